@@ -1,7 +1,5 @@
 import json
-from typing import Union
-
-from .vendor.lslopt.lslfuncs import typecast, Quaternion, Vector, Key, cond, neg
+from typing import List, Union
 
 from .lslexecutils import *
 from .goto import with_goto, label, goto
@@ -9,38 +7,166 @@ from .exceptions import CompileError
 import lummao._compiler as compiler_mod  # noqa
 
 
-def convert_script(lsl_contents: Union[str, bytes]) -> bytes:
-    """Convert an LSL script to a Python script, returning the Python text"""
+def convert_script(lsl_contents: Union[str, bytes], **options) -> bytes:
+    """
+    Convert an LSL script to a Python script, returning the Python text
+
+    Keyword arguments are passed through to the compiler as options:
+      * `lazy_methods`: Only compile functions and event handlers when first used
+      * `promote_loop_globals`: Cache globals in locals within loops that make no calls
+      * `elide_int_wraparound`: Use plain integer ops where they provably can't overflow
+      * `simplify_casts`: Drop redundant typecasts and inline the simple ones
+      * `bind_helpers`: Bind runtime helpers and repeatedly called methods to locals,
+        use `rebind_helpers()` to replace helpers in the compiled script
+      * `switch_dispatch`: Dispatch long `if` chains comparing against constants through a dict
+      * `typed_output`: Generate synchronous code that passes `mypy --strict`, suitable for compiling
+        with mypyc. The script class derives from `SyncLSLScript`, and `jump` is rejected, as is
+        combining it with `lazy_methods` or `bind_helpers`.
+      * `instrument`: Record call counts, branch outcomes and loop trip counts in `script.profile`
+      * `profile`: A `ScriptProfile` (or its JSON form) from an instrumented run to optimize for
+      * `eliminate_dead_vars`: Drop locals and globals that are never read, and stores to locals
+        that are always overwritten before they're read. Dropped globals won't exist on the script.
+      * `tree_shaking`: Drop functions no event handler can reach, and have identical functions
+        share one definition. Merged functions are left as aliases of the one that was kept.
+      * `max_expression_depth`: Split binary operations nested deeper than this into
+        sequenced temporaries so CPython can compile them, 0 (the default) means no limit.
+    """
     if isinstance(lsl_contents, str):
         lsl_bytes = lsl_contents.encode("utf8")
     else:
         lsl_bytes = lsl_contents
-    return compiler_mod.lsl_to_python_src(lsl_bytes)
+    profile = options.get("profile")
+    if isinstance(profile, ScriptProfile):
+        profile = profile.to_json()
+    if isinstance(profile, dict):
+        options["profile"] = json.dumps(profile)
+    return compiler_mod.lsl_to_python_src(lsl_bytes, **options)
 
 
-def convert_script_file(path) -> bytes:
+def convert_script_file(path, **options) -> bytes:
     """Convert an LSL script file to a Python script, returning the Python text"""
     with open(path, "rb") as f:
-        return convert_script(f.read())
+        return convert_script(f.read(), **options)
 
 
-def compile_script(lsl_contents: Union[str, bytes]) -> BaseLSLScript:
+def compile_script(lsl_contents: Union[str, bytes], **options) -> BaseLSLScript:
     """Compile an LSL script to a Python class, returning a class instance"""
     new_globals = globals().copy()
-    exec(convert_script(lsl_contents), new_globals)
+    exec(convert_script(lsl_contents, **options), new_globals)
     return new_globals["Script"]()
 
 
-def compile_script_file(path) -> BaseLSLScript:
+def compile_script_file(path, **options) -> BaseLSLScript:
     """Compile an LSL script file to a Python class, returning a class instance"""
     with open(path, "rb") as f:
-        return compile_script(f.read())
+        return compile_script(f.read(), **options)
+
+
+def convert_script_to_ir(lsl_contents: Union[str, bytes], **options) -> Dict:
+    """
+    Convert an LSL script to a stack-based IR, returning the parsed JSON
+
+    Keyword arguments are passed through to the compiler as options:
+      * `jump_tables`: Emit `JUMP_TABLE` ops for long `if` chains comparing against constants
+      * `tree_shaking`: Drop functions no event handler can reach, and call a single copy
+        of identical functions
+      * `peephole`: Clean up the generated code, either `True` for every rule, or a rule name
+        or collection of rule names out of `push_pop`, `dup_store_pop`, `jump_threading`, `jump_to_next`,
+        `unreachable_code` and `cast_pairs`. How much each rule removed goes in `peephole_stats`.
+      * `eliminate_dead_stores`: Drop unreachable blocks, and stores to locals and args whose values
+        are never read. What was removed goes in `dataflow_stats`.
+      * `cfg`: Include each function's control flow graph under `cfg`, either as JSON (`True` or `"json"`)
+        or as a Graphviz string (`"dot"`). Blocks refer to ranges of the function's `code`.
+      * `resolve`: Refer to everything by index instead of by name. Labels are dropped and jumps
+        get the index of the op to go to in `target`, `CALL` gets its index in `functions` as `function`,
+        `CALL_LIB` gets its index in the new `builtins` signature table as `builtin` and `CHANGE_STATE`
+        gets its index in `states` as `state`.
+      * `reuse_local_slots`: Let locals of the same type share a slot in `locals` when their blocks
+        are never active at the same time. Functions with labels keep a slot per local. How many
+        locals were declared and how many reused a slot goes in `local_slot_stats`.
+      * `stack_depths`: Give every op its net `stack_effect`, every reachable label the `stack_depth`
+        on entry, and every function and handler the deepest its stack gets as `max_stack`
+        (`init_max_stack` for `init_code`). With `resolve`, label depths move to the op they pointed to.
+      * `verify_types`: Check that every op finds values of the types it expects on the stack, that loads
+        and stores match the declared types and that all paths into a label agree on the stack. Each op
+        gets the types on the stack before it runs as `stack_types`. Raises `RuntimeError` if the check fails.
+      * `data_section`: Give each global its initial value as an index into a `constants` table in `data`,
+        with identical values sharing an entry and lists holding the indices of their elements. Only
+        globals whose initializers aren't constant are still set by `init_code`, they start out with
+        their type's default value.
+      * `superinstructions`: Fuse common runs of ops into single `INCR_LOCAL`, `CMP_LOCAL_CONST_JUMP`
+        and `STORE_CONSTANT` ops. `lummao.ir_stats` can find which runs are common.
+    """
+    if isinstance(lsl_contents, str):
+        lsl_bytes = lsl_contents.encode("utf8")
+    else:
+        lsl_bytes = lsl_contents
+    return json.loads(compiler_mod.lsl_to_ir(lsl_bytes, **options))
+
+
+def convert_script_to_register_ir(lsl_contents: Union[str, bytes], **options) -> Dict:
+    """
+    Convert an LSL script to a three-address IR where every value lives in a typed register
+    that's only assigned once, and each function's code is split into basic blocks.
+
+    Takes the same options as `convert_script_to_ir()`, other than `superinstructions`, `resolve`,
+    `stack_depths`, `verify_types` and `cfg`. It also takes:
+      * `cse`: Reuse the result of an operator, cast or call to a pure builtin instead of computing
+        it again later in the same block
+      * `licm`: Compute those once before a loop when nothing they depend on changes within it
+    What these removed or moved goes in `redundancy_stats`. `register_ir_to_stack_ir()` stores
+    values used more than once in new locals.
+    """
+    if isinstance(lsl_contents, str):
+        lsl_bytes = lsl_contents.encode("utf8")
+    else:
+        lsl_bytes = lsl_contents
+    return json.loads(compiler_mod.lsl_to_register_ir(lsl_bytes, **options))
+
+
+def register_ir_to_stack_ir(register_ir: Dict, **options) -> Dict:
+    """
+    Convert register IR back to the stack-based IR `convert_script_to_ir()` returns
+
+    `verify_types` checks the converted IR the same way `convert_script_to_ir()` does,
+    raising `ValueError` if it's malformed.
+    """
+    return json.loads(compiler_mod.register_ir_to_stack_ir(json.dumps(register_ir).encode("utf8"), **options))
+
+
+def minify_script(lsl_contents: Union[str, bytes], **options) -> bytes:
+    """
+    Shrink an LSL script, returning the LSL text
+
+    Keyword arguments are passed through to the compiler as options, all of them default to `True`:
+      * `fold_constants`: Replace expressions with their value where it can be computed up front
+      * `remove_dead_code`: Drop unreachable functions, unused globals, locals that are never read,
+        branches that can never be taken and statements after a `return` or `jump`.
+        Identical functions share one definition.
+      * `shorten_identifiers`: Rename globals, functions, locals and labels to the shortest names available
+    """
+    if isinstance(lsl_contents, str):
+        lsl_bytes = lsl_contents.encode("utf8")
+    else:
+        lsl_bytes = lsl_contents
+    return compiler_mod.lsl_to_minified_lsl(lsl_bytes, **options)
+
+
+def minify_script_file(path, **options) -> bytes:
+    """Shrink an LSL script file, returning the LSL text"""
+    with open(path, "rb") as f:
+        return minify_script(f.read(), **options)
+
 
+def perf_lint_script(lsl_contents: Union[str, bytes]) -> List[Dict]:
+    """
+    Look for code in an LSL script that's likely to be slow or waste memory in-world
 
-def convert_script_to_ir(lsl_contents: Union[str, bytes]) -> Dict:
-    """Convert an LSL script to a Python script, returning the Python text"""
+    Returns a list of findings, each a dict with the `line` and `column` in the source
+    the finding applies to, a short `code` for the kind of problem and a `message` describing it.
+    """
     if isinstance(lsl_contents, str):
         lsl_bytes = lsl_contents.encode("utf8")
     else:
         lsl_bytes = lsl_contents
-    return json.loads(compiler_mod.lsl_to_ir(lsl_bytes))
+    return json.loads(compiler_mod.lsl_perf_lint(lsl_bytes))
@@ -1,27 +1,123 @@
+import argparse
 import sys
 
 import lummao
 
 
 def cli_main():
-    if len(sys.argv) != 3:
-        print("Usage:", sys.argv[0], "<input_file>", "<output_file>", file=sys.stderr)
-        sys.exit(1)
+    parser = argparse.ArgumentParser(description="Convert an LSL script to Python")
+    parser.add_argument("input_file", help="LSL file to convert, or - for stdin")
+    parser.add_argument(
+        "output_file", nargs="?", default="-",
+        help="Python (or minified LSL) file to write, or - for stdout. Optional, stdout is used when it's left out",
+    )
+    parser.add_argument(
+        "--lazy", action="store_true",
+        help="only compile functions and event handlers the first time they're used",
+    )
+    parser.add_argument(
+        "--promote-loop-globals", action="store_true",
+        help="cache globals in locals within loops that make no function calls",
+    )
+    parser.add_argument(
+        "--elide-int-wraparound", action="store_true",
+        help="use plain integer arithmetic where it provably can't overflow",
+    )
+    parser.add_argument(
+        "--simplify-casts", action="store_true",
+        help="drop redundant typecasts and inline the simple ones",
+    )
+    parser.add_argument(
+        "--bind-helpers", action="store_true",
+        help="bind runtime helpers and repeatedly called methods to locals",
+    )
+    parser.add_argument(
+        "--switch-dispatch", action="store_true",
+        help="dispatch long if chains comparing against constants through a dict",
+    )
+    parser.add_argument(
+        "--typed", action="store_true",
+        help="generate synchronous, strictly typed code that mypyc can compile",
+    )
+    parser.add_argument(
+        "--instrument", action="store_true",
+        help="record call counts, branch outcomes and loop trip counts in `script.profile`",
+    )
+    parser.add_argument(
+        "--profile", metavar="PROFILE_JSON",
+        help="optimize using a profile saved from an instrumented script's `profile.to_json()`",
+    )
+    parser.add_argument(
+        "--eliminate-dead-vars", action="store_true",
+        help="drop variables that are never read and stores that are always overwritten before a read",
+    )
+    parser.add_argument(
+        "--tree-shaking", action="store_true",
+        help="drop unreachable functions and merge identical ones",
+    )
+    parser.add_argument(
+        "--max-expression-depth", type=int, default=0, metavar="DEPTH",
+        help="split binary operations nested deeper than this so CPython can compile them",
+    )
+    parser.add_argument(
+        "--minify", action="store_true",
+        help="write out a smaller version of the LSL script instead of converting it to Python",
+    )
+    parser.add_argument(
+        "--keep-names", action="store_true",
+        help="don't shorten identifiers when minifying",
+    )
+    parser.add_argument(
+        "--perf-lint", action="store_true",
+        help="report code that's likely to be slow or waste memory in-world instead of converting",
+    )
+    args = parser.parse_args()
 
-    if sys.argv[1] == "-":
+    if args.input_file == "-":
         in_bytes = sys.stdin.read()
     else:
-        with open(sys.argv[1], "rb") as f:
+        with open(args.input_file, "rb") as f:
             in_bytes = f.read()
 
-    converted = lummao.convert_script(in_bytes)
+    profile = None
+    if args.profile:
+        with open(args.profile, "r") as f:
+            profile = f.read()
+
+    if args.perf_lint:
+        findings = lummao.perf_lint_script(in_bytes)
+        report = "".join(
+            "(%3d,%3d): [%s] %s\n" % (f["line"], f["column"], f["code"], f["message"]) for f in findings
+        )
+        converted = report.encode("utf8")
+    elif args.minify:
+        converted = lummao.minify_script(in_bytes, shorten_identifiers=not args.keep_names)
+    else:
+        converted = lummao.convert_script(
+            in_bytes,
+            lazy_methods=args.lazy,
+            promote_loop_globals=args.promote_loop_globals,
+            elide_int_wraparound=args.elide_int_wraparound,
+            simplify_casts=args.simplify_casts,
+            bind_helpers=args.bind_helpers,
+            switch_dispatch=args.switch_dispatch,
+            typed_output=args.typed,
+            instrument=args.instrument,
+            profile=profile,
+            eliminate_dead_vars=args.eliminate_dead_vars,
+            tree_shaking=args.tree_shaking,
+            max_expression_depth=args.max_expression_depth,
+        )
 
-    if sys.argv[2] == "-":
+    if args.output_file == "-":
         sys.stdout.buffer.write(converted)
     else:
-        with open(sys.argv[2], "wb") as f:
+        with open(args.output_file, "wb") as f:
             f.write(converted)
 
+    if args.perf_lint and converted:
+        sys.exit(1)
+
 
 if __name__ == "__main__":
     cli_main()
@@ -116,16 +116,16 @@ def with_goto(func_or_code):
     if isinstance(func_or_code, types.CodeType):
         return _patch_code(func_or_code)
 
-    return functools.update_wrapper(
-        types.FunctionType(
-            _patch_code(func_or_code.__code__),
-            func_or_code.__globals__,
-            func_or_code.__name__,
-            func_or_code.__defaults__,
-            func_or_code.__closure__,
-        ),
-        func_or_code
+    new_func = types.FunctionType(
+        _patch_code(func_or_code.__code__),
+        func_or_code.__globals__,
+        func_or_code.__name__,
+        func_or_code.__defaults__,
+        func_or_code.__closure__,
     )
+    # Not covered by the constructor, and generated code may bind helpers through these
+    new_func.__kwdefaults__ = func_or_code.__kwdefaults__
+    return functools.update_wrapper(new_func, func_or_code)
 
 
 class _CatchAll:
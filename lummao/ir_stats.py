@@ -0,0 +1,81 @@
+"""
+Find out which runs of IR ops are common across a set of scripts, to decide what's
+worth fusing into a superinstruction.
+
+    python -m lummao.ir_stats --length 3 scripts/*.lsl
+"""
+import argparse
+import collections
+import sys
+from typing import Dict, Iterable, Iterator, List
+
+import lummao
+
+# Fields that make an op behave differently enough to be its own superinstruction
+_KEY_FIELDS = ("whence", "operation", "jump_type", "type", "left_type", "right_type")
+
+
+def op_key(instr: Dict) -> str:
+    """Name an op along with whatever it's specialized on, like `PUSH LOCAL integer`"""
+    return " ".join([instr["op"]] + [instr[field] for field in _KEY_FIELDS if field in instr])
+
+
+def iter_ir_code(ir: Dict) -> Iterator[List[Dict]]:
+    """Every block of code in a script's IR"""
+    yield ir["init_code"]
+    for func in ir["functions"]:
+        yield func["code"]
+    for state in ir["states"]:
+        for handler in state["handlers"]:
+            yield handler["code"]
+
+
+def count_op_sequences(ir: Dict, length: int = 2) -> collections.Counter:
+    """
+    Count each run of `length` ops in a script's IR.
+
+    Runs never span a label, anything fused from them would have a jump target in the middle.
+    """
+    counts = collections.Counter()
+    for code in iter_ir_code(ir):
+        window: List[str] = []
+        for instr in code:
+            if instr["instr_type"] == "label":
+                window.clear()
+                continue
+            window.append(op_key(instr))
+            if len(window) > length:
+                window.pop(0)
+            if len(window) == length:
+                counts[tuple(window)] += 1
+    return counts
+
+
+def mine_op_sequences(paths: Iterable, length: int = 2, **options) -> collections.Counter:
+    """Count runs of ops across a corpus of LSL files, options are passed to `convert_script_to_ir()`"""
+    counts = collections.Counter()
+    for path in paths:
+        with open(path, "rb") as f:
+            counts.update(count_op_sequences(lummao.convert_script_to_ir(f.read(), **options), length))
+    return counts
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Count the most common runs of IR ops in LSL scripts")
+    parser.add_argument("input_files", nargs="+", help="LSL files to analyze")
+    parser.add_argument("--length", type=int, default=2, help="number of ops in each run")
+    parser.add_argument("--top", type=int, default=20, help="how many of the most common runs to show")
+    parser.add_argument(
+        "--superinstructions", action="store_true",
+        help="count what's left after the existing superinstructions are fused",
+    )
+    args = parser.parse_args()
+
+    counts = mine_op_sequences(args.input_files, args.length, superinstructions=args.superinstructions)
+    total = sum(counts.values()) or 1
+    for sequence, count in counts.most_common(args.top):
+        sys.stdout.write("%8d %5.1f%%  %s\n" % (count, count * 100.0 / total, " ; ".join(sequence)))
+
+
+if __name__ == "__main__":
+    main()
@@ -27,11 +27,15 @@ import functools
 import struct
 import sys
 import time
+import types
 import uuid
 import weakref
-from typing import List, Sequence, Tuple, Any, Optional, Dict, Callable, Set, Coroutine
+from typing import List, Sequence, Tuple, Any, Optional, Dict, Callable, Set, Coroutine, Type, TypeVar
+from typing import TYPE_CHECKING, overload
 
 from .vendor.lslopt import lslfuncs, lslcommon
+# Re-exported explicitly so they're visible through `from lummao import *` under `mypy --strict`
+from .vendor.lslopt.lslcommon import Key as Key, Vector as Vector, Quaternion as Quaternion
 
 lslcommon.IsCalc = True
 
@@ -51,88 +55,161 @@ def bin2float(_ignored: str, flt_str: str) -> float:
     return struct.unpack("f", binascii.unhexlify(flt_str))[0]
 
 
-def radd(rhs, lhs, f32=True):
+_T = TypeVar("_T")
+_CoordT = TypeVar("_CoordT", Vector, Quaternion)
+
+
+if TYPE_CHECKING:
+    # The vendored implementations are untyped, describe them for `typed_output` scripts
+    def typecast(val: Any, out: Type[_T], InList: bool = False, f32: bool = True) -> _T: ...
+
+    def cond(val: Any) -> bool: ...
+
+    def neg(val: _T) -> _T: ...
+else:
+    from .vendor.lslopt.lslfuncs import typecast, cond, neg
+
+
+# The arithmetic helpers' overloads mirror LSL's operator table, so `typed_output`
+# scripts get a precise result type for every combination of operand types.
+@overload
+def radd(rhs: int, lhs: int, f32: bool = ...) -> int: ...
+@overload
+def radd(rhs: float, lhs: float, f32: bool = ...) -> float: ...
+@overload
+def radd(rhs: str, lhs: str, f32: bool = ...) -> str: ...
+@overload
+def radd(rhs: _CoordT, lhs: _CoordT, f32: bool = ...) -> _CoordT: ...
+@overload
+def radd(rhs: Any, lhs: List[Any], f32: bool = ...) -> List[Any]: ...
+@overload
+def radd(rhs: List[Any], lhs: Any, f32: bool = ...) -> List[Any]: ...
+
+
+def radd(rhs: Any, lhs: Any, f32: bool = True) -> Any:
     return lslfuncs.add(lhs, rhs, f32)
 
 
-def rsub(rhs, lhs, f32=True):
+@overload
+def rsub(rhs: int, lhs: int, f32: bool = ...) -> int: ...
+@overload
+def rsub(rhs: float, lhs: float, f32: bool = ...) -> float: ...
+@overload
+def rsub(rhs: _CoordT, lhs: _CoordT, f32: bool = ...) -> _CoordT: ...
+
+
+def rsub(rhs: Any, lhs: Any, f32: bool = True) -> Any:
     return lslfuncs.sub(lhs, rhs, f32)
 
 
-def rmul(rhs, lhs, f32=True):
+@overload
+def rmul(rhs: int, lhs: int, f32: bool = ...) -> int: ...
+@overload
+def rmul(rhs: float, lhs: float, f32: bool = ...) -> float: ...
+@overload
+def rmul(rhs: Vector, lhs: Vector, f32: bool = ...) -> float: ...
+@overload
+def rmul(rhs: float, lhs: Vector, f32: bool = ...) -> Vector: ...
+@overload
+def rmul(rhs: Vector, lhs: float, f32: bool = ...) -> Vector: ...
+@overload
+def rmul(rhs: Quaternion, lhs: Vector, f32: bool = ...) -> Vector: ...
+@overload
+def rmul(rhs: Quaternion, lhs: Quaternion, f32: bool = ...) -> Quaternion: ...
+
+
+def rmul(rhs: Any, lhs: Any, f32: bool = True) -> Any:
     return lslfuncs.mul(lhs, rhs, f32)
 
 
-def rdiv(rhs, lhs, f32=True):
+@overload
+def rdiv(rhs: int, lhs: int, f32: bool = ...) -> int: ...
+@overload
+def rdiv(rhs: float, lhs: float, f32: bool = ...) -> float: ...
+@overload
+def rdiv(rhs: float, lhs: Vector, f32: bool = ...) -> Vector: ...
+@overload
+def rdiv(rhs: Quaternion, lhs: Vector, f32: bool = ...) -> Vector: ...
+@overload
+def rdiv(rhs: Quaternion, lhs: Quaternion, f32: bool = ...) -> Quaternion: ...
+
+
+def rdiv(rhs: Any, lhs: Any, f32: bool = True) -> Any:
     return lslfuncs.div(lhs, rhs, f32)
 
 
-def rmod(rhs, lhs, f32=True):
+@overload
+def rmod(rhs: int, lhs: int, f32: bool = ...) -> int: ...
+@overload
+def rmod(rhs: Vector, lhs: Vector, f32: bool = ...) -> Vector: ...
+
+
+def rmod(rhs: Any, lhs: Any, f32: bool = True) -> Any:
     return lslfuncs.mod(lhs, rhs, f32)
 
 
-def req(rhs, lhs):
+def req(rhs: Any, lhs: Any) -> int:
     return lslfuncs.compare(lhs, rhs, True)
 
 
-def rneq(rhs, lhs):
+def rneq(rhs: Any, lhs: Any) -> int:
     return lslfuncs.compare(lhs, rhs, False)
 
 
-def rless(rhs, lhs):
+def rless(rhs: Any, lhs: Any) -> int:
     return lslfuncs.less(lhs, rhs)
 
 
-def rgreater(rhs, lhs):
+def rgreater(rhs: Any, lhs: Any) -> int:
     return lslfuncs.less(rhs, lhs)
 
 
-def rleq(rhs, lhs):
+def rleq(rhs: Any, lhs: Any) -> int:
     return int(not rgreater(rhs, lhs))
 
 
-def rgeq(rhs, lhs):
+def rgeq(rhs: Any, lhs: Any) -> int:
     return int(not rless(rhs, lhs))
 
 
-def rbooland(rhs, lhs):
+def rbooland(rhs: Any, lhs: Any) -> int:
     return int(bool(lhs and rhs))
 
 
-def rboolor(rhs, lhs):
+def rboolor(rhs: Any, lhs: Any) -> int:
     return int(bool(lhs or rhs))
 
 
-def rbitxor(rhs, lhs):
+def rbitxor(rhs: int, lhs: int) -> int:
     return lslfuncs.S32(lhs ^ rhs)
 
 
-def rbitor(rhs, lhs):
+def rbitor(rhs: int, lhs: int) -> int:
     return lslfuncs.S32(lhs | rhs)
 
 
-def rbitand(rhs, lhs):
+def rbitand(rhs: int, lhs: int) -> int:
     return lslfuncs.S32(lhs & rhs)
 
 
-def rshl(rhs, lhs):
+def rshl(rhs: int, lhs: int) -> int:
     return lslfuncs.S32(lhs << (rhs & 31))
 
 
-def rshr(rhs, lhs):
+def rshr(rhs: int, lhs: int) -> int:
     # 99% sure this does sign-extension correctly
     return lslfuncs.S32(lhs >> (rhs & 31))
 
 
-def bitnot(val):
+def bitnot(val: int) -> int:
     return lslfuncs.S32(~val)
 
 
-def boolnot(val):
+def boolnot(val: Any) -> int:
     return int(not val)
 
 
-def replace_coord_axis(coord_val, member_idx, new_val):
+def replace_coord_axis(coord_val: _CoordT, member_idx: int, new_val: float) -> _CoordT:
     new_coord = []
     for i, axis_val in enumerate(coord_val):
         if i == member_idx:
@@ -156,7 +233,8 @@ def prepostincrdecr(sym_scope, sym_name, mod_amount, post, member_idx, frame):
     new_val = radd(orig_val, mod_amount)
 
     if member_idx is not None:
-        new_sym_val = replace_coord_axis(sym_val, member_idx, sym_val[member_idx] + mod_amount)
+        # Splice the new member in directly rather than rebuilding the coord member-by-member
+        new_sym_val = sym_val.__class__(sym_val[:member_idx] + (new_val,) + sym_val[member_idx + 1:])
     else:
         new_sym_val = new_val
 
@@ -195,9 +273,119 @@ def postdecr(sym_scope, sym_name, member_idx=None):
     return prepostincrdecr(sym_scope, sym_name, -1, True, member_idx, sys._getframe(1))  # noqa
 
 
+class LazyMethod:
+    """
+    Method whose source is only compiled the first time it's looked up
+
+    Large scripts with many states spend most of their construction time compiling
+    handlers that a given test may never run, so lazily compiled scripts defer that.
+    """
+    def __init__(self, name: str, src: str, module_globals: Dict[str, Any]):
+        self.name = name
+        self.src = src
+        self.module_globals = module_globals
+        self.owner: Optional[type] = None
+        # Every name we're bound to on the owner, aliases included
+        self.attr_names: List[str] = []
+        self.func: Optional[Callable] = None
+        # From `rebind_helpers()` calls before we were materialized
+        self.helper_overrides: Dict[str, Any] = {}
+
+    def __set_name__(self, owner, name):
+        self.owner = owner
+        self.attr_names.append(name)
+
+    def copy(self, owner: type) -> "LazyMethod":
+        method_copy = LazyMethod(self.name, self.src, self.module_globals)
+        method_copy.owner = owner
+        method_copy.helper_overrides = dict(self.helper_overrides)
+        return method_copy
+
+    def materialize(self) -> Callable:
+        if self.func is None:
+            method_locals = {}
+            exec(compile(self.src, f"<lummao method {self.name}>", "exec"), self.module_globals, method_locals)
+            self.func = method_locals[self.name]
+            _rebind_func_helpers(self.func, self.helper_overrides)
+        # Replace ourselves on the class so later lookups are just normal method lookups
+        for attr_name in self.attr_names:
+            if vars(self.owner).get(attr_name) is self:
+                setattr(self.owner, attr_name, self.func)
+        return self.func
+
+    def __get__(self, instance, owner=None):
+        func = self.materialize()
+        if instance is None:
+            return func
+        return func.__get__(instance, owner)
+
+
+def lazy_method(name: str, src: str) -> LazyMethod:
+    # Needs to be compiled with the globals of the module the class is being defined in
+    return LazyMethod(name, src, sys._getframe(1).f_globals)  # noqa
+
+
+def _rebind_func_helpers(func: Callable, helpers: Dict[str, Any]) -> bool:
+    kwdefaults = getattr(func, "__kwdefaults__", None)
+    if not kwdefaults:
+        return False
+    rebound = False
+    for name, helper in helpers.items():
+        if name in kwdefaults:
+            kwdefaults[name] = helper
+            rebound = True
+    return rebound
+
+
+def _copy_func(func: types.FunctionType) -> types.FunctionType:
+    func_copy = types.FunctionType(func.__code__, func.__globals__, func.__name__, func.__defaults__, func.__closure__)
+    func_copy.__kwdefaults__ = dict(func.__kwdefaults__ or {})
+    func_copy.__qualname__ = func.__qualname__
+    func_copy.__dict__.update(func.__dict__)
+    return func_copy
+
+
+def rebind_helpers(script_cls: type, **helpers):
+    """
+    Replace runtime helpers in a script compiled with `bind_helpers`
+
+    Those scripts capture helpers like `radd` when their methods are defined,
+    so patching the module globals won't affect them. This affects every
+    instance of the script class, methods inherited from other classes are
+    copied onto it first so those classes keep their own helpers.
+    """
+    if not isinstance(script_cls, type):
+        script_cls = type(script_cls)
+    seen_names: Set[str] = set()
+    # Aliases of an inherited lazy method need to keep sharing one copy
+    lazy_copies: Dict[LazyMethod, LazyMethod] = {}
+    for klass in script_cls.__mro__:
+        for name, val in list(vars(klass).items()):
+            # Overridden further down the hierarchy
+            if name in seen_names:
+                continue
+            seen_names.add(name)
+            if isinstance(val, LazyMethod):
+                if klass is not script_cls:
+                    if val not in lazy_copies:
+                        lazy_copies[val] = val.copy(script_cls)
+                    val = lazy_copies[val]
+                    val.attr_names.append(name)
+                    setattr(script_cls, name, val)
+                val.helper_overrides.update(helpers)
+            elif isinstance(val, types.FunctionType):
+                if klass is not script_cls:
+                    val = _copy_func(val)
+                    if not _rebind_func_helpers(val, helpers):
+                        continue
+                    setattr(script_cls, name, val)
+                else:
+                    _rebind_func_helpers(val, helpers)
+
+
 class StateChangeException(Exception):
     """Signal that the state should change, unwinding the stack"""
-    def __init__(self, new_state: str):
+    def __init__(self, new_state: str) -> None:
         self.new_state = new_state
 
 
@@ -236,13 +424,19 @@ class BuiltinsCollection(Dict[str, Callable]):
         value = _make_async(value)
         super().__setitem__(key, value)
 
-    def __getattr__(self, item):
+    def __getattr__(self, item: str) -> Callable[..., Any]:
         return self[item]
 
 
+class SyncBuiltinsCollection(BuiltinsCollection):
+    """Builtins for scripts compiled with `typed_output`, which never `await` them"""
+    def __setitem__(self, key, value):
+        dict.__setitem__(self, key, value)
+
+
 @dataclasses.dataclass
 class DetectedDetails:
-    Key: lslcommon.Key = lslcommon.Key(uuid.UUID(int=0))
+    Key: lslcommon.Key = lslcommon.Key(uuid.UUID(int=0))  # noqa: F811
     Owner: lslcommon.Key = lslcommon.Key(uuid.UUID(int=0))
     Group: lslcommon.Key = lslcommon.Key(uuid.UUID(int=0))
     Name: str = ""
@@ -260,15 +454,60 @@ class DetectedDetails:
     Grab: lslcommon.Vector = dataclasses.field(default_factory=lambda: lslcommon.Vector((0, 0, 0)))
 
 
-class BaseLSLScript:
+class ScriptProfile:
+    """
+    Execution counts recorded by a script compiled with `instrument`
+
+    Pass it back in as the `profile` option to recompile the script using it.
+    Branches and loops are keyed on their "line:column" in the LSL source.
+    """
     def __init__(self):
+        self.calls: Dict[str, int] = {}
+        # [taken, not taken]
+        self.branches: Dict[str, List[int]] = {}
+        # [times entered, total iterations]
+        self.loops: Dict[str, List[int]] = {}
+
+    def record_call(self, name: str) -> None:
+        self.calls[name] = self.calls.get(name, 0) + 1
+
+    def record_branch(self, key: str, val: int) -> int:
+        counts = self.branches.get(key)
+        if counts is None:
+            counts = self.branches[key] = [0, 0]
+        counts[0 if val else 1] += 1
+        return val
+
+    def record_loop_entry(self, key: str) -> None:
+        counts = self.loops.get(key)
+        if counts is None:
+            counts = self.loops[key] = [0, 0]
+        counts[0] += 1
+
+    def record_loop_iteration(self, key: str) -> None:
+        self.loops[key][1] += 1
+
+    def to_json(self) -> Dict[str, Any]:
+        return {
+            "calls": dict(self.calls),
+            "branches": {k: {"taken": v[0], "not_taken": v[1]} for k, v in self.branches.items()},
+            "loops": {k: {"entries": v[0], "iterations": v[1]} for k, v in self.loops.items()},
+        }
+
+
+class BaseLSLScript:
+    builtins_collection_cls = BuiltinsCollection
+
+    def __init__(self) -> None:
         self.current_state: str = "default"
         self.next_state: Optional[str] = None
         self.detected_stack: List[DetectedDetails] = []
         self.event_queue: List[Tuple[str, Sequence[Any], List[DetectedDetails]]] = [("state_entry", (), [])]
         # Things that may publish to the event queue asynchronously
         self.event_publishers: weakref.WeakKeyDictionary[Any] = weakref.WeakKeyDictionary()
-        self.builtin_funcs = BuiltinsCollection()
+        self.builtin_funcs = self.builtins_collection_cls()
+        # Only filled in when compiled with `instrument`
+        self.profile = ScriptProfile()
         # Patch llDetected* builtins so that they return details related to the current event
         for field in dataclasses.fields(DetectedDetails):
             self.builtin_funcs['llDetected' + field.name] = self._make_detected_wrapper(field.name)
@@ -304,24 +543,29 @@ class BaseLSLScript:
             finally:
                 self.detected_stack = []
 
+    def _handled_event(self, event: str):
+        # TODO: Check this is correct, is changing state in state_exit possible?
+        if event == "state_exit":
+            # Need to queue a state_entry for the new state
+            self.current_state = self.next_state
+            self.next_state = None
+            self.event_queue.clear()
+            self.event_queue.append(("state_entry", (), []))
+
+    def _requested_state_change(self, new_state: str):
+        self.next_state = new_state
+        # Switching states blows away the event stack
+        self.event_queue.clear()
+        self.event_queue.append(("state_exit", (), []))
+
     async def execute_one(self):
         """Execute a single event from the event queue"""
         event, event_args, detected_stack = self.event_queue.pop(0)
         try:
             await self._trigger_event_handler(event, *event_args, detected_stack=detected_stack)
-            # TODO: Check this is correct, is changing state in state_exit possible?
-            if event == "state_exit":
-                # Need to queue a state_entry for the new state
-                self.current_state = self.next_state
-                self.next_state = None
-                self.event_queue.clear()
-                self.event_queue.append(("state_entry", (), []))
-
+            self._handled_event(event)
         except StateChangeException as e:
-            self.next_state = e.new_state
-            # Switching states blows away the event stack
-            self.event_queue.clear()
-            self.event_queue.append(("state_exit", (), []))
+            self._requested_state_change(e.new_state)
 
     async def execute(self) -> bool:
         """Execute all events on the event queue"""
@@ -344,6 +588,46 @@ class BaseLSLScript:
         return handled
 
 
+class SyncLSLScript(BaseLSLScript):
+    """
+    Base for scripts compiled with `typed_output`
+
+    Event handlers and functions are plain synchronous methods, so events are
+    executed synchronously as well. Builtins that need to be awaited can't be
+    used from these scripts, and nothing can publish events in the background.
+    """
+    builtins_collection_cls = SyncBuiltinsCollection
+
+    def _trigger_event_handler(self, name: str, *args, detected_stack):  # type: ignore[override]
+        func = getattr(self, f"e{self.current_state}{name}", None)
+        if func is not None:
+            self.detected_stack = detected_stack
+            try:
+                func(*args)
+            finally:
+                self.detected_stack = []
+
+    def execute_one(self):  # type: ignore[override]
+        """Execute a single event from the event queue"""
+        event, event_args, detected_stack = self.event_queue.pop(0)
+        try:
+            self._trigger_event_handler(event, *event_args, detected_stack=detected_stack)
+            self._handled_event(event)
+        except StateChangeException as e:
+            self._requested_state_change(e.new_state)
+
+    def execute(self) -> bool:  # type: ignore[override]
+        """Execute all events on the event queue"""
+        handled = False
+        while self.event_queue:
+            handled = True
+            self.execute_one()
+        return handled
+
+    def execute_until_complete(self) -> bool:  # type: ignore[override]
+        return self.execute()
+
+
 class ScriptExtender(abc.ABC):
     """Base class for something that extends a single script, modifying its environment"""
     script: Optional[BaseLSLScript]
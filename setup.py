@@ -76,7 +76,7 @@ setup(
     ext_modules=[
         AutobuildExtension(
             "lummao._compiler",
-            sources=["src/python_pass.cc", "src/json_ir_pass.cc", "src/compiler.cc"],
+            sources=["src/python_pass.cc", "src/json_ir_pass.cc", "src/ir_peephole.cc", "src/ir_superinstructions.cc", "src/register_ir.cc", "src/register_ir_opt.cc", "src/ir_cfg.cc", "src/ir_resolve.cc", "src/ir_stack_depth.cc", "src/ir_verify.cc", "src/lsl_pass.cc", "src/perf_lint.cc", "src/ast_utils.cc", "src/int_ranges.cc", "src/cast_simplification.cc", "src/switch_detection.cc", "src/script_profile.cc", "src/tree_shaking.cc", "src/compiler.cc"],
             define_macros=[("Py_LIMITED_API", "0x03080000")],
             libraries=["tailslide"],
             library_dirs=["build/packages/lib/release"],
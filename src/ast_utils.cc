@@ -0,0 +1,271 @@
+#include "ast_utils.hh"
+
+namespace Tailslide {
+
+bool is_assignment_op(LSLOperator op) {
+  switch (op) {
+    case '=':
+    case OP_ADD_ASSIGN:
+    case OP_SUB_ASSIGN:
+    case OP_MUL_ASSIGN:
+    case OP_DIV_ASSIGN:
+    case OP_MOD_ASSIGN:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool is_incr_decr_op(LSLOperator op) {
+  return op == OP_POST_DECR || op == OP_POST_INCR || op == OP_PRE_DECR || op == OP_PRE_INCR;
+}
+
+bool AssignmentFindingVisitor::visit(LSLBinaryExpression *bin_expr) {
+  if (is_assignment_op(bin_expr->getOperation()) && matches(bin_expr->getLHS()->getSymbol()))
+    mFound = true;
+  return !mFound;
+}
+
+bool AssignmentFindingVisitor::visit(LSLUnaryExpression *unary_expr) {
+  if (is_incr_decr_op(unary_expr->getOperation()) && matches(unary_expr->getChildExpr()->getSymbol()))
+    mFound = true;
+  return !mFound;
+}
+
+bool AssignmentFindingVisitor::visit(LSLFunctionExpression *func_expr) {
+  // Anything we call may assign to globals, even builtins if they've been mocked.
+  if (!_mSym || _mSym->getSubType() == SYM_GLOBAL)
+    mFound = true;
+  return !mFound;
+}
+
+bool has_side_effects(LSLASTNode *node) {
+  AssignmentFindingVisitor assignment_visitor;
+  node->visit(&assignment_visitor);
+  return assignment_visitor.mFound;
+}
+
+class LabelFindingVisitor : public ASTVisitor {
+  public:
+    bool mFound = false;
+
+  protected:
+    bool visit(LSLLabel *label_stmt) override {
+      mFound = true;
+      return false;
+    }
+    bool visit(LSLExpression *expr) override { return false; }
+};
+
+bool contains_label(LSLASTNode *node) {
+  LabelFindingVisitor label_visitor;
+  node->visit(&label_visitor);
+  return label_visitor.mFound;
+}
+
+std::vector<LSLBinaryExpression *> collect_left_chain(
+    LSLBinaryExpression *bin_expr,
+    const std::function<bool(LSLBinaryExpression *)> &can_link
+) {
+  std::vector<LSLBinaryExpression *> chain {bin_expr};
+  for (;;) {
+    auto *lhs = chain.back()->getLHS();
+    if (lhs->getNodeSubType() != NODE_BINARY_EXPRESSION)
+      break;
+    auto *lhs_bin = (LSLBinaryExpression *) lhs;
+    if (is_assignment_op(lhs_bin->getOperation()))
+      break;
+    if (can_link && !can_link(lhs_bin))
+      break;
+    chain.push_back(lhs_bin);
+  }
+  return chain;
+}
+
+bool CalleeCollectingVisitor::visit(LSLFunctionExpression *func_expr) {
+  auto *sym = func_expr->getSymbol();
+  if (sym->getSubType() != SYM_BUILTIN)
+    mCallees.push_back(sym);
+  return true;
+}
+
+bool VarUsageVisitor::visit(LSLBinaryExpression *bin_expr) {
+  if (bin_expr->getOperation() != '=')
+    return true;
+  // Plain stores don't count as reads, but replacing a single member reads the others.
+  auto *lvalue = (LSLLValueExpression *) bin_expr->getLHS();
+  mReferenced.insert(lvalue->getSymbol());
+  if (lvalue->getMember())
+    mRead.insert(lvalue->getSymbol());
+  else
+    mStores.push_back(bin_expr);
+  bin_expr->getRHS()->visit(this);
+  return false;
+}
+
+bool VarUsageVisitor::visit(LSLLValueExpression *lvalue) {
+  mRead.insert(lvalue->getSymbol());
+  mReferenced.insert(lvalue->getSymbol());
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLGlobalFunction *glob_func) {
+  analyzeBody(glob_func->getStatements());
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLEventHandler *handler) {
+  analyzeBody(handler->getStatements());
+  return false;
+}
+
+void DeadStoreFindingVisitor::analyzeBody(LSLASTNode *body) {
+  // Jumps can go anywhere, don't bother following them.
+  if (contains_label(body))
+    return;
+  _mLive.clear();
+  body->visit(this);
+  for (auto *store : _mStores) {
+    if (_mReadStores.find(store) == _mReadStores.end())
+      mDeadStores.insert(store);
+  }
+  _mStores.clear();
+  _mReadStores.clear();
+}
+
+void DeadStoreFindingVisitor::recordStore(LSLASTNode *store, LSLSymbol *sym, bool read) {
+  switch (sym->getSubType()) {
+    case SYM_LOCAL:
+    case SYM_FUNCTION_PARAMETER:
+    case SYM_EVENT_PARAMETER:
+      break;
+    default:
+      return;
+  }
+  // Loops are analyzed until nothing changes, a store only has to be read on one pass.
+  _mStores.insert(store);
+  if (read)
+    _mReadStores.insert(store);
+}
+
+void DeadStoreFindingVisitor::analyzeExpr(LSLASTNode *expr) {
+  if (!expr)
+    return;
+  // The order things happen in within an expression isn't tracked, so a variable
+  // read anywhere in it keeps all of the expression's stores to it alive.
+  VarUsageVisitor usage;
+  expr->visit(&usage);
+  for (auto *store : usage.mStores) {
+    auto *sym = store->getLHS()->getSymbol();
+    recordStore(store, sym, _mLive.count(sym) || usage.mRead.count(sym));
+  }
+  for (auto *store : usage.mStores)
+    _mLive.erase(store->getLHS()->getSymbol());
+  _mLive.insert(usage.mRead.begin(), usage.mRead.end());
+}
+
+void DeadStoreFindingVisitor::analyzeExprs(LSLASTNode *exprs) {
+  if (!exprs)
+    return;
+  std::vector<LSLASTNode *> expr_list;
+  for (auto *expr : *exprs)
+    expr_list.push_back(expr);
+  for (auto it = expr_list.rbegin(); it != expr_list.rend(); ++it)
+    analyzeExpr(*it);
+}
+
+bool DeadStoreFindingVisitor::visit(LSLCompoundStatement *compound_stmt) {
+  std::vector<LSLASTNode *> stmts;
+  for (auto *stmt : *compound_stmt)
+    stmts.push_back(stmt);
+  for (auto it = stmts.rbegin(); it != stmts.rend(); ++it)
+    (*it)->visit(this);
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLExpressionStatement *expr_stmt) {
+  analyzeExpr(expr_stmt->getExpr());
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLDeclaration *decl_stmt) {
+  auto *sym = decl_stmt->getSymbol();
+  recordStore(decl_stmt, sym, _mLive.count(sym));
+  _mLive.erase(sym);
+  analyzeExpr(decl_stmt->getInitializer());
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLIfStatement *if_stmt) {
+  auto live_after = _mLive;
+  if (auto *false_branch = if_stmt->getFalseBranch())
+    false_branch->visit(this);
+  auto live_false = std::move(_mLive);
+  _mLive = std::move(live_after);
+  if_stmt->getTrueBranch()->visit(this);
+  _mLive.insert(live_false.begin(), live_false.end());
+  analyzeExpr(if_stmt->getCheckExpr());
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLForStatement *for_stmt) {
+  auto live_after = _mLive;
+  // What's live going into the check, the body and increment loop back around to it.
+  std::set<LSLSymbol *> live_check;
+  for (;;) {
+    _mLive = live_check;
+    analyzeExprs(for_stmt->getIncrExprs());
+    for_stmt->getBody()->visit(this);
+    _mLive.insert(live_after.begin(), live_after.end());
+    analyzeExpr(for_stmt->getCheckExpr());
+    if (_mLive == live_check)
+      break;
+    live_check = _mLive;
+  }
+  analyzeExprs(for_stmt->getInitExprs());
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLWhileStatement *while_stmt) {
+  auto live_after = _mLive;
+  std::set<LSLSymbol *> live_check;
+  for (;;) {
+    _mLive = live_check;
+    while_stmt->getBody()->visit(this);
+    _mLive.insert(live_after.begin(), live_after.end());
+    analyzeExpr(while_stmt->getCheckExpr());
+    if (_mLive == live_check)
+      break;
+    live_check = _mLive;
+  }
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLDoStatement *do_stmt) {
+  auto live_after = _mLive;
+  std::set<LSLSymbol *> live_body;
+  for (;;) {
+    _mLive = live_body;
+    _mLive.insert(live_after.begin(), live_after.end());
+    analyzeExpr(do_stmt->getCheckExpr());
+    do_stmt->getBody()->visit(this);
+    if (_mLive == live_body)
+      break;
+    live_body = _mLive;
+  }
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLReturnStatement *return_stmt) {
+  // Nothing after a `return` can read any locals
+  _mLive.clear();
+  analyzeExpr(return_stmt->getExpr());
+  return false;
+}
+
+bool DeadStoreFindingVisitor::visit(LSLStateStatement *state_stmt) {
+  _mLive.clear();
+  return false;
+}
+
+}
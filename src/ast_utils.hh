@@ -0,0 +1,113 @@
+#pragma once
+
+#include <functional>
+#include <set>
+#include <vector>
+
+#include <tailslide/tailslide.hh>
+
+namespace Tailslide {
+
+// How each type is spelled in LSL source, `void` has no name.
+const char * const LSL_TYPE_NAMES[LST_MAX] = {
+    "",
+    "integer",
+    "float",
+    "string",
+    "key",
+    "vector",
+    "rotation",
+    "list",
+    "<ERROR>"
+};
+
+bool is_assignment_op(LSLOperator op);
+bool is_incr_decr_op(LSLOperator op);
+
+// Checks whether an expression could assign to any variable, or to a specific one if given
+class AssignmentFindingVisitor : public ASTVisitor {
+  public:
+    explicit AssignmentFindingVisitor(LSLSymbol *sym=nullptr) : _mSym(sym) {}
+    bool mFound = false;
+
+  protected:
+    bool visit(LSLBinaryExpression *bin_expr) override;
+    bool visit(LSLUnaryExpression *unary_expr) override;
+    bool visit(LSLFunctionExpression *func_expr) override;
+
+    bool matches(LSLSymbol *sym) {
+      return !_mSym || sym == _mSym;
+    }
+
+    LSLSymbol *_mSym;
+};
+
+// Whether evaluating `node` could change any state visible to the script
+bool has_side_effects(LSLASTNode *node);
+
+// Whether `node` contains a label that something could jump to
+bool contains_label(LSLASTNode *node);
+
+// Walks down the left side of a left-deep chain of binary operations like `a + b + c`,
+// starting with `bin_expr` and ending with the innermost link. Only non-assignment
+// operations accepted by `can_link` (if given) become part of the chain.
+std::vector<LSLBinaryExpression *> collect_left_chain(
+    LSLBinaryExpression *bin_expr,
+    const std::function<bool(LSLBinaryExpression *)> &can_link = nullptr
+);
+
+// Collects the user-defined functions called within a node, in the order they're called
+class CalleeCollectingVisitor : public ASTVisitor {
+  public:
+    std::vector<LSLSymbol *> mCallees;
+
+  protected:
+    bool visit(LSLFunctionExpression *func_expr) override;
+};
+
+// Figures out which variables are ever read, and which are referenced at all.
+// Flow-insensitive, a variable read anywhere is considered read everywhere.
+class VarUsageVisitor : public ASTVisitor {
+  public:
+    std::set<LSLSymbol *> mRead;
+    std::set<LSLSymbol *> mReferenced;
+    // Assignments that replace a variable's whole value
+    std::vector<LSLBinaryExpression *> mStores;
+
+  protected:
+    bool visit(LSLBinaryExpression *bin_expr) override;
+    bool visit(LSLLValueExpression *lvalue) override;
+};
+
+// Finds stores to locals and arguments whose values can never be read, because every path
+// after them either overwrites the variable or leaves the function first. Declarations
+// count as stores of their initializer. Functions containing labels aren't analyzed.
+class DeadStoreFindingVisitor : public ASTVisitor {
+  public:
+    std::set<LSLASTNode *> mDeadStores;
+
+  protected:
+    bool visit(LSLGlobalFunction *glob_func) override;
+    bool visit(LSLEventHandler *handler) override;
+    bool visit(LSLCompoundStatement *compound_stmt) override;
+    bool visit(LSLExpressionStatement *expr_stmt) override;
+    bool visit(LSLDeclaration *decl_stmt) override;
+    bool visit(LSLIfStatement *if_stmt) override;
+    bool visit(LSLForStatement *for_stmt) override;
+    bool visit(LSLWhileStatement *while_stmt) override;
+    bool visit(LSLDoStatement *do_stmt) override;
+    bool visit(LSLReturnStatement *return_stmt) override;
+    bool visit(LSLStateStatement *state_stmt) override;
+
+    void analyzeBody(LSLASTNode *body);
+    void analyzeExpr(LSLASTNode *expr);
+    void analyzeExprs(LSLASTNode *exprs);
+    void recordStore(LSLASTNode *store, LSLSymbol *sym, bool read);
+
+    // Variables whose current value may still be read, working backwards from the end of the body
+    std::set<LSLSymbol *> _mLive;
+    std::set<LSLASTNode *> _mStores;
+    std::set<LSLASTNode *> _mReadStores;
+};
+
+}
@@ -0,0 +1,42 @@
+#include "cast_simplification.hh"
+
+namespace Tailslide {
+
+static bool is_stringish(LSLIType type) {
+  return type == LST_STRING || type == LST_KEY;
+}
+
+// Whether `(to_type)(via_type)expr` always gives the same result as `(to_type)expr`
+static bool is_skippable_cast(LSLIType from_type, LSLIType via_type, LSLIType to_type) {
+  if (from_type == via_type)
+    return true;
+  // strings and keys convert between each other without changing their contents
+  if (is_stringish(from_type) && is_stringish(via_type) && is_stringish(to_type))
+    return true;
+  // integers always survive a round trip through their string representation
+  return from_type == LST_INTEGER && via_type == LST_STRING && to_type == LST_INTEGER;
+}
+
+static LSLExpression *strip_parens(LSLExpression *expr) {
+  while (expr->getNodeSubType() == NODE_PARENTHESIS_EXPRESSION)
+    expr = ((LSLParenthesisExpression *) expr)->getChildExpr();
+  return expr;
+}
+
+LSLExpression *get_cast_source(LSLTypecastExpression *cast_expr) {
+  auto to_type = cast_expr->getIType();
+  auto *source = cast_expr->getChildExpr();
+  for (;;) {
+    auto *inner = strip_parens(source);
+    if (inner->getNodeSubType() != NODE_TYPECAST_EXPRESSION)
+      break;
+    auto *inner_cast = (LSLTypecastExpression *) inner;
+    auto *inner_source = inner_cast->getChildExpr();
+    if (!is_skippable_cast(inner_source->getIType(), inner_cast->getIType(), to_type))
+      break;
+    source = inner_source;
+  }
+  return source;
+}
+
+}
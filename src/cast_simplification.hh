@@ -0,0 +1,12 @@
+#pragma once
+
+#include <tailslide/tailslide.hh>
+
+namespace Tailslide {
+
+// Finds the expression a cast can be performed on directly, looking through any
+// intermediate casts that can't affect the result. If the returned expression is
+// already of the cast's type then the cast doesn't need to be done at all.
+LSLExpression *get_cast_source(LSLTypecastExpression *cast_expr);
+
+}
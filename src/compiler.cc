@@ -1,24 +1,32 @@
 #include "python_pass.hh"
 #include "json_ir_pass.hh"
+#include "lsl_pass.hh"
+#include "perf_lint.hh"
+#include "register_ir.hh"
+#include "register_ir_opt.hh"
+#include "ir_verify.hh"
+#include <cstdint>
+#include <cstring>
+#include <set>
 #include <string>
+#include <vector>
 
 #define PY_SSIZE_T_CLEAN 1
 #include <Python.h>
 
 using namespace Tailslide;
 
-static PyObject* set_error(Logger *logger)
+static PyObject* set_error(const std::vector<std::string> &messages)
 {
   PyObject *mod_lummao = PyImport_ImportModule("lummao.exceptions");
   assert (mod_lummao != NULL);
   PyObject* type_compile_error = PyObject_GetAttrString(mod_lummao, "CompileError");
   assert (type_compile_error != NULL);
 
-  auto &messages = logger->getMessages();
   PyObject *message_tup = PyTuple_New(messages.size());
   int idx = 0;
   for (const auto &message : messages) {
-    PyObject *err_str = PyUnicode_FromString(message->getMessage().c_str());
+    PyObject *err_str = PyUnicode_FromString(message.c_str());
     PyTuple_SetItem(message_tup, idx, err_str);
     ++idx;
   }
@@ -31,10 +39,246 @@ static PyObject* set_error(Logger *logger)
   return nullptr;
 }
 
+static PyObject* set_error(Logger *logger)
+{
+  std::vector<std::string> messages;
+  for (const auto &message : logger->getMessages())
+    messages.push_back(message->getMessage());
+  return set_error(messages);
+}
+
+
+// `PyUnicode_AsUTF8()` isn't part of the limited API, so go through a bytes object
+static bool get_str(PyObject *value, std::string *out) {
+  PyObject *value_bytes = PyUnicode_AsUTF8String(value);
+  if (!value_bytes)
+    return false;
+  *out = PyBytes_AsString(value_bytes);
+  Py_DECREF(value_bytes);
+  return true;
+}
+
+// Make sure we weren't passed any keyword args we don't know how to handle,
+// typos in option names shouldn't silently do nothing.
+static bool check_options(PyObject *kwargs, const std::set<std::string> &known_options) {
+  if (!kwargs)
+    return true;
+
+  PyObject *key, *value;
+  Py_ssize_t pos = 0;
+  while (PyDict_Next(kwargs, &pos, &key, &value)) {
+    std::string key_str;
+    if (!get_str(key, &key_str))
+      return false;
+    if (known_options.find(key_str) == known_options.end()) {
+      PyErr_Format(PyExc_TypeError, "unexpected compiler option '%s'", key_str.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool get_bool_option(PyObject *kwargs, const char *name, bool *out) {
+  if (!kwargs)
+    return true;
+  // borrowed reference
+  PyObject *value = PyDict_GetItemString(kwargs, name);
+  if (!value)
+    return true;
+  int truth = PyObject_IsTrue(value);
+  if (truth < 0)
+    return false;
+  *out = truth;
+  return true;
+}
+
+static bool get_int_option(PyObject *kwargs, const char *name, int *out) {
+  if (!kwargs)
+    return true;
+  // borrowed reference
+  PyObject *value = PyDict_GetItemString(kwargs, name);
+  if (!value || value == Py_None)
+    return true;
+  long long_val = PyLong_AsLong(value);
+  if (long_val == -1 && PyErr_Occurred())
+    return false;
+  if (long_val < 0 || long_val > INT32_MAX) {
+    PyErr_Format(PyExc_ValueError, "%s must be a non-negative int", name);
+    return false;
+  }
+  *out = (int)long_val;
+  return true;
+}
+
+static bool get_str_option(PyObject *kwargs, const char *name, std::string *out, bool *present) {
+  if (!kwargs)
+    return true;
+  // borrowed reference
+  PyObject *value = PyDict_GetItemString(kwargs, name);
+  if (!value || value == Py_None)
+    return true;
+  if (!get_str(value, out))
+    return false;
+  *present = true;
+  return true;
+}
+
+static bool parse_python_options(PyObject *kwargs, PythonCompilationOptions *options, ScriptProfile *profile) {
+  if (!check_options(kwargs, {"lazy_methods", "promote_loop_globals", "elide_int_wraparound", "simplify_casts", "bind_helpers", "switch_dispatch", "typed_output", "instrument", "profile", "eliminate_dead_vars", "tree_shaking", "max_expression_depth"}))
+    return false;
+  bool ok = get_bool_option(kwargs, "lazy_methods", &options->lazy_methods)
+      && get_bool_option(kwargs, "promote_loop_globals", &options->promote_loop_globals)
+      && get_bool_option(kwargs, "elide_int_wraparound", &options->elide_int_wraparound)
+      && get_bool_option(kwargs, "simplify_casts", &options->simplify_casts)
+      && get_bool_option(kwargs, "bind_helpers", &options->bind_helpers)
+      && get_bool_option(kwargs, "switch_dispatch", &options->switch_dispatch)
+      && get_bool_option(kwargs, "typed_output", &options->typed_output)
+      && get_bool_option(kwargs, "instrument", &options->instrument)
+      && get_bool_option(kwargs, "eliminate_dead_vars", &options->eliminate_dead_vars)
+      && get_int_option(kwargs, "max_expression_depth", &options->max_expression_depth);
+  if (!ok)
+    return false;
+
+  std::string profile_json;
+  bool have_profile = false;
+  if (!get_str_option(kwargs, "profile", &profile_json, &have_profile))
+    return false;
+  if (have_profile) {
+    std::string profile_error;
+    if (!ScriptProfile::fromJSON(profile_json, profile, &profile_error)) {
+      PyErr_Format(PyExc_ValueError, "invalid profile: %s", profile_error.c_str());
+      return false;
+    }
+    options->profile = profile;
+  }
+  if (options->typed_output && options->lazy_methods) {
+    // lazy methods are compiled with `exec()` at runtime, which defeats the point.
+    PyErr_SetString(PyExc_ValueError, "typed_output can't be combined with lazy_methods");
+    return false;
+  }
+  if (options->typed_output && options->bind_helpers) {
+    // helpers bound as untyped keyword defaults would lose their overloads under `mypy --strict`
+    PyErr_SetString(PyExc_ValueError, "typed_output can't be combined with bind_helpers");
+    return false;
+  }
+  return true;
+}
+
+// `peephole` may either be a bool turning every rule on or off, a single rule name,
+// or a collection of rule names to run
+static bool get_peephole_option(PyObject *kwargs, IRPeepholeOptions *out, bool *present) {
+  if (!kwargs)
+    return true;
+  // borrowed reference
+  PyObject *value = PyDict_GetItemString(kwargs, "peephole");
+  if (!value || value == Py_None)
+    return true;
+  if (PyBool_Check(value)) {
+    *present = (value == Py_True);
+    return true;
+  }
+
+  // A string is iterable too, but its characters aren't rule names.
+  PyObject *iter;
+  if (PyUnicode_Check(value)) {
+    PyObject *names = PyTuple_Pack(1, value);
+    if (!names)
+      return false;
+    iter = PyObject_GetIter(names);
+    Py_DECREF(names);
+  } else {
+    iter = PyObject_GetIter(value);
+  }
+  if (!iter)
+    return false;
+  for (const auto *rule_name : IR_PEEPHOLE_RULES)
+    *get_peephole_rule(out, rule_name) = false;
+  PyObject *item;
+  while ((item = PyIter_Next(iter))) {
+    std::string item_str;
+    bool *rule = get_str(item, &item_str) ? get_peephole_rule(out, item_str) : nullptr;
+    if (!rule && !PyErr_Occurred())
+      PyErr_Format(PyExc_ValueError, "unknown peephole rule '%s'", item_str.c_str());
+    Py_DECREF(item);
+    if (!rule) {
+      Py_DECREF(iter);
+      return false;
+    }
+    *rule = true;
+  }
+  Py_DECREF(iter);
+  if (PyErr_Occurred())
+    return false;
+  *present = true;
+  return true;
+}
+
+// `cfg` may be `True` or `"json"` for the graph as JSON, or `"dot"` for Graphviz
+static bool get_cfg_option(PyObject *kwargs, IRCFGFormat *out) {
+  if (!kwargs)
+    return true;
+  // borrowed reference
+  PyObject *value = PyDict_GetItemString(kwargs, "cfg");
+  if (!value || value == Py_None)
+    return true;
+  if (PyBool_Check(value)) {
+    *out = (value == Py_True) ? IR_CFG_JSON : IR_CFG_NONE;
+    return true;
+  }
+  std::string format;
+  bool present = false;
+  if (!get_str_option(kwargs, "cfg", &format, &present))
+    return false;
+  if (format == "json") {
+    *out = IR_CFG_JSON;
+  } else if (format == "dot") {
+    *out = IR_CFG_DOT;
+  } else {
+    PyErr_Format(PyExc_ValueError, "unknown cfg format '%s'", format.c_str());
+    return false;
+  }
+  return true;
+}
+
+static bool parse_ir_options(PyObject *kwargs, JSONCompilationOptions *options, IRPeepholeOptions *peephole,
+                             RegisterIROptOptions *register_opt) {
+  if (!check_options(kwargs, {"jump_tables", "tree_shaking", "peephole", "superinstructions", "eliminate_dead_stores", "cfg", "resolve", "reuse_local_slots", "stack_depths", "verify_types", "data_section", "cse", "licm"}))
+    return false;
+  bool have_peephole = false;
+  if (!get_bool_option(kwargs, "jump_tables", &options->jump_tables)
+      || !get_bool_option(kwargs, "superinstructions", &options->superinstructions)
+      || !get_bool_option(kwargs, "eliminate_dead_stores", &options->eliminate_dead_stores)
+      || !get_bool_option(kwargs, "resolve", &options->resolve)
+      || !get_bool_option(kwargs, "reuse_local_slots", &options->reuse_local_slots)
+      || !get_bool_option(kwargs, "stack_depths", &options->stack_depths)
+      || !get_bool_option(kwargs, "verify_types", &options->verify_types)
+      || !get_bool_option(kwargs, "data_section", &options->data_section)
+      || !get_bool_option(kwargs, "cse", &register_opt->cse)
+      || !get_bool_option(kwargs, "licm", &register_opt->licm)
+      || !get_cfg_option(kwargs, &options->cfg_format)
+      || !get_peephole_option(kwargs, peephole, &have_peephole))
+    return false;
+  if (have_peephole)
+    options->peephole = peephole;
+  return true;
+}
+
+
+static bool parse_lsl_options(PyObject *kwargs, LSLCompilationOptions *options) {
+  if (!check_options(kwargs, {"fold_constants", "remove_dead_code", "shorten_identifiers"}))
+    return false;
+  return get_bool_option(kwargs, "fold_constants", &options->fold_constants)
+      && get_bool_option(kwargs, "remove_dead_code", &options->remove_dead_code)
+      && get_bool_option(kwargs, "shorten_identifiers", &options->shorten_identifiers);
+}
+
 
 enum LSLHandleMode {
     LSL_TO_PYTHON,
     LSL_TO_IR,
+    LSL_TO_REGISTER_IR,
+    LSL_TO_LSL,
+    LSL_PERF_LINT,
 } eLSLHandleMode;
 
 
@@ -46,6 +290,51 @@ PyObject* parse_and_handle_lsl(LSLHandleMode mode, PyObject* self, PyObject *arg
     return NULL;
   }
 
+  PythonCompilationOptions py_options;
+  ScriptProfile profile;
+  JSONCompilationOptions ir_options;
+  ir_options.omit_unnecessary_pushes = true;
+  IRPeepholeOptions peephole_options;
+  RegisterIROptOptions register_opt_options;
+  LSLCompilationOptions lsl_options;
+  switch (mode) {
+    case LSL_TO_PYTHON:
+      if (!parse_python_options(kwargs, &py_options, &profile))
+        return NULL;
+      break;
+    case LSL_TO_IR:
+      if (!parse_ir_options(kwargs, &ir_options, &peephole_options, &register_opt_options))
+        return NULL;
+      if (register_opt_options.cse || register_opt_options.licm) {
+        PyErr_SetString(PyExc_ValueError, "cse and licm only apply to the register IR");
+        return NULL;
+      }
+      break;
+    case LSL_TO_REGISTER_IR:
+      if (!parse_ir_options(kwargs, &ir_options, &peephole_options, &register_opt_options))
+        return NULL;
+      if (ir_options.superinstructions || ir_options.resolve || ir_options.stack_depths || ir_options.verify_types
+          || ir_options.cfg_format != IR_CFG_NONE) {
+        PyErr_SetString(PyExc_ValueError, "superinstructions, resolve, stack_depths, verify_types and cfg only apply to the stack IR");
+        return NULL;
+      }
+      break;
+    case LSL_TO_LSL:
+      if (!parse_lsl_options(kwargs, &lsl_options))
+        return NULL;
+      break;
+    case LSL_PERF_LINT:
+      if (!check_options(kwargs, {}))
+        return NULL;
+      break;
+  }
+  // shared by the Python and IR backends, the minifier always shakes when removing dead code
+  bool tree_shaking = false;
+  if (!get_bool_option(kwargs, "tree_shaking", &tree_shaking))
+    return NULL;
+  if (mode == LSL_TO_LSL)
+    tree_shaking = lsl_options.remove_dead_code;
+
   char *buffer_data;
   Py_ssize_t buffer_len;
   if (PyBytes_AsStringAndSize(buffer, &buffer_data, &buffer_len) < 0)
@@ -76,21 +365,81 @@ PyObject* parse_and_handle_lsl(LSLHandleMode mode, PyObject* self, PyObject *arg
     return set_error(logger);
   }
 
+  TreeShaker tree_shaker;
+  if (tree_shaking) {
+    tree_shaker.shake(script);
+    py_options.tree_shaker = &tree_shaker;
+    ir_options.tree_shaker = &tree_shaker;
+    lsl_options.tree_shaker = &tree_shaker;
+  }
+
   switch (mode) {
     case LSL_TO_PYTHON: {
-      PythonVisitor py_visitor;
+      PythonVisitor py_visitor(py_options);
       script->visit(&py_visitor);
+      if (!py_visitor.mErrors.empty())
+        return set_error(py_visitor.mErrors);
       std::string py_code {py_visitor.mStr.str()};
       return PyBytes_FromStringAndSize(py_code.c_str(), py_code.size());
     }
     case LSL_TO_IR: {
-      JSONScriptCompiler json_visitor(&parser.allocator, {true});
+      JSONScriptCompiler json_visitor(&parser.allocator, ir_options);
       script->visit(&json_visitor);
+      if (!json_visitor.mErrors.empty()) {
+        PyErr_Format(PyExc_RuntimeError, "generated malformed IR: %s", json_visitor.mErrors.front().c_str());
+        return NULL;
+      }
       std::stringstream sstr;
       sstr << std::setw(2) << json_visitor.mIR << "\n";
       std::string json_str {sstr.str()};
       return PyBytes_FromStringAndSize(json_str.c_str(), json_str.size());
     }
+    case LSL_TO_REGISTER_IR: {
+      JSONScriptCompiler json_visitor(&parser.allocator, ir_options);
+      script->visit(&json_visitor);
+      if (!json_visitor.mErrors.empty()) {
+        PyErr_Format(PyExc_RuntimeError, "generated malformed IR: %s", json_visitor.mErrors.front().c_str());
+        return NULL;
+      }
+      BuiltinSignatureVisitor signature_visitor;
+      script->visit(&signature_visitor);
+      nlohmann::json register_ir;
+      std::string error;
+      if (!build_register_ir(json_visitor.mIR, signature_visitor.mSignatures, &register_ir, &error)) {
+        PyErr_Format(PyExc_RuntimeError, "couldn't build register IR: %s", error.c_str());
+        return NULL;
+      }
+      if (register_opt_options.cse || register_opt_options.licm) {
+        RegisterIROptStats opt_stats;
+        optimize_register_ir(register_ir, register_opt_options, &opt_stats);
+        register_ir["redundancy_stats"] = opt_stats;
+      }
+      std::stringstream sstr;
+      sstr << std::setw(2) << register_ir << "\n";
+      std::string json_str {sstr.str()};
+      return PyBytes_FromStringAndSize(json_str.c_str(), json_str.size());
+    }
+    case LSL_TO_LSL: {
+      LSLMinifyingVisitor lsl_visitor(lsl_options);
+      script->visit(&lsl_visitor);
+      std::string lsl_code {lsl_visitor.mStr.str()};
+      return PyBytes_FromStringAndSize(lsl_code.c_str(), lsl_code.size());
+    }
+    case LSL_PERF_LINT: {
+      PerfLintVisitor lint_visitor;
+      script->visit(&lint_visitor);
+      nlohmann::json findings = nlohmann::json::array();
+      for (const auto &finding : lint_visitor.mFindings) {
+        findings.push_back({
+            {"line", finding.line},
+            {"column", finding.column},
+            {"code", finding.code},
+            {"message", finding.message}
+        });
+      }
+      std::string json_str {findings.dump()};
+      return PyBytes_FromStringAndSize(json_str.c_str(), json_str.size());
+    }
   }
   return nullptr;
 }
@@ -103,10 +452,60 @@ PyObject* lsl_to_ir(PyObject* self, PyObject *args, PyObject *kwargs) {
   return parse_and_handle_lsl(LSL_TO_IR, self, args, kwargs);
 }
 
+PyObject* lsl_to_register_ir(PyObject* self, PyObject *args, PyObject *kwargs) {
+  return parse_and_handle_lsl(LSL_TO_REGISTER_IR, self, args, kwargs);
+}
+
+PyObject* lsl_register_ir_to_stack_ir(PyObject* self, PyObject *args, PyObject *kwargs) {
+  const char *ir_data;
+  Py_ssize_t ir_len;
+  if (!PyArg_ParseTuple(args, "y#", &ir_data, &ir_len))
+    return NULL;
+  bool verify_types = false;
+  if (!check_options(kwargs, {"verify_types"}) || !get_bool_option(kwargs, "verify_types", &verify_types))
+    return NULL;
+
+  nlohmann::json stack_ir;
+  std::string error;
+  bool ok;
+  try {
+    auto register_ir = nlohmann::json::parse(ir_data, ir_data + ir_len);
+    ok = register_ir_to_stack_ir(register_ir, &stack_ir, &error);
+    if (ok && verify_types) {
+      IRSignatureMap builtins;
+      get_register_ir_builtins(register_ir, &builtins);
+      ok = verify_ir_types(stack_ir, builtins, &error);
+    }
+  } catch (const nlohmann::json::exception &e) {
+    ok = false;
+    error = e.what();
+  }
+  if (!ok) {
+    PyErr_Format(PyExc_ValueError, "invalid register IR: %s", error.c_str());
+    return NULL;
+  }
+  std::stringstream sstr;
+  sstr << std::setw(2) << stack_ir << "\n";
+  std::string json_str {sstr.str()};
+  return PyBytes_FromStringAndSize(json_str.c_str(), json_str.size());
+}
+
+PyObject* lsl_to_minified_lsl(PyObject* self, PyObject *args, PyObject *kwargs) {
+  return parse_and_handle_lsl(LSL_TO_LSL, self, args, kwargs);
+}
+
+PyObject* lsl_perf_lint(PyObject* self, PyObject *args, PyObject *kwargs) {
+  return parse_and_handle_lsl(LSL_PERF_LINT, self, args, kwargs);
+}
+
 
 static PyMethodDef compilerMethods[] = {
-  {"lsl_to_python_src", (PyCFunction) lsl_to_python_src, METH_VARARGS, NULL},
-  {"lsl_to_ir", (PyCFunction) lsl_to_ir, METH_VARARGS, NULL},
+  {"lsl_to_python_src", (PyCFunction)(void(*)(void)) lsl_to_python_src, METH_VARARGS | METH_KEYWORDS, NULL},
+  {"lsl_to_ir", (PyCFunction)(void(*)(void)) lsl_to_ir, METH_VARARGS | METH_KEYWORDS, NULL},
+  {"lsl_to_register_ir", (PyCFunction)(void(*)(void)) lsl_to_register_ir, METH_VARARGS | METH_KEYWORDS, NULL},
+  {"register_ir_to_stack_ir", (PyCFunction)(void(*)(void)) lsl_register_ir_to_stack_ir, METH_VARARGS | METH_KEYWORDS, NULL},
+  {"lsl_to_minified_lsl", (PyCFunction)(void(*)(void)) lsl_to_minified_lsl, METH_VARARGS | METH_KEYWORDS, NULL},
+  {"lsl_perf_lint", (PyCFunction)(void(*)(void)) lsl_perf_lint, METH_VARARGS | METH_KEYWORDS, NULL},
   {NULL, NULL, 0, NULL}       /* Sentinel */
 };
 
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#include "int_ranges.hh"
+#include "ast_utils.hh"
+
+namespace Tailslide {
+
+static const IntRange FULL_RANGE {};
+
+// Builtins whose results are naturally bounded, mostly lengths and indices.
+static const std::map<std::string, IntRange> BUILTIN_RANGES {
+  {"llGetListLength", {0, INT32_MAX}},
+  {"llStringLength", {0, INT32_MAX}},
+  {"llGetInventoryNumber", {0, INT32_MAX}},
+  {"llGetNumberOfPrims", {0, INT32_MAX}},
+  {"llSubStringIndex", {-1, INT32_MAX}},
+  {"llListFindList", {-1, INT32_MAX}},
+};
+
+static bool is_int_counter(LSLExpression *expr) {
+  if (expr->getNodeSubType() != NODE_LVALUE_EXPRESSION || expr->getIType() != LST_INTEGER)
+    return false;
+  auto *lvalue = (LSLLValueExpression *) expr;
+  if (lvalue->getMember())
+    return false;
+  // Globals may be changed by anything we call, only bother with locals.
+  auto sub_type = lvalue->getSymbol()->getSubType();
+  return sub_type == SYM_LOCAL || sub_type == SYM_FUNCTION_PARAMETER || sub_type == SYM_EVENT_PARAMETER;
+}
+
+static bool is_int_const(LSLExpression *expr, int32_t val) {
+  auto *const_val = expr->getConstantValue();
+  if (!const_val || const_val->getIType() != LST_INTEGER)
+    return false;
+  return ((LSLIntegerConstant *) const_val)->getValue() == val;
+}
+
+// Whether `expr` is `sym++`, `++sym` or `sym = sym + 1`
+static bool is_counter_increment(LSLExpression *expr, LSLSymbol *sym) {
+  if (expr->getNodeSubType() == NODE_UNARY_EXPRESSION) {
+    auto *unary_expr = (LSLUnaryExpression *) expr;
+    auto op = unary_expr->getOperation();
+    if (op != OP_POST_INCR && op != OP_PRE_INCR)
+      return false;
+    auto *child_expr = unary_expr->getChildExpr();
+    return is_int_counter(child_expr) && child_expr->getSymbol() == sym;
+  }
+  if (expr->getNodeSubType() != NODE_BINARY_EXPRESSION)
+    return false;
+  auto *assign_expr = (LSLBinaryExpression *) expr;
+  if (assign_expr->getOperation() != '=' || assign_expr->getLHS()->getSymbol() != sym)
+    return false;
+  auto *rhs = assign_expr->getRHS();
+  if (rhs->getNodeSubType() != NODE_BINARY_EXPRESSION)
+    return false;
+  auto *add_expr = (LSLBinaryExpression *) rhs;
+  if (add_expr->getOperation() != '+')
+    return false;
+  auto *add_lhs = add_expr->getLHS();
+  auto *add_rhs = add_expr->getRHS();
+  if (is_int_counter(add_lhs) && add_lhs->getSymbol() == sym && is_int_const(add_rhs, 1))
+    return true;
+  return is_int_counter(add_rhs) && add_rhs->getSymbol() == sym && is_int_const(add_lhs, 1);
+}
+
+IntRange IntRangeAnalysis::getRange(LSLExpression *expr) {
+  auto range = getUnwrappedRange(expr);
+  if (!range.fitsInt32())
+    return FULL_RANGE;
+  return range;
+}
+
+bool IntRangeAnalysis::canWrap(LSLExpression *expr) {
+  if (expr->getIType() != LST_INTEGER)
+    return true;
+  if (expr->getNodeSubType() == NODE_BINARY_EXPRESSION) {
+    auto *bin_expr = (LSLBinaryExpression *) expr;
+    auto op = bin_expr->getOperation();
+    if (op != '+' && op != '-' && op != '*')
+      return true;
+    if (bin_expr->getLHS()->getIType() != LST_INTEGER || bin_expr->getRHS()->getIType() != LST_INTEGER)
+      return true;
+  } else if (expr->getNodeSubType() == NODE_UNARY_EXPRESSION) {
+    if (((LSLUnaryExpression *) expr)->getOperation() != '-')
+      return true;
+  } else {
+    return true;
+  }
+  return !getUnwrappedRange(expr).fitsInt32();
+}
+
+IntRange IntRangeAnalysis::getUnwrappedRange(LSLExpression *expr) {
+  if (expr->getIType() != LST_INTEGER)
+    return FULL_RANGE;
+
+  auto *const_val = expr->getConstantValue();
+  if (const_val && const_val->getIType() == LST_INTEGER) {
+    int64_t val = ((LSLIntegerConstant *) const_val)->getValue();
+    return {val, val};
+  }
+
+  switch (expr->getNodeSubType()) {
+    case NODE_PARENTHESIS_EXPRESSION:
+      return getRange(((LSLParenthesisExpression *) expr)->getChildExpr());
+    case NODE_LVALUE_EXPRESSION:
+      return getSymbolRange((LSLLValueExpression *) expr);
+    case NODE_FUNCTION_EXPRESSION: {
+      auto *sym = expr->getSymbol();
+      if (sym->getSubType() != SYM_BUILTIN)
+        return FULL_RANGE;
+      auto range_iter = BUILTIN_RANGES.find(sym->getName());
+      if (range_iter == BUILTIN_RANGES.end())
+        return FULL_RANGE;
+      return range_iter->second;
+    }
+    case NODE_UNARY_EXPRESSION: {
+      auto *unary_expr = (LSLUnaryExpression *) expr;
+      auto *child_expr = unary_expr->getChildExpr();
+      switch (unary_expr->getOperation()) {
+        case '!':
+          return {0, 1};
+        case '-': {
+          auto child_range = getRange(child_expr);
+          return {-child_range.max, -child_range.min};
+        }
+        case '~': {
+          auto child_range = getRange(child_expr);
+          return {~child_range.max, ~child_range.min};
+        }
+        default:
+          return FULL_RANGE;
+      }
+    }
+    case NODE_BINARY_EXPRESSION: {
+      auto *bin_expr = (LSLBinaryExpression *) expr;
+      auto *lhs = bin_expr->getLHS();
+      auto *rhs = bin_expr->getRHS();
+      switch (bin_expr->getOperation()) {
+        case OP_EQ:
+        case OP_NEQ:
+        case OP_GREATER:
+        case OP_LESS:
+        case OP_GEQ:
+        case OP_LEQ:
+        case OP_BOOLEAN_AND:
+        case OP_BOOLEAN_OR:
+          return {0, 1};
+        case '=':
+          if (((LSLLValueExpression *) lhs)->getMember())
+            return FULL_RANGE;
+          return getRange(rhs);
+        default:
+          break;
+      }
+
+      // Everything else only has interesting ranges when both sides are ints
+      if (lhs->getIType() != LST_INTEGER || rhs->getIType() != LST_INTEGER)
+        return FULL_RANGE;
+      auto lhs_range = getRange(lhs);
+      auto rhs_range = getRange(rhs);
+      switch (bin_expr->getOperation()) {
+        case '+':
+          return {lhs_range.min + rhs_range.min, lhs_range.max + rhs_range.max};
+        case '-':
+          return {lhs_range.min - rhs_range.max, lhs_range.max - rhs_range.min};
+        case '*': {
+          // Both sides are within int32, so none of these can overflow an int64.
+          int64_t products[4] {
+            lhs_range.min * rhs_range.min,
+            lhs_range.min * rhs_range.max,
+            lhs_range.max * rhs_range.min,
+            lhs_range.max * rhs_range.max,
+          };
+          return {*std::min_element(products, products + 4), *std::max_element(products, products + 4)};
+        }
+        case '%': {
+          // Result can't be any further from zero than the divisor, and takes the sign of the dividend.
+          int64_t max_mag = std::max(std::abs(rhs_range.min), std::abs(rhs_range.max)) - 1;
+          if (max_mag < 0)
+            return FULL_RANGE;
+          if (lhs_range.min >= 0)
+            return {0, std::min(max_mag, lhs_range.max)};
+          return {-max_mag, max_mag};
+        }
+        case OP_BIT_AND:
+          if (lhs_range.min >= 0 && rhs_range.min >= 0)
+            return {0, std::min(lhs_range.max, rhs_range.max)};
+          if (lhs_range.min >= 0)
+            return {0, lhs_range.max};
+          if (rhs_range.min >= 0)
+            return {0, rhs_range.max};
+          return FULL_RANGE;
+        default:
+          return FULL_RANGE;
+      }
+    }
+    default:
+      return FULL_RANGE;
+  }
+}
+
+IntRange IntRangeAnalysis::getSymbolRange(LSLLValueExpression *lvalue) {
+  if (!is_int_counter(lvalue))
+    return FULL_RANGE;
+  auto *sym = lvalue->getSymbol();
+
+  // Only `for` loop counters have known ranges, and only within the loop's body and increment
+  // expressions, where the loop's check is known to have passed.
+  LSLASTNode *child = lvalue;
+  for (auto *node = lvalue->getParent(); node; child = node, node = node->getParent()) {
+    if (node->getNodeSubType() != NODE_FOR_STATEMENT)
+      continue;
+    auto *for_stmt = (LSLForStatement *) node;
+    if (child != for_stmt->getBody() && child != for_stmt->getIncrExprs())
+      continue;
+    const auto &induction_info = getInductionInfo(for_stmt);
+    if (induction_info.sym == sym)
+      return induction_info.range;
+  }
+  return FULL_RANGE;
+}
+
+const IntRangeAnalysis::InductionInfo &IntRangeAnalysis::getInductionInfo(LSLForStatement *for_stmt) {
+  auto cache_iter = _mInductionCache.find(for_stmt);
+  if (cache_iter != _mInductionCache.end())
+    return cache_iter->second;
+
+  // Start out saying this loop has no counter, in case anything in here
+  // winds up asking about the same loop again.
+  auto &info = _mInductionCache[for_stmt];
+
+  // Looking for `for(i = init; i < bound; ++i)` or with `<=`
+  auto *check_expr = for_stmt->getCheckExpr();
+  if (check_expr->getNodeSubType() != NODE_BINARY_EXPRESSION)
+    return info;
+  auto *check_bin_expr = (LSLBinaryExpression *) check_expr;
+  auto check_op = check_bin_expr->getOperation();
+  if (check_op != OP_LESS && check_op != OP_LEQ)
+    return info;
+  if (!is_int_counter(check_bin_expr->getLHS()))
+    return info;
+  auto *sym = check_bin_expr->getLHS()->getSymbol();
+
+  LSLExpression *incr_expr = nullptr;
+  for (auto *incr_node : *for_stmt->getIncrExprs()) {
+    if (incr_expr)
+      return info;
+    incr_expr = (LSLExpression *) incr_node;
+  }
+  if (!incr_expr || !is_counter_increment(incr_expr, sym))
+    return info;
+
+  // Nothing else can be allowed to touch the counter, and nothing can jump into the loop.
+  AssignmentFindingVisitor assignment_visitor(sym);
+  check_expr->visit(&assignment_visitor);
+  for_stmt->getBody()->visit(&assignment_visitor);
+  if (assignment_visitor.mFound)
+    return info;
+  if (contains_label(for_stmt->getBody()))
+    return info;
+
+  int64_t min_val = INT32_MIN;
+  for (auto *init_node : *for_stmt->getInitExprs()) {
+    auto *init_expr = (LSLBinaryExpression *) init_node;
+    if (init_node->getNodeSubType() == NODE_BINARY_EXPRESSION
+        && init_expr->getOperation() == '='
+        && init_expr->getLHS()->getSymbol() == sym
+        && !has_side_effects(init_expr->getRHS())) {
+      min_val = getRange(init_expr->getRHS()).min;
+    } else {
+      AssignmentFindingVisitor init_assignment_visitor(sym);
+      init_node->visit(&init_assignment_visitor);
+      if (init_assignment_visitor.mFound)
+        min_val = INT32_MIN;
+    }
+  }
+
+  auto bound_range = getRange(check_bin_expr->getRHS());
+  int64_t max_val = (check_op == OP_LESS) ? bound_range.max - 1 : bound_range.max;
+  // With `<=` against INT32_MAX the increment could wrap around and pass the check again.
+  if (check_op == OP_LEQ && bound_range.max == INT32_MAX)
+    min_val = INT32_MIN;
+
+  info.sym = sym;
+  info.range = {min_val, std::max(min_val, max_val)};
+  return info;
+}
+
+}
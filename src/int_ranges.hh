@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+#include <tailslide/tailslide.hh>
+
+namespace Tailslide {
+
+// Inclusive bounds on the value an integer expression can take, wide enough
+// to hold the result of int32 arithmetic before it gets wrapped.
+struct IntRange {
+  int64_t min = INT32_MIN;
+  int64_t max = INT32_MAX;
+
+  bool fitsInt32() const {
+    return min >= INT32_MIN && max <= INT32_MAX;
+  }
+};
+
+// Figures out bounds for integer expressions so that arithmetic that can't overflow
+// doesn't need to go through the wraparound helpers. Deliberately simple, ranges only
+// come from constants, operators with naturally bounded results, a handful of builtins
+// and the counters of `for` loops that count up towards a bound.
+class IntRangeAnalysis {
+  public:
+    // Range of the (wrapped) value of an integer expression
+    IntRange getRange(LSLExpression *expr);
+    // Whether an int `+`, `-`, `*` or negation could need wrapping to fit into an int32
+    bool canWrap(LSLExpression *expr);
+
+  protected:
+    // Range of the result of an arithmetic expression as if it was computed with infinite precision
+    IntRange getUnwrappedRange(LSLExpression *expr);
+    IntRange getSymbolRange(LSLLValueExpression *lvalue);
+
+    struct InductionInfo {
+      LSLSymbol *sym = nullptr;
+      // Range of the counter within the loop body and increment expressions
+      IntRange range;
+    };
+    const InductionInfo &getInductionInfo(LSLForStatement *for_stmt);
+
+    std::map<LSLForStatement *, InductionInfo> _mInductionCache;
+};
+
+}
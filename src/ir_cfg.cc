@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <sstream>
+
+#include "ir_cfg.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+static bool is_op(const json &instr, const char *name) {
+  return instr.value("op", "") == name;
+}
+
+static bool is_label(const json &instr) {
+  return instr.value("instr_type", "") == "label";
+}
+
+static bool is_conditional_jump(const json &instr) {
+  return (is_op(instr, "JUMP") && instr.value("jump_type", "") != "ALWAYS") || is_op(instr, "CMP_LOCAL_CONST_JUMP");
+}
+
+// Execution never continues on to whatever comes after these
+static bool is_terminator(const json &instr) {
+  return is_op(instr, "RET") || is_op(instr, "JUMP_TABLE")
+      || (is_op(instr, "JUMP") && instr.value("jump_type", "") == "ALWAYS");
+}
+
+IRControlFlowGraph::IRControlFlowGraph(const json::array_t &code) {
+  std::map<std::string, size_t> label_blocks;
+  IRBasicBlock block;
+  bool has_ops = false;
+  bool ended = false;
+  for (size_t i = 0; i < code.size(); ++i) {
+    const auto &instr = code[i];
+    bool label = is_label(instr);
+    if (ended || (label && has_ops)) {
+      block.end = i;
+      mBlocks.push_back(block);
+      block = IRBasicBlock();
+      block.start = i;
+      has_ops = false;
+    }
+    if (label) {
+      auto label_name = instr["label"].get<std::string>();
+      if (block.label.empty())
+        block.label = label_name;
+      label_blocks[label_name] = mBlocks.size();
+      ended = false;
+    } else {
+      has_ops = true;
+      ended = is_terminator(instr) || is_conditional_jump(instr);
+    }
+  }
+  block.end = code.size();
+  mBlocks.push_back(block);
+
+  for (size_t block_idx = 0; block_idx < mBlocks.size(); ++block_idx) {
+    auto &cur_block = mBlocks[block_idx];
+    std::vector<std::string> targets;
+    bool falls_through = true;
+    for (size_t i = cur_block.end; i > cur_block.start; --i) {
+      const auto &instr = code[i - 1];
+      if (is_label(instr))
+        continue;
+      if (instr.contains("label") && !is_label(instr))
+        targets.push_back(instr["label"].get<std::string>());
+      if (is_op(instr, "JUMP_TABLE")) {
+        for (const auto &jump_case : instr["cases"])
+          targets.push_back(jump_case["label"].get<std::string>());
+        targets.push_back(instr["default_label"].get<std::string>());
+      }
+      falls_through = !is_terminator(instr);
+      break;
+    }
+    for (const auto &target : targets) {
+      auto target_iter = label_blocks.find(target);
+      if (target_iter != label_blocks.end())
+        cur_block.succs.push_back(target_iter->second);
+    }
+    if (falls_through && block_idx + 1 < mBlocks.size())
+      cur_block.succs.push_back(block_idx + 1);
+    std::sort(cur_block.succs.begin(), cur_block.succs.end());
+    cur_block.succs.erase(std::unique(cur_block.succs.begin(), cur_block.succs.end()), cur_block.succs.end());
+  }
+  for (size_t block_idx = 0; block_idx < mBlocks.size(); ++block_idx) {
+    for (auto succ : mBlocks[block_idx].succs)
+      mBlocks[succ].preds.push_back(block_idx);
+  }
+}
+
+std::vector<bool> IRControlFlowGraph::findReachable() const {
+  std::vector<bool> reachable(mBlocks.size(), false);
+  std::vector<size_t> pending {0};
+  while (!pending.empty()) {
+    auto block_idx = pending.back();
+    pending.pop_back();
+    if (reachable[block_idx])
+      continue;
+    reachable[block_idx] = true;
+    for (auto succ : mBlocks[block_idx].succs)
+      pending.push_back(succ);
+  }
+  return reachable;
+}
+
+json IRControlFlowGraph::toJSON() const {
+  json::array_t blocks;
+  for (const auto &block : mBlocks) {
+    blocks.push_back({
+        {"label", block.label.empty() ? json() : json(block.label)},
+        {"start", block.start},
+        {"end", block.end},
+        {"preds", block.preds},
+        {"succs", block.succs}
+    });
+  }
+  return json {{"blocks", blocks}};
+}
+
+std::string IRControlFlowGraph::toDOT(const std::string &name, const json::array_t &code) const {
+  std::stringstream dot;
+  dot << "digraph \"" << name << "\" {\n";
+  dot << "  node [shape=box fontname=monospace];\n";
+  for (size_t block_idx = 0; block_idx < mBlocks.size(); ++block_idx) {
+    const auto &block = mBlocks[block_idx];
+    dot << "  b" << block_idx << " [label=\"";
+    dot << (block.label.empty() ? "b" + std::to_string(block_idx) : block.label) << ":\\l";
+    for (size_t i = block.start; i < block.end; ++i) {
+      if (!is_label(code[i]))
+        dot << "  " << code[i]["op"].get<std::string>() << "\\l";
+    }
+    dot << "\"];\n";
+    for (auto succ : block.succs)
+      dot << "  b" << block_idx << " -> b" << succ << ";\n";
+  }
+  dot << "}\n";
+  return dot.str();
+}
+
+// Figures out which local or arg an op refers to, locals come first then args.
+static bool get_slot(const json &instr, size_t num_locals, size_t num_args, size_t *slot) {
+  auto whence = instr.value("whence", "");
+  if (whence != "LOCAL" && whence != "ARG")
+    return false;
+  auto index = instr["index"].get<size_t>();
+  if (whence == "LOCAL") {
+    *slot = index;
+    return index < num_locals;
+  }
+  *slot = num_locals + index;
+  return index < num_args;
+}
+
+static bool is_slot_use(const json &instr) {
+  return is_op(instr, "PUSH") || is_op(instr, "INCR_LOCAL") || is_op(instr, "CMP_LOCAL_CONST_JUMP");
+}
+
+static bool is_slot_def(const json &instr) {
+  return is_op(instr, "STORE") || is_op(instr, "STORE_DEFAULT") || is_op(instr, "INCR_LOCAL");
+}
+
+static bool remove_unreachable_blocks(json::array_t &code, IRDataflowStats *stats) {
+  IRControlFlowGraph cfg(code);
+  auto reachable = cfg.findReachable();
+  if (std::find(reachable.begin(), reachable.end(), false) == reachable.end())
+    return false;
+  json::array_t new_code;
+  for (size_t block_idx = 0; block_idx < cfg.mBlocks.size(); ++block_idx) {
+    const auto &block = cfg.mBlocks[block_idx];
+    if (!reachable[block_idx]) {
+      (*stats)["unreachable_blocks"] += 1;
+      continue;
+    }
+    for (size_t i = block.start; i < block.end; ++i)
+      new_code.push_back(std::move(code[i]));
+  }
+  code = std::move(new_code);
+  return true;
+}
+
+static bool remove_dead_stores(json::array_t &code, size_t num_locals, size_t num_args, IRDataflowStats *stats) {
+  IRControlFlowGraph cfg(code);
+  size_t num_slots = num_locals + num_args;
+  size_t num_blocks = cfg.mBlocks.size();
+
+  // slots read before being written in each block, and slots written in each block
+  std::vector<std::vector<bool>> gen(num_blocks, std::vector<bool>(num_slots, false));
+  std::vector<std::vector<bool>> kill(num_blocks, std::vector<bool>(num_slots, false));
+  for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+    const auto &block = cfg.mBlocks[block_idx];
+    for (size_t i = block.end; i > block.start; --i) {
+      const auto &instr = code[i - 1];
+      size_t slot;
+      if (!get_slot(instr, num_locals, num_args, &slot))
+        continue;
+      if (is_slot_def(instr)) {
+        kill[block_idx][slot] = true;
+        gen[block_idx][slot] = false;
+      }
+      if (is_slot_use(instr))
+        gen[block_idx][slot] = true;
+    }
+  }
+
+  std::vector<std::vector<bool>> live_in(num_blocks, std::vector<bool>(num_slots, false));
+  std::vector<std::vector<bool>> live_out(num_blocks, std::vector<bool>(num_slots, false));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t block_idx = num_blocks; block_idx-- > 0;) {
+      std::vector<bool> out(num_slots, false);
+      for (auto succ : cfg.mBlocks[block_idx].succs) {
+        for (size_t slot = 0; slot < num_slots; ++slot)
+          out[slot] = out[slot] || live_in[succ][slot];
+      }
+      std::vector<bool> in(num_slots);
+      for (size_t slot = 0; slot < num_slots; ++slot)
+        in[slot] = gen[block_idx][slot] || (out[slot] && !kill[block_idx][slot]);
+      if (in != live_in[block_idx] || out != live_out[block_idx]) {
+        live_in[block_idx] = std::move(in);
+        live_out[block_idx] = std::move(out);
+        changed = true;
+      }
+    }
+  }
+
+  // Walk each block backwards, tracking what's live after each op
+  std::vector<bool> removed(code.size(), false);
+  bool any_removed = false;
+  for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+    const auto &block = cfg.mBlocks[block_idx];
+    auto live = live_out[block_idx];
+    for (size_t i = block.end; i > block.start; --i) {
+      auto &instr = code[i - 1];
+      size_t slot;
+      if (!get_slot(instr, num_locals, num_args, &slot))
+        continue;
+      if (is_op(instr, "STORE_DEFAULT") && !live[slot]) {
+        removed[i - 1] = true;
+        any_removed = true;
+        (*stats)["dead_store_defaults"] += 1;
+        continue;
+      }
+      if (is_op(instr, "STORE") && !live[slot]) {
+        any_removed = true;
+        (*stats)["dead_stores"] += 1;
+        // If the value was just pushed we don't need it at all, otherwise it still has to be popped.
+        bool just_pushed = i - 1 > block.start
+            && (is_op(code[i - 2], "PUSH") || is_op(code[i - 2], "PUSH_CONSTANT") || is_op(code[i - 2], "DUP"));
+        if (just_pushed) {
+          removed[i - 1] = true;
+          removed[i - 2] = true;
+          // skip over the push, it doesn't count as a use anymore
+          --i;
+        } else {
+          instr = json::object_t {
+              {"instr_type", "op"},
+              {"op", "POP_N"},
+              {"num", 1}
+          };
+        }
+        continue;
+      }
+      if (is_slot_def(instr))
+        live[slot] = false;
+      if (is_slot_use(instr))
+        live[slot] = true;
+    }
+  }
+  if (!any_removed)
+    return false;
+
+  json::array_t new_code;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (!removed[i])
+      new_code.push_back(std::move(code[i]));
+  }
+  code = std::move(new_code);
+  return true;
+}
+
+void eliminate_dead_ir_stores(json::array_t &code, size_t num_locals, size_t num_args, IRDataflowStats *stats) {
+  (*stats)["unreachable_blocks"] += 0;
+  (*stats)["dead_stores"] += 0;
+  (*stats)["dead_store_defaults"] += 0;
+  // Dropping code can make more stores dead, keep going until it doesn't.
+  while (remove_unreachable_blocks(code, stats) || remove_dead_stores(code, num_locals, num_args, stats)) {}
+}
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../extern/json.hh"
+
+namespace Tailslide {
+
+struct IRBasicBlock {
+  // the range of the function's code this block covers, including any labels at its start
+  size_t start = 0;
+  size_t end = 0;
+  // the first label at the start of the block, empty if there isn't one
+  std::string label;
+  std::vector<size_t> preds;
+  std::vector<size_t> succs;
+};
+
+// Splits a function's stack IR into basic blocks, starting a new one at each label
+// and after every jump or `RET`. The first block is the entry block.
+class IRControlFlowGraph {
+  public:
+    explicit IRControlFlowGraph(const nlohmann::json::array_t &code);
+
+    // Which blocks can be reached from the entry block
+    std::vector<bool> findReachable() const;
+    nlohmann::json toJSON() const;
+    std::string toDOT(const std::string &name, const nlohmann::json::array_t &code) const;
+
+    std::vector<IRBasicBlock> mBlocks;
+};
+
+enum IRCFGFormat {
+  IR_CFG_NONE,
+  IR_CFG_JSON,
+  IR_CFG_DOT,
+};
+
+// what was removed -> how many of them
+typedef std::map<std::string, uint32_t> IRDataflowStats;
+
+// Removes blocks that can never run, then uses liveness of the function's locals and args to remove
+// `STORE`s and `STORE_DEFAULT`s whose values are never read. Stored values that were just pushed
+// go too, other stored values are popped instead since computing them might have side effects.
+void eliminate_dead_ir_stores(nlohmann::json::array_t &code, size_t num_locals, size_t num_args,
+                              IRDataflowStats *stats);
+
+}
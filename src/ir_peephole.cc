@@ -0,0 +1,256 @@
+#include <set>
+
+#include "ir_peephole.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+bool *get_peephole_rule(IRPeepholeOptions *options, const std::string &name) {
+  if (name == "push_pop")
+    return &options->push_pop;
+  if (name == "dup_store_pop")
+    return &options->dup_store_pop;
+  if (name == "jump_threading")
+    return &options->jump_threading;
+  if (name == "jump_to_next")
+    return &options->jump_to_next;
+  if (name == "unreachable_code")
+    return &options->unreachable_code;
+  if (name == "cast_pairs")
+    return &options->cast_pairs;
+  return nullptr;
+}
+
+static bool is_op(const json &instr, const char *name) {
+  return instr.value("op", "") == name;
+}
+
+static bool is_label(const json &instr) {
+  return instr.value("instr_type", "") == "label";
+}
+
+static bool is_unconditional_jump(const json &instr) {
+  return is_op(instr, "JUMP") && instr.value("jump_type", "") == "ALWAYS";
+}
+
+// Execution can never continue on to whatever comes after these
+static bool is_terminator(const json &instr) {
+  return is_op(instr, "RET") || is_op(instr, "JUMP_TABLE") || is_unconditional_jump(instr);
+}
+
+// Ops that push a single value and do nothing else
+static bool is_pure_push(const json &instr) {
+  return is_op(instr, "PUSH") || is_op(instr, "PUSH_CONSTANT") || is_op(instr, "PUSH_EMPTY")
+      || is_op(instr, "DUP");
+}
+
+// Whether casting to `to_type` and back to `from_type` always gives back the original value.
+// Not true of anything involving floats, those lose precision on the way.
+static bool is_lossless_round_trip(const std::string &from_type, const std::string &to_type) {
+  return (from_type == "key" && to_type == "string")
+      || (from_type == "string" && to_type == "key")
+      || (from_type == "integer" && to_type == "string");
+}
+
+template<typename F>
+static void for_each_jump_label(json &instr, F func) {
+  if (is_op(instr, "JUMP")) {
+    func(instr["label"]);
+  } else if (is_op(instr, "JUMP_TABLE")) {
+    for (auto &jump_case : instr["cases"])
+      func(jump_case["label"]);
+    func(instr["default_label"]);
+  }
+}
+
+static std::set<std::string> find_referenced_labels(json::array_t &code) {
+  std::set<std::string> referenced;
+  for (auto &instr : code) {
+    for_each_jump_label(instr, [&](json &label) {
+      referenced.insert(label.get<std::string>());
+    });
+  }
+  return referenced;
+}
+
+static bool thread_jumps(json::array_t &code, IRPeepholeStats *stats) {
+  std::map<std::string, size_t> label_indices;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (is_label(code[i]))
+      label_indices[code[i]["label"].get<std::string>()] = i;
+  }
+
+  // The first op that runs after jumping to `label`
+  auto op_after_label = [&](const std::string &label) -> json * {
+    auto label_iter = label_indices.find(label);
+    if (label_iter == label_indices.end())
+      return nullptr;
+    for (size_t i = label_iter->second; i < code.size(); ++i) {
+      if (!is_label(code[i]))
+        return &code[i];
+    }
+    return nullptr;
+  };
+
+  uint32_t num_threaded = 0;
+  for (auto &instr : code) {
+    for_each_jump_label(instr, [&](json &label) {
+      std::string target = label.get<std::string>();
+      // jumps that end up going round in a circle stop at the first repeat
+      std::set<std::string> seen {target};
+      json *next_op;
+      while ((next_op = op_after_label(target)) && is_unconditional_jump(*next_op)) {
+        std::string next_target = (*next_op)["label"].get<std::string>();
+        if (!seen.insert(next_target).second)
+          break;
+        target = next_target;
+      }
+      if (target != label.get<std::string>()) {
+        label = target;
+        ++num_threaded;
+      }
+    });
+  }
+  (*stats)["jump_threading"] += num_threaded;
+  return num_threaded != 0;
+}
+
+static bool remove_jumps_to_next(json::array_t &code, IRPeepholeStats *stats) {
+  json::array_t new_code;
+  uint32_t num_removed = 0;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (is_unconditional_jump(code[i])) {
+      bool jumps_to_next = false;
+      for (size_t j = i + 1; j < code.size() && is_label(code[j]); ++j) {
+        if (code[j]["label"] == code[i]["label"]) {
+          jumps_to_next = true;
+          break;
+        }
+      }
+      if (jumps_to_next) {
+        ++num_removed;
+        continue;
+      }
+    }
+    new_code.push_back(std::move(code[i]));
+  }
+  code = std::move(new_code);
+  (*stats)["jump_to_next"] += num_removed;
+  return num_removed != 0;
+}
+
+static bool remove_unreachable_code(json::array_t &code, IRPeepholeStats *stats) {
+  auto referenced = find_referenced_labels(code);
+  json::array_t new_code;
+  uint32_t num_removed = 0;
+  bool changed = false;
+  bool reachable = true;
+  for (auto &instr : code) {
+    if (is_label(instr)) {
+      if (referenced.find(instr["label"].get<std::string>()) != referenced.end()) {
+        reachable = true;
+      } else if (!reachable) {
+        // nothing can get here, the label's just in the way of removing what comes after it.
+        changed = true;
+        continue;
+      }
+    } else if (!reachable) {
+      ++num_removed;
+      continue;
+    } else if (is_terminator(instr)) {
+      reachable = false;
+    }
+    new_code.push_back(std::move(instr));
+  }
+  code = std::move(new_code);
+  (*stats)["unreachable_code"] += num_removed;
+  return changed || num_removed != 0;
+}
+
+// Tries each of the rules that only need to look at the last few ops written.
+// Returns the number of ops removed from the end of `code`.
+static uint32_t match_tail(json::array_t &code, const IRPeepholeOptions &options, IRPeepholeStats *stats) {
+  size_t size = code.size();
+  if (size < 2)
+    return 0;
+  auto &last = code[size - 1];
+  auto &prev = code[size - 2];
+
+  if (is_op(last, "POP_N")) {
+    // find the push the first pop would throw away
+    const char *rule;
+    size_t push_idx;
+    if (options.push_pop && is_pure_push(prev)) {
+      // `PUSH`, `POP_N n` -> `POP_N n-1`
+      rule = "push_pop";
+      push_idx = size - 2;
+    } else if (options.dup_store_pop && size >= 3 && is_op(prev, "STORE") && is_op(code[size - 3], "DUP")) {
+      // `DUP`, `STORE`, `POP_N n` -> `STORE`, `POP_N n-1`
+      rule = "dup_store_pop";
+      push_idx = size - 3;
+    } else {
+      return 0;
+    }
+    auto num_pops = last["num"].get<uint32_t>();
+    uint32_t num_removed = 1;
+    code.erase(code.begin() + (ptrdiff_t)push_idx);
+    if (num_pops == 1) {
+      code.pop_back();
+      ++num_removed;
+    } else {
+      code.back()["num"] = num_pops - 1;
+    }
+    (*stats)[rule] += num_removed;
+    return num_removed;
+  }
+
+  if (options.cast_pairs && is_op(last, "CAST") && is_op(prev, "CAST")) {
+    auto from_type = prev["from_type"].get<std::string>();
+    auto to_type = prev["to_type"].get<std::string>();
+    if (last["from_type"] == to_type && last["to_type"] == from_type && is_lossless_round_trip(from_type, to_type)) {
+      code.resize(size - 2);
+      (*stats)["cast_pairs"] += 2;
+      return 2;
+    }
+  }
+  return 0;
+}
+
+static bool apply_local_rules(json::array_t &code, const IRPeepholeOptions &options, IRPeepholeStats *stats) {
+  json::array_t new_code;
+  bool changed = false;
+  for (auto &instr : code) {
+    new_code.push_back(std::move(instr));
+    // removing ops can make the ones before them match, keep going until nothing does.
+    while (match_tail(new_code, options, stats))
+      changed = true;
+  }
+  code = std::move(new_code);
+  return changed;
+}
+
+void optimize_ir_code(json::array_t &code, const IRPeepholeOptions &options, IRPeepholeStats *stats) {
+  // Make sure every enabled rule shows up in the stats, even if it never matched
+  IRPeepholeOptions rule_options = options;
+  for (const auto *rule_name : IR_PEEPHOLE_RULES) {
+    if (*get_peephole_rule(&rule_options, rule_name))
+      (*stats)[rule_name] += 0;
+  }
+
+  // Each rule can expose more for the others to clean up
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    if (options.jump_threading)
+      changed |= thread_jumps(code, stats);
+    if (options.jump_to_next)
+      changed |= remove_jumps_to_next(code, stats);
+    if (options.unreachable_code)
+      changed |= remove_unreachable_code(code, stats);
+    if (options.push_pop || options.dup_store_pop || options.cast_pairs)
+      changed |= apply_local_rules(code, options, stats);
+  }
+}
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "../extern/json.hh"
+
+namespace Tailslide {
+
+struct IRPeepholeOptions {
+  // Drop ops that only push a value when it gets popped right away
+  bool push_pop = true;
+  // `DUP`, `STORE`, `POP_N 1` is just a `STORE`
+  bool dup_store_pop = true;
+  // Jumps to a label that's followed by an unconditional jump go straight to its target
+  bool jump_threading = true;
+  // Unconditional jumps to the label right after them
+  bool jump_to_next = true;
+  // Ops after a `RET` or unconditional jump that no label makes reachable again
+  bool unreachable_code = true;
+  // Pairs of `CAST`s where the second gives back exactly what the first was given
+  bool cast_pairs = true;
+};
+
+const char * const IR_PEEPHOLE_RULES[] = {
+    "push_pop",
+    "dup_store_pop",
+    "jump_threading",
+    "jump_to_next",
+    "unreachable_code",
+    "cast_pairs",
+};
+
+// The flag for the rule called `name`, or `nullptr` if there's no such rule
+bool *get_peephole_rule(IRPeepholeOptions *options, const std::string &name);
+
+// rule name -> how many ops it removed. `jump_threading` counts retargeted jumps instead,
+// the ops those make unnecessary are counted by the rules that remove them.
+typedef std::map<std::string, uint32_t> IRPeepholeStats;
+
+// Rewrites the code for a single function in place until no more rules apply
+void optimize_ir_code(nlohmann::json::array_t &code, const IRPeepholeOptions &options, IRPeepholeStats *stats);
+
+}
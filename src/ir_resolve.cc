@@ -0,0 +1,139 @@
+#include "ir_resolve.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+typedef std::map<std::string, uint32_t> IRIndexMap;
+
+struct IRResolveTables {
+  IRIndexMap functions;
+  IRIndexMap builtins;
+  IRIndexMap states;
+};
+
+// `what` is the kind of thing being looked up, for the error message
+static bool lookup(const IRIndexMap &indices, const json &name, const char *what, json *out, std::string *error) {
+  auto index_iter = indices.find(name.get<std::string>());
+  if (index_iter == indices.end()) {
+    *error = std::string("unknown ") + what + " '" + name.get<std::string>() + "'";
+    return false;
+  }
+  *out = index_iter->second;
+  return true;
+}
+
+static bool resolve_code(json &func_like, const char *code_key, const IRResolveTables &tables, std::string *error) {
+  auto &code = func_like[code_key];
+  // Labels take up no space once they're gone, so figure out where each op ends up first
+  std::map<std::string, uint32_t> label_targets;
+  std::vector<uint32_t> new_indices;
+  uint32_t num_ops = 0;
+  for (const auto &instr : code) {
+    new_indices.push_back(num_ops);
+    if (instr["instr_type"] == "label")
+      label_targets[instr["label"].get<std::string>()] = num_ops;
+    else
+      ++num_ops;
+  }
+  new_indices.push_back(num_ops);
+
+  json::array_t new_code;
+  json label_depth;
+  for (auto &instr : code) {
+    if (instr["instr_type"] == "label") {
+      // keep any stack depth on entry around on the op the label pointed to
+      if (instr.contains("stack_depth"))
+        label_depth = instr["stack_depth"];
+      continue;
+    }
+    if (!label_depth.is_null()) {
+      instr["stack_depth"] = label_depth;
+      label_depth = nullptr;
+    }
+    const auto op = instr["op"].get<std::string>();
+    if (instr.contains("label")) {
+      if (!lookup(label_targets, instr["label"], "label", &instr["target"], error))
+        return false;
+      instr.erase("label");
+    }
+    if (op == "JUMP_TABLE") {
+      for (auto &jump_case : instr["cases"]) {
+        if (!lookup(label_targets, jump_case["label"], "label", &jump_case["target"], error))
+          return false;
+        jump_case.erase("label");
+      }
+      if (!lookup(label_targets, instr["default_label"], "label", &instr["default_target"], error))
+        return false;
+      instr.erase("default_label");
+    } else if (op == "CALL") {
+      if (!lookup(tables.functions, instr["name"], "function", &instr["function"], error))
+        return false;
+      instr.erase("name");
+    } else if (op == "CALL_LIB") {
+      if (!lookup(tables.builtins, instr["name"], "builtin", &instr["builtin"], error))
+        return false;
+      instr.erase("name");
+    } else if (op == "CHANGE_STATE") {
+      json state_index;
+      if (!lookup(tables.states, instr["state"], "state", &state_index, error))
+        return false;
+      instr["state"] = state_index;
+    }
+    new_code.push_back(std::move(instr));
+  }
+  code = std::move(new_code);
+
+  if (func_like.contains("cfg") && func_like["cfg"].is_object()) {
+    for (auto &block : func_like["cfg"]["blocks"]) {
+      block["start"] = new_indices[block["start"].get<size_t>()];
+      block["end"] = new_indices[block["end"].get<size_t>()];
+    }
+  }
+  return true;
+}
+
+bool resolve_ir(json &ir, const IRSignatureMap &builtins, std::string *error) {
+  IRResolveTables tables;
+  for (const auto &func : ir["functions"])
+    tables.functions[func["name"].get<std::string>()] = (uint32_t)tables.functions.size();
+  for (const auto &state : ir["states"])
+    tables.states[state["name"].get<std::string>()] = (uint32_t)tables.states.size();
+
+  json::array_t builtins_table;
+  for (const auto &builtin : builtins) {
+    tables.builtins[builtin.first] = (uint32_t)builtins_table.size();
+    builtins_table.push_back({
+        {"name", builtin.first},
+        {"return", builtin.second.ret},
+        {"args", builtin.second.args}
+    });
+  }
+  ir["builtins"] = builtins_table;
+
+  auto resolve_func_like = [&](json &func_like) {
+    if (!resolve_code(func_like, "code", tables, error)) {
+      *error = func_like["name"].get<std::string>() + ": " + *error;
+      return false;
+    }
+    return true;
+  };
+
+  if (!resolve_code(ir, "init_code", tables, error)) {
+    *error = "init_code: " + *error;
+    return false;
+  }
+  for (auto &func : ir["functions"]) {
+    if (!resolve_func_like(func))
+      return false;
+  }
+  for (auto &state : ir["states"]) {
+    for (auto &handler : state["handlers"]) {
+      if (!resolve_func_like(handler))
+        return false;
+    }
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+#include "../extern/json.hh"
+#include "json_ir_pass.hh"
+
+namespace Tailslide {
+
+// Replaces every name in the IR that a consumer would otherwise have to look up:
+//  * labels are removed, jumps get the index of the op to jump to in `target`
+//    (`JUMP_TABLE` cases and its default get `target` and `default_target`)
+//  * `CALL` gets the index of the function in `functions` as `function`
+//  * `CALL_LIB` gets the index of the builtin in a new top-level `builtins` table as `builtin`,
+//    each entry gives the builtin's `name`, `return` type and `args` types
+//  * `CHANGE_STATE` gets the index of the state in `states` as `state`
+// Any `cfg` ranges are updated to match the code without labels, and any label `stack_depth`
+// moves to the op the label pointed to. Fails if anything refers to a name that doesn't exist.
+bool resolve_ir(nlohmann::json &ir, const IRSignatureMap &builtins, std::string *error);
+
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "ir_stack_depth.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+struct IRStackEffect {
+  uint32_t pops = 0;
+  uint32_t pushes = 0;
+};
+
+static bool is_label(const json &instr) {
+  return instr.value("instr_type", "") == "label";
+}
+
+// Execution never continues on to whatever comes after these
+static bool is_terminator(const json &instr) {
+  auto op = instr.value("op", "");
+  return op == "RET" || op == "JUMP_TABLE" || (op == "JUMP" && instr.value("jump_type", "") == "ALWAYS");
+}
+
+static bool get_stack_effect(const json &instr, const IRSignatureMap &functions, const IRSignatureMap &builtins,
+                             IRStackEffect *effect, std::string *error) {
+  auto op = instr.value("op", "");
+  if (op == "PUSH" || op == "PUSH_CONSTANT" || op == "PUSH_EMPTY") {
+    effect->pushes = 1;
+  } else if (op == "DUP") {
+    effect->pops = 1;
+    effect->pushes = 2;
+  } else if (op == "STORE" || op == "DUMP" || op == "JUMP_TABLE") {
+    effect->pops = 1;
+  } else if (op == "JUMP") {
+    effect->pops = (instr["jump_type"] != "ALWAYS") ? 1 : 0;
+  } else if (op == "POP_N") {
+    effect->pops = instr["num"].get<uint32_t>();
+  } else if (op == "TAKE_MEMBER" || op == "CAST" || op == "BOOL" || op == "UN_OP") {
+    effect->pops = 1;
+    effect->pushes = 1;
+  } else if (op == "REPLACE_MEMBER" || op == "BIN_OP") {
+    effect->pops = 2;
+    effect->pushes = 1;
+  } else if (op == "BUILD_COORD") {
+    effect->pops = (instr["type"] == "vector") ? 3 : 4;
+    effect->pushes = 1;
+  } else if (op == "BUILD_LIST") {
+    effect->pops = instr["num_elems"].get<uint32_t>();
+    effect->pushes = 1;
+  } else if (op == "CALL" || op == "CALL_LIB") {
+    auto name = instr["name"].get<std::string>();
+    const auto &signatures = (op == "CALL") ? functions : builtins;
+    auto sig_iter = signatures.find(name);
+    if (sig_iter == signatures.end()) {
+      *error = "no signature for " + name;
+      return false;
+    }
+    effect->pops = (uint32_t)sig_iter->second.args.size();
+    // Our own functions return into the slot `PUSH_EMPTY` reserved before the args were pushed
+    if (op == "CALL_LIB" && sig_iter->second.ret != "void")
+      effect->pushes = 1;
+  } else if (op == "STORE_DEFAULT" || op == "STORE_CONSTANT" || op == "INCR_LOCAL"
+             || op == "CMP_LOCAL_CONST_JUMP" || op == "CHANGE_STATE" || op == "RET") {
+    // don't touch the stack
+  } else {
+    *error = "unknown op " + op;
+    return false;
+  }
+  return true;
+}
+
+static std::vector<std::string> get_jump_targets(const json &instr) {
+  std::vector<std::string> targets;
+  if (instr.contains("label"))
+    targets.push_back(instr["label"].get<std::string>());
+  if (instr.value("op", "") == "JUMP_TABLE") {
+    for (const auto &jump_case : instr["cases"])
+      targets.push_back(jump_case["label"].get<std::string>());
+    targets.push_back(instr["default_label"].get<std::string>());
+  }
+  return targets;
+}
+
+static bool annotate_code(json &code, const IRSignatureMap &functions, const IRSignatureMap &builtins,
+                          uint32_t *max_stack, std::string *error) {
+  std::vector<IRStackEffect> effects(code.size());
+  std::map<std::string, size_t> label_indices;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (is_label(code[i]))
+      label_indices[code[i]["label"].get<std::string>()] = i;
+    else if (!get_stack_effect(code[i], functions, builtins, &effects[i], error))
+      return false;
+  }
+
+  // depth of the stack before each instruction, -1 if nothing reaches it
+  std::vector<int64_t> depths(code.size(), -1);
+  std::vector<size_t> pending;
+  auto reach = [&](size_t index, int64_t depth) {
+    if (index >= code.size()) {
+      *error = "code runs past the end";
+      return false;
+    }
+    if (depths[index] == -1) {
+      depths[index] = depth;
+      pending.push_back(index);
+    } else if (depths[index] != depth) {
+      auto where = is_label(code[index]) ? code[index]["label"].get<std::string>() : "op " + std::to_string(index);
+      *error = "stack depth " + std::to_string(depth) + " doesn't match " + std::to_string(depths[index])
+          + " at " + where;
+      return false;
+    }
+    return true;
+  };
+
+  int64_t max_depth = 0;
+  if (!code.empty() && !reach(0, 0))
+    return false;
+  while (!pending.empty()) {
+    size_t i = pending.back();
+    pending.pop_back();
+    const auto &instr = code[i];
+    int64_t depth = depths[i];
+    if (is_label(instr)) {
+      if (!reach(i + 1, depth))
+        return false;
+      continue;
+    }
+    const auto &effect = effects[i];
+    if (depth < effect.pops) {
+      *error = "stack underflow at op " + std::to_string(i) + " (" + instr["op"].get<std::string>() + ")";
+      return false;
+    }
+    depth = depth - effect.pops + effect.pushes;
+    max_depth = std::max(max_depth, depth);
+    for (const auto &target : get_jump_targets(instr)) {
+      auto label_iter = label_indices.find(target);
+      if (label_iter == label_indices.end()) {
+        *error = "jump to unknown label " + target;
+        return false;
+      }
+      if (!reach(label_iter->second, depth))
+        return false;
+    }
+    if (!is_terminator(instr) && !reach(i + 1, depth))
+      return false;
+  }
+
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (!is_label(code[i]))
+      code[i]["stack_effect"] = (int64_t)effects[i].pushes - (int64_t)effects[i].pops;
+    else if (depths[i] != -1)
+      code[i]["stack_depth"] = depths[i];
+  }
+  *max_stack = (uint32_t)max_depth;
+  return true;
+}
+
+bool annotate_ir_stack_depths(json &ir, const IRSignatureMap &builtins, std::string *error) {
+  IRSignatureMap functions;
+  for (const auto &func : ir["functions"]) {
+    auto &sig = functions[func["name"].get<std::string>()];
+    sig.ret = func["return"].get<std::string>();
+    for (const auto &arg : func["args"])
+      sig.args.push_back(arg.get<std::string>());
+  }
+
+  auto annotate_func_like = [&](json &func_like) {
+    uint32_t max_stack = 0;
+    if (!annotate_code(func_like["code"], functions, builtins, &max_stack, error)) {
+      *error = func_like["name"].get<std::string>() + ": " + *error;
+      return false;
+    }
+    func_like["max_stack"] = max_stack;
+    return true;
+  };
+
+  uint32_t init_max_stack = 0;
+  if (!annotate_code(ir["init_code"], functions, builtins, &init_max_stack, error)) {
+    *error = "init_code: " + *error;
+    return false;
+  }
+  ir["init_max_stack"] = init_max_stack;
+  for (auto &func : ir["functions"]) {
+    if (!annotate_func_like(func))
+      return false;
+  }
+  for (auto &state : ir["states"]) {
+    for (auto &handler : state["handlers"]) {
+      if (!annotate_func_like(handler))
+        return false;
+    }
+  }
+  return true;
+}
+
+}
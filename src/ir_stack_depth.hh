@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+#include "../extern/json.hh"
+#include "json_ir_pass.hh"
+
+namespace Tailslide {
+
+// Works out how the stack IR uses the operand stack so consumers don't have to simulate it:
+//  * every op gets its net `stack_effect`
+//  * every label that can be reached gets the `stack_depth` on entry
+//  * every function and handler gets the deepest the stack can get as `max_stack`,
+//    `init_code`'s goes in the top-level `init_max_stack`
+// Fails if an op would pop more than is on the stack, or if two paths reach a label
+// with different stack depths.
+bool annotate_ir_stack_depths(nlohmann::json &ir, const IRSignatureMap &builtins, std::string *error);
+
+}
@@ -0,0 +1,114 @@
+#include "ir_superinstructions.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+static bool is_op(const json &instr, const char *name) {
+  return instr.value("op", "") == name;
+}
+
+static bool is_numeric_type(const json &type) {
+  return type == "integer" || type == "float";
+}
+
+static bool is_comparison(const json &operation) {
+  return operation == "LESS" || operation == "GREATER" || operation == "LEQ" || operation == "GEQ"
+      || operation == "EQ" || operation == "NEQ";
+}
+
+// `PUSH_CONSTANT`, `PUSH` of a local or arg, then a `BIN_OP` between the two,
+// which is how `local <op> constant` gets compiled.
+static bool match_local_const_op(const json::array_t &code, size_t i) {
+  if (i + 2 >= code.size())
+    return false;
+  const auto &constant = code[i];
+  const auto &push = code[i + 1];
+  const auto &bin_op = code[i + 2];
+  if (!is_op(constant, "PUSH_CONSTANT") || !is_op(push, "PUSH") || !is_op(bin_op, "BIN_OP"))
+    return false;
+  const auto &type = constant["type"];
+  return is_numeric_type(type) && push["type"] == type
+      && (push["whence"] == "LOCAL" || push["whence"] == "ARG")
+      && bin_op["left_type"] == type && bin_op["right_type"] == type;
+}
+
+static bool fuse_incr_local(const json::array_t &code, size_t i, json::array_t &new_code) {
+  if (!match_local_const_op(code, i) || i + 3 >= code.size())
+    return false;
+  const auto &push = code[i + 1];
+  const auto &operation = code[i + 2]["operation"];
+  const auto &store = code[i + 3];
+  if ((operation != "PLUS" && operation != "MINUS") || !is_op(store, "STORE")
+      || store["type"] != push["type"] || store["whence"] != push["whence"] || store["index"] != push["index"])
+    return false;
+  new_code.push_back({
+      {"instr_type", "op"},
+      {"op", "INCR_LOCAL"},
+      {"type", push["type"]},
+      {"whence", push["whence"]},
+      {"index", push["index"]},
+      {"operation", operation},
+      {"value", code[i]["value"]}
+  });
+  return true;
+}
+
+static bool fuse_cmp_local_const_jump(const json::array_t &code, size_t i, json::array_t &new_code) {
+  if (!match_local_const_op(code, i) || i + 3 >= code.size())
+    return false;
+  const auto &push = code[i + 1];
+  const auto &operation = code[i + 2]["operation"];
+  const auto &jump = code[i + 3];
+  if (!is_comparison(operation) || !is_op(jump, "JUMP") || jump["jump_type"] == "ALWAYS")
+    return false;
+  new_code.push_back({
+      {"instr_type", "op"},
+      {"op", "CMP_LOCAL_CONST_JUMP"},
+      {"type", push["type"]},
+      {"whence", push["whence"]},
+      {"index", push["index"]},
+      {"operation", operation},
+      {"value", code[i]["value"]},
+      {"jump_type", jump["jump_type"]},
+      {"label", jump["label"]}
+  });
+  return true;
+}
+
+static bool fuse_store_constant(const json::array_t &code, size_t i, json::array_t &new_code) {
+  if (i + 1 >= code.size())
+    return false;
+  const auto &constant = code[i];
+  const auto &store = code[i + 1];
+  if (!is_op(constant, "PUSH_CONSTANT") || !is_op(store, "STORE") || store["type"] != constant["type"])
+    return false;
+  new_code.push_back({
+      {"instr_type", "op"},
+      {"op", "STORE_CONSTANT"},
+      {"type", store["type"]},
+      {"whence", store["whence"]},
+      {"index", store["index"]},
+      {"value", constant["value"]}
+  });
+  return true;
+}
+
+void fuse_superinstructions(json::array_t &code) {
+  json::array_t new_code;
+  size_t i = 0;
+  while (i < code.size()) {
+    // Labels are entries of their own, so a run of ops can't have a jump target in the middle.
+    if (fuse_incr_local(code, i, new_code) || fuse_cmp_local_const_jump(code, i, new_code)) {
+      i += 4;
+    } else if (fuse_store_constant(code, i, new_code)) {
+      i += 2;
+    } else {
+      new_code.push_back(std::move(code[i]));
+      ++i;
+    }
+  }
+  code = std::move(new_code);
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "../extern/json.hh"
+
+namespace Tailslide {
+
+// Replaces common runs of ops with a single op doing the same thing, so anything
+// interpreting the IR has fewer ops to dispatch:
+//  * `INCR_LOCAL`: `PUSH_CONSTANT`, `PUSH`, `BIN_OP PLUS/MINUS`, `STORE` to the same local or argument.
+//    Stores `local <operation> value` back to the local.
+//  * `CMP_LOCAL_CONST_JUMP`: `PUSH_CONSTANT`, `PUSH`, `BIN_OP` comparing them, then `JUMP IF/NIF`.
+//    Jumps to `label` depending on `jump_type` and the result of `local <operation> value`.
+//  * `STORE_CONSTANT`: `PUSH_CONSTANT` then `STORE` of the same type, which can be any type.
+// The first two only fuse integer or float ops that all have the same type, and `STORE_CONSTANT`
+// only fuses a constant that already has the stored type, so no fused op needs an implicit conversion.
+void fuse_superinstructions(nlohmann::json::array_t &code);
+
+}
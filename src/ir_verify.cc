@@ -0,0 +1,323 @@
+#include <map>
+#include <vector>
+
+#include "ir_verify.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+typedef std::vector<std::string> IRStackTypes;
+
+static bool is_label(const json &instr) {
+  return instr.value("instr_type", "") == "label";
+}
+
+// Execution never continues on to whatever comes after these
+static bool is_terminator(const json &instr) {
+  auto op = instr.value("op", "");
+  return op == "RET" || op == "JUMP_TABLE" || (op == "JUMP" && instr.value("jump_type", "") == "ALWAYS");
+}
+
+// LSL converts integers to floats and strings to keys (and back) when passing arguments,
+// coordinate members can also be built from integers.
+static bool is_implicitly_convertible(const std::string &from, const std::string &to) {
+  if (from == to)
+    return true;
+  if (from == "integer" && to == "float")
+    return true;
+  return (from == "string" && to == "key") || (from == "key" && to == "string");
+}
+
+class IRTypeVerifier {
+  public:
+    IRTypeVerifier(const json &ir, const IRSignatureMap &functions, const IRSignatureMap &builtins, std::string *error)
+      : _mGlobals(ir["globals"]), _mFunctions(functions), _mBuiltins(builtins), _mError(error) {}
+
+    bool verify(json &code, const json &func_like);
+
+  protected:
+    bool verifyOp(const json &instr, IRStackTypes &stack);
+    bool checkSlot(const json &instr, const std::string &type);
+    bool pop(IRStackTypes &stack, const std::string &expected, bool implicit = false);
+    bool popAny(IRStackTypes &stack, std::string *type = nullptr);
+    bool reach(size_t index, const IRStackTypes &stack);
+    bool fail(const std::string &message);
+
+    const json &_mGlobals;
+    const IRSignatureMap &_mFunctions;
+    const IRSignatureMap &_mBuiltins;
+    std::string *_mError;
+
+    json _mLocals;
+    json _mArgs;
+    std::string _mReturn;
+    const json *_mCode = nullptr;
+    std::vector<bool> _mReached;
+    std::vector<IRStackTypes> _mStacks;
+    std::vector<size_t> _mPending;
+    size_t _mCurrentOp = 0;
+};
+
+bool IRTypeVerifier::verify(json &code, const json &func_like) {
+  _mLocals = func_like.value("locals", json::array_t());
+  _mArgs = func_like.value("args", json::array_t());
+  _mReturn = func_like.value("return", "void");
+  _mCode = &code;
+  _mCurrentOp = 0;
+  _mReached.assign(code.size(), false);
+  _mStacks.assign(code.size(), {});
+  _mPending.clear();
+
+  std::map<std::string, size_t> label_indices;
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (is_label(code[i]))
+      label_indices[code[i]["label"].get<std::string>()] = i;
+  }
+
+  if (!code.empty() && !reach(0, {}))
+    return false;
+  while (!_mPending.empty()) {
+    size_t i = _mPending.back();
+    _mPending.pop_back();
+    _mCurrentOp = i;
+    const auto &instr = code[i];
+    auto stack = _mStacks[i];
+    if (!is_label(instr)) {
+      if (!verifyOp(instr, stack))
+        return false;
+      std::vector<std::string> targets;
+      if (instr.contains("label"))
+        targets.push_back(instr["label"].get<std::string>());
+      if (instr["op"] == "JUMP_TABLE") {
+        for (const auto &jump_case : instr["cases"])
+          targets.push_back(jump_case["label"].get<std::string>());
+        targets.push_back(instr["default_label"].get<std::string>());
+      }
+      for (const auto &target : targets) {
+        auto label_iter = label_indices.find(target);
+        if (label_iter == label_indices.end())
+          return fail("jump to unknown label " + target);
+        if (!reach(label_iter->second, stack))
+          return false;
+      }
+      if (is_terminator(instr))
+        continue;
+    }
+    if (!reach(i + 1, stack))
+      return false;
+  }
+
+  for (size_t i = 0; i < code.size(); ++i) {
+    if (_mReached[i] && !is_label(code[i]))
+      code[i]["stack_types"] = _mStacks[i];
+  }
+  return true;
+}
+
+bool IRTypeVerifier::verifyOp(const json &instr, IRStackTypes &stack) {
+  auto op = instr["op"].get<std::string>();
+  auto type = instr.value("type", "");
+  std::string popped;
+  if (op == "PUSH") {
+    if (!checkSlot(instr, type))
+      return false;
+    stack.push_back(type);
+  } else if (op == "PUSH_CONSTANT" || op == "PUSH_EMPTY") {
+    stack.push_back(type);
+  } else if (op == "DUP") {
+    if (!popAny(stack, &popped))
+      return false;
+    stack.push_back(popped);
+    stack.push_back(popped);
+  } else if (op == "STORE") {
+    if (!checkSlot(instr, type) || !pop(stack, type))
+      return false;
+  } else if (op == "STORE_DEFAULT" || op == "STORE_CONSTANT" || op == "INCR_LOCAL" || op == "CMP_LOCAL_CONST_JUMP") {
+    if (!checkSlot(instr, type))
+      return false;
+  } else if (op == "POP_N") {
+    for (auto i = instr["num"].get<uint32_t>(); i > 0; --i) {
+      if (!popAny(stack))
+        return false;
+    }
+  } else if (op == "TAKE_MEMBER") {
+    if (!pop(stack, type))
+      return false;
+    stack.push_back("float");
+  } else if (op == "REPLACE_MEMBER") {
+    // the containing object is on top, the new value for the member is below it
+    if (!pop(stack, type) || !pop(stack, "float", true))
+      return false;
+    stack.push_back(type);
+  } else if (op == "CAST") {
+    if (!pop(stack, instr["from_type"].get<std::string>()))
+      return false;
+    stack.push_back(instr["to_type"].get<std::string>());
+  } else if (op == "BOOL") {
+    if (!pop(stack, type))
+      return false;
+    stack.push_back("integer");
+  } else if (op == "UN_OP") {
+    if (!pop(stack, type))
+      return false;
+    stack.push_back(ir_un_op_result_type(instr["operation"].get<std::string>(), type));
+  } else if (op == "BIN_OP") {
+    // The left hand side is evaluated last, so it's on top
+    auto left_type = instr["left_type"].get<std::string>();
+    auto right_type = instr["right_type"].get<std::string>();
+    if (!pop(stack, left_type) || !pop(stack, right_type))
+      return false;
+    stack.push_back(ir_bin_op_result_type(instr["operation"].get<std::string>(), left_type, right_type));
+  } else if (op == "BUILD_COORD") {
+    for (int i = (type == "vector") ? 3 : 4; i > 0; --i) {
+      if (!pop(stack, "float", true))
+        return false;
+    }
+    stack.push_back(type);
+  } else if (op == "BUILD_LIST") {
+    for (auto i = instr["num_elems"].get<uint32_t>(); i > 0; --i) {
+      if (!popAny(stack, &popped))
+        return false;
+      if (popped == "list")
+        return fail("lists can't contain lists");
+    }
+    stack.push_back("list");
+  } else if (op == "CALL" || op == "CALL_LIB") {
+    auto name = instr["name"].get<std::string>();
+    const auto &signatures = (op == "CALL") ? _mFunctions : _mBuiltins;
+    auto sig_iter = signatures.find(name);
+    if (sig_iter == signatures.end())
+      return fail("no signature for " + name);
+    const auto &sig = sig_iter->second;
+    for (auto arg_iter = sig.args.rbegin(); arg_iter != sig.args.rend(); ++arg_iter) {
+      if (!pop(stack, *arg_iter, true))
+        return false;
+    }
+    if (sig.ret != "void") {
+      // Calls to our own functions return into the slot `PUSH_EMPTY` reserved
+      if (op == "CALL") {
+        if (stack.empty() || stack.back() != sig.ret)
+          return fail("no space reserved for the return value of " + name);
+      } else {
+        stack.push_back(sig.ret);
+      }
+    }
+  } else if (op == "DUMP") {
+    if (!popAny(stack))
+      return false;
+  } else if (op == "JUMP") {
+    if (instr["jump_type"] != "ALWAYS" && !popAny(stack))
+      return false;
+  } else if (op == "JUMP_TABLE") {
+    if (!pop(stack, type))
+      return false;
+  } else if (op != "CHANGE_STATE" && op != "RET") {
+    return fail("unknown op " + op);
+  }
+  return true;
+}
+
+bool IRTypeVerifier::checkSlot(const json &instr, const std::string &type) {
+  auto whence = instr["whence"].get<std::string>();
+  std::string declared;
+  if (whence == "RETURN") {
+    declared = _mReturn;
+  } else {
+    const json *slots = nullptr;
+    if (whence == "GLOBAL")
+      slots = &_mGlobals;
+    else if (whence == "LOCAL")
+      slots = &_mLocals;
+    else if (whence == "ARG")
+      slots = &_mArgs;
+    else
+      return fail("unknown whence " + whence);
+    auto index = instr["index"].get<size_t>();
+    if (index >= slots->size())
+      return fail("no " + whence + " " + std::to_string(index));
+    declared = (*slots)[index].get<std::string>();
+  }
+  if (declared != type)
+    return fail(whence + " " + instr.value("index", json(0)).dump() + " is " + declared + ", not " + type);
+  return true;
+}
+
+bool IRTypeVerifier::pop(IRStackTypes &stack, const std::string &expected, bool implicit) {
+  std::string found;
+  if (!popAny(stack, &found))
+    return false;
+  if (found == expected || (implicit && is_implicitly_convertible(found, expected)))
+    return true;
+  return fail("expected " + expected + ", found " + found);
+}
+
+bool IRTypeVerifier::popAny(IRStackTypes &stack, std::string *type) {
+  if (stack.empty())
+    return fail("stack underflow");
+  if (type)
+    *type = stack.back();
+  stack.pop_back();
+  return true;
+}
+
+bool IRTypeVerifier::reach(size_t index, const IRStackTypes &stack) {
+  if (index >= _mCode->size())
+    return fail("code runs past the end");
+  if (!_mReached[index]) {
+    _mReached[index] = true;
+    _mStacks[index] = stack;
+    _mPending.push_back(index);
+    return true;
+  }
+  if (_mStacks[index] != stack) {
+    auto describe = [](const IRStackTypes &types) { return json(types).dump(); };
+    const auto &instr = (*_mCode)[index];
+    auto where = is_label(instr) ? instr["label"].get<std::string>() : "op " + std::to_string(index);
+    return fail("stack " + describe(stack) + " doesn't match " + describe(_mStacks[index]) + " at " + where);
+  }
+  return true;
+}
+
+bool IRTypeVerifier::fail(const std::string &message) {
+  const auto &instr = (*_mCode)[_mCurrentOp];
+  *_mError = "op " + std::to_string(_mCurrentOp) + " (" + instr.value("op", "label") + "): " + message;
+  return false;
+}
+
+bool verify_ir_types(json &ir, const IRSignatureMap &builtins, std::string *error) {
+  IRSignatureMap functions;
+  for (const auto &func : ir["functions"]) {
+    auto &sig = functions[func["name"].get<std::string>()];
+    sig.ret = func["return"].get<std::string>();
+    for (const auto &arg : func["args"])
+      sig.args.push_back(arg.get<std::string>());
+  }
+
+  IRTypeVerifier verifier(ir, functions, builtins, error);
+  auto verify_func_like = [&](json &func_like) {
+    if (!verifier.verify(func_like["code"], func_like)) {
+      *error = func_like["name"].get<std::string>() + ": " + *error;
+      return false;
+    }
+    return true;
+  };
+
+  if (!verifier.verify(ir["init_code"], json::object())) {
+    *error = "init_code: " + *error;
+    return false;
+  }
+  for (auto &func : ir["functions"]) {
+    if (!verify_func_like(func))
+      return false;
+  }
+  for (auto &state : ir["states"]) {
+    for (auto &handler : state["handlers"]) {
+      if (!verify_func_like(handler))
+        return false;
+    }
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+#include "../extern/json.hh"
+#include "json_ir_pass.hh"
+
+namespace Tailslide {
+
+// Walks every path through the stack IR keeping track of the type of each value on the stack,
+// and checks that:
+//  * ops find operands of the types they say they take
+//  * loads and stores use the declared type of the global, local, arg or return value
+//  * every path into a label arrives with the same stack
+// Each reachable op gets the types on the stack before it runs as `stack_types`, bottom first.
+bool verify_ir_types(nlohmann::json &ir, const IRSignatureMap &builtins, std::string *error);
+
+}
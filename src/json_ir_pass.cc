@@ -1,6 +1,11 @@
 #include <tailslide/visitor.hh>
 #include <tailslide/passes/desugaring.hh>
 #include "json_ir_pass.hh"
+#include "ir_resolve.hh"
+#include "ir_stack_depth.hh"
+#include "ir_verify.hh"
+#include "ast_utils.hh"
+#include "cast_simplification.hh"
 
 namespace Tailslide {
 
@@ -8,9 +13,7 @@ using json = nlohmann::json;
 
 
 bool JSONResourceVisitor::visit(LSLGlobalFunction *glob_func) {
-  auto *sym = glob_func->getSymbol();
-  auto *func_sym_data = getSymbolData(sym);
-  _mCurrentFunc = func_sym_data;
+  startFunc(glob_func);
   // pick up local declarations
   handleFuncDecl(glob_func->getArguments());
   visitChildren(glob_func);
@@ -19,9 +22,7 @@ bool JSONResourceVisitor::visit(LSLGlobalFunction *glob_func) {
 }
 
 bool JSONResourceVisitor::visit(LSLEventHandler *handler) {
-  auto *sym = handler->getSymbol();
-  auto *handler_sym_data = getSymbolData(sym);
-  _mCurrentFunc = handler_sym_data;
+  startFunc(handler);
   // pick up local declarations
   handleFuncDecl(handler->getArguments());
   visitChildren(handler);
@@ -29,6 +30,13 @@ bool JSONResourceVisitor::visit(LSLEventHandler *handler) {
   return false;
 }
 
+void JSONResourceVisitor::startFunc(LSLASTNode *func) {
+  _mCurrentFunc = getSymbolData(func->getSymbol());
+  _mReuseInFunc = _mReuseLocalSlots && !contains_label(func);
+  _mFreeLocalSlots.clear();
+  _mScopeLocalSlots.clear();
+}
+
 void JSONResourceVisitor::handleFuncDecl(LSLASTNode *func_decl) {
   if (!func_decl || !func_decl->hasChildren())
     return;
@@ -40,11 +48,33 @@ void JSONResourceVisitor::handleFuncDecl(LSLASTNode *func_decl) {
   }
 }
 
+bool JSONResourceVisitor::visit(LSLCompoundStatement *compound_stmt) {
+  size_t scope_start = _mScopeLocalSlots.size();
+  visitChildren(compound_stmt);
+  if (_mReuseInFunc) {
+    for (size_t i = scope_start; i < _mScopeLocalSlots.size(); ++i) {
+      auto slot = _mScopeLocalSlots[i];
+      _mFreeLocalSlots[_mCurrentFunc->locals[slot]].push_back(slot);
+    }
+  }
+  _mScopeLocalSlots.resize(scope_start);
+  return false;
+}
+
 bool JSONResourceVisitor::visit(LSLDeclaration *decl_stmt) {
   auto *sym = decl_stmt->getSymbol();
   auto *sym_data = getSymbolData(sym);
-  sym_data->index = (uint32_t)_mCurrentFunc->locals.size();
-  _mCurrentFunc->locals.push_back(sym->getIType());
+  auto &free_slots = _mFreeLocalSlots[sym->getIType()];
+  ++mDeclaredLocals;
+  if (!free_slots.empty()) {
+    sym_data->index = free_slots.back();
+    free_slots.pop_back();
+    ++mReusedLocalSlots;
+  } else {
+    sym_data->index = (uint32_t)_mCurrentFunc->locals.size();
+    _mCurrentFunc->locals.push_back(sym->getIType());
+  }
+  _mScopeLocalSlots.push_back(sym_data->index);
   return true;
 }
 
@@ -63,12 +93,28 @@ JSONSymbolData *JSONResourceVisitor::getSymbolData(LSLSymbol *sym) {
   return &_mSymData->find(sym)->second;
 }
 
+bool BuiltinSignatureVisitor::visit(LSLFunctionExpression *func_expr) {
+  auto *sym = func_expr->getSymbol();
+  if (sym->getSubType() != SYM_BUILTIN || mSignatures.find(sym->getName()) != mSignatures.end())
+    return true;
+  auto &sig = mSignatures[sym->getName()];
+  sig.ret = JSON_TYPE_NAMES[sym->getIType()];
+  // Prefer the declared parameter types, the arguments might have been implicitly converted
+  auto *func_decl = sym->getFunctionDecl();
+  LSLASTNode *params = func_expr->getArguments();
+  if (func_decl && func_decl->getNumChildren() == params->getNumChildren())
+    params = func_decl;
+  for (auto *param : *params)
+    sig.args.push_back(JSON_TYPE_NAMES[param->getIType()]);
+  return true;
+}
+
 
 bool JSONScriptCompiler::visit(LSLScript *script) {
   DeSugaringVisitor de_sugaring_visitor(_mAllocator, true);
   script->visit(&de_sugaring_visitor);
 
-  JSONResourceVisitor resource_visitor(&_mSymData);
+  JSONResourceVisitor resource_visitor(&_mSymData, _mOptions.reuse_local_slots);
   script->visit(&resource_visitor);
 
   auto *globals = script->getGlobals();
@@ -84,22 +130,39 @@ bool JSONScriptCompiler::visit(LSLScript *script) {
 
   // Now build up the code needed to initialize the globals
   _mCode.clear();
+  json::array_t global_data;
   for (auto *global: *globals) {
     if (global->getNodeType() != NODE_GLOBAL_VARIABLE)
       continue;
+    if (_mOptions.data_section) {
+      uint32_t data_index;
+      if (getGlobalData((LSLGlobalVariable *) global, &data_index)) {
+        global_data.push_back(data_index);
+        continue;
+      }
+      // Initializer has to run, the global holds its default value until then
+      global_data.push_back(addDataConstant(JSON_TYPE_NAMES[global->getSymbol()->getIType()], nullptr));
+    }
     global->visit(this);
   }
   // "init_code" is implemented as a function, it needs a ret!
   writeOp({
       {"op", "RET"}
   });
+  finishCode(0, 0);
   mIR["init_code"] = _mCode;
+  if (_mOptions.data_section) {
+    mIR["constants"] = _mDataConstants;
+    mIR["data"] = global_data;
+  }
 
   // then handle functions
   json::array_t global_funcs;
   for (auto *global: *globals) {
     if (global->getNodeType() != NODE_GLOBAL_FUNCTION)
       continue;
+    if (_mOptions.tree_shaker && !_mOptions.tree_shaker->isKept(global->getSymbol()))
+      continue;
     global->visit(this);
     global_funcs.push_back(_mFunction);
   }
@@ -121,6 +184,30 @@ bool JSONScriptCompiler::visit(LSLScript *script) {
   }
   mIR["states"] = states;
 
+  if (_mOptions.peephole)
+    mIR["peephole_stats"] = _mPeepholeStats;
+  if (_mOptions.eliminate_dead_stores)
+    mIR["dataflow_stats"] = _mDataflowStats;
+  if (_mOptions.reuse_local_slots) {
+    mIR["local_slot_stats"] = {
+        {"declared_locals", resource_visitor.mDeclaredLocals},
+        {"reused_slots", resource_visitor.mReusedLocalSlots}
+    };
+  }
+
+  if (_mOptions.stack_depths || _mOptions.verify_types || _mOptions.resolve) {
+    BuiltinSignatureVisitor signature_visitor;
+    script->visit(&signature_visitor);
+    // labels are still around to hang entry depths on
+    std::string error;
+    if (_mOptions.stack_depths && !annotate_ir_stack_depths(mIR, signature_visitor.mSignatures, &error))
+      mErrors.push_back(error);
+    if (_mOptions.verify_types && !verify_ir_types(mIR, signature_visitor.mSignatures, &error))
+      mErrors.push_back(error);
+    if (_mOptions.resolve && !resolve_ir(mIR, signature_visitor.mSignatures, &error))
+      mErrors.push_back(error);
+  }
+
   return false;
 }
 
@@ -129,6 +216,16 @@ void JSONScriptCompiler::writeOp(nlohmann::json::object_t op_data) {
   _mCode.push_back(op_data);
 }
 
+void JSONScriptCompiler::finishCode(size_t num_locals, size_t num_args) {
+  // Dead stores get replaced with pops that the peephole rules can clean up
+  if (_mOptions.eliminate_dead_stores)
+    eliminate_dead_ir_stores(_mCode, num_locals, num_args, &_mDataflowStats);
+  if (_mOptions.peephole)
+    optimize_ir_code(_mCode, *_mOptions.peephole, &_mPeepholeStats);
+  if (_mOptions.superinstructions)
+    fuse_superinstructions(_mCode);
+}
+
 void JSONScriptCompiler::writeJump(const std::string &label, const std::string &jump_type) {
   writeOp({
       {"op", "JUMP"},
@@ -207,11 +304,17 @@ bool JSONScriptCompiler::visit(LSLDeclaration *decl_stmt) {
 
 
 bool JSONScriptCompiler::visit(LSLIfStatement *if_stmt) {
-  auto jump_past_true_label = "LabelTempJump" + std::to_string(_mJumpNum++);
+  SwitchChain chain;
+  if (_mOptions.jump_tables && find_switch_chain(if_stmt, chain)) {
+    writeJumpTable(chain);
+    return false;
+  }
+
+  auto jump_past_true_label = newTempLabel();
   std::string jump_past_false_label;
   auto *false_node = if_stmt->getFalseBranch();
   if (false_node)
-    jump_past_false_label = "LabelTempJump" + std::to_string(_mJumpNum++);
+    jump_past_false_label = newTempLabel();
 
   if_stmt->getCheckExpr()->visit(this);
   writeJump(jump_past_true_label, "NIF");
@@ -227,6 +330,44 @@ bool JSONScriptCompiler::visit(LSLIfStatement *if_stmt) {
   return false;
 }
 
+void JSONScriptCompiler::writeJumpTable(const SwitchChain &chain) {
+  // JUMP_TABLE pops the subject and jumps to the label for the case matching its value,
+  // or to the default label if none match.
+  auto default_label = newTempLabel();
+  auto end_label = newTempLabel();
+  std::vector<std::string> case_labels;
+  json::array_t cases;
+  for (const auto &switch_case : chain.cases) {
+    case_labels.push_back(newTempLabel());
+    json case_value;
+    if (switch_case.value->getIType() == LST_INTEGER)
+      case_value = ((LSLIntegerConstant *) switch_case.value)->getValue();
+    else
+      case_value = ((LSLStringConstant *) switch_case.value)->getValue();
+    cases.push_back({
+        {"value", case_value},
+        {"label", case_labels.back()}
+    });
+  }
+
+  chain.subject->visit(this);
+  writeOp({
+      {"op", "JUMP_TABLE"},
+      {"type", JSON_TYPE_NAMES[chain.subject->getIType()]},
+      {"cases", cases},
+      {"default_label", default_label}
+  });
+  for (size_t i = 0; i < chain.cases.size(); ++i) {
+    writeLabel(case_labels[i]);
+    chain.cases[i].body->visit(this);
+    writeJump(end_label, "ALWAYS");
+  }
+  writeLabel(default_label);
+  if (chain.default_body)
+    chain.default_body->visit(this);
+  writeLabel(end_label);
+}
+
 bool JSONScriptCompiler::visit(LSLForStatement *for_stmt) {
   // execute instructions to initialize vars
   for(auto *init_expr : *for_stmt->getInitExprs()) {
@@ -235,8 +376,8 @@ bool JSONScriptCompiler::visit(LSLForStatement *for_stmt) {
       writePop(1);
     _mPushOmitted = false;
   }
-  auto jump_to_start_label = "LabelTempJump" + std::to_string(_mJumpNum++);
-  auto jump_to_end_label = "LabelTempJump" + std::to_string(_mJumpNum++);
+  auto jump_to_start_label = newTempLabel();
+  auto jump_to_end_label = newTempLabel();
   writeLabel(jump_to_start_label);
   // run the check expression, exiting the loop if it fails
   for_stmt->getCheckExpr()->visit(this);
@@ -257,8 +398,8 @@ bool JSONScriptCompiler::visit(LSLForStatement *for_stmt) {
 }
 
 bool JSONScriptCompiler::visit(LSLWhileStatement* while_stmt) {
-  auto jump_to_start_label = "LabelTempJump" + std::to_string(_mJumpNum++);
-  auto jump_to_end_label = "LabelTempJump" + std::to_string(_mJumpNum++);
+  auto jump_to_start_label = newTempLabel();
+  auto jump_to_end_label = newTempLabel();
   writeLabel(jump_to_start_label);
   // run the check expression, exiting the loop if it fails
   while_stmt->getCheckExpr()->visit(this);
@@ -272,7 +413,7 @@ bool JSONScriptCompiler::visit(LSLWhileStatement* while_stmt) {
 }
 
 bool JSONScriptCompiler::visit(LSLDoStatement* do_stmt) {
-  auto jump_to_start_label = "LabelTempJump" + std::to_string(_mJumpNum++);
+  auto jump_to_start_label = newTempLabel();
   writeLabel(jump_to_start_label);
   // run the body of the loop
   do_stmt->getBody()->visit(this);
@@ -321,18 +462,37 @@ bool JSONScriptCompiler::visit(LSLReturnStatement *ret_stmt) {
   return false;
 }
 
+std::string JSONScriptCompiler::newTempLabel() {
+  // Scripts can call their labels this too, skip any that are already taken.
+  std::string name;
+  do {
+    name = "LabelTempJump" + std::to_string(_mJumpNum++);
+  } while (_mUsedLabelNames.find(name) != _mUsedLabelNames.end());
+  _mUsedLabelNames.insert(name);
+  return name;
+}
+
+const std::string &JSONScriptCompiler::getLabelName(LSLSymbol *label_sym) {
+  auto name_iter = _mLabelNames.find(label_sym);
+  if (name_iter != _mLabelNames.end())
+    return name_iter->second;
+  // Labels in different scopes can share a name, and one of ours might already have it.
+  // Only the first gets to keep it, and the suffixed name might be taken as well.
+  std::string name = label_sym->getName();
+  while (_mUsedLabelNames.find(name) != _mUsedLabelNames.end())
+    name = label_sym->getName() + "_" + std::to_string(_mJumpNum++);
+  _mUsedLabelNames.insert(name);
+  return _mLabelNames[label_sym] = name;
+}
+
 bool JSONScriptCompiler::visit(LSLLabel *label_stmt) {
-  // TODO: right now this roughly matches LL's behavior, but label names
-  //  should be mangled to prevent collisions.
-  writeLabel(label_stmt->getSymbol()->getName());
+  writeLabel(getLabelName(label_stmt->getSymbol()));
   return false;
 }
 
 bool JSONScriptCompiler::visit(LSLJumpStatement *jump_stmt) {
-  // TODO: right now this roughly matches LL's behavior, but label names
-  //  should be mangled to prevent collisions.
   // note that labels are scoped to a specific function in our IR
-  writeJump(jump_stmt->getSymbol()->getName(), "ALWAYS");
+  writeJump(getLabelName(jump_stmt->getSymbol()), "ALWAYS");
   return false;
 }
 
@@ -377,36 +537,23 @@ static json float_to_json(float f_val) {
   return json::number_float_t{f_val};
 }
 
-void JSONScriptCompiler::pushConstant(LSLConstant *cv) {
-  if (!cv)
-    return;
-
-  json::object_t obj {
-      {"op", "PUSH_CONSTANT"},
-      {"type", JSON_TYPE_NAMES[cv->getIType()]}
-  };
+static json constant_to_json(LSLConstant *cv) {
   switch(cv->getIType()) {
     case LST_INTEGER:
-      obj["value"] = ((LSLIntegerConstant *) cv)->getValue();
-      break;
-    case LST_FLOATINGPOINT: {
-      obj["value"] = float_to_json(((LSLFloatConstant *) cv)->getValue());
-      break;
-    }
+      return ((LSLIntegerConstant *) cv)->getValue();
+    case LST_FLOATINGPOINT:
+      return float_to_json(((LSLFloatConstant *) cv)->getValue());
     case LST_STRING:
-      obj["value"] = ((LSLStringConstant *) cv)->getValue();
-      break;
+      return ((LSLStringConstant *) cv)->getValue();
     case LST_KEY:
-      obj["value"] = ((LSLKeyConstant *) cv)->getValue();
-      break;
+      return ((LSLKeyConstant *) cv)->getValue();
     case LST_VECTOR: {
       json::array_t coord_array;
       auto *vec_val = ((LSLVectorConstant *) cv)->getValue();
       coord_array.push_back(float_to_json(vec_val->x));
       coord_array.push_back(float_to_json(vec_val->y));
       coord_array.push_back(float_to_json(vec_val->z));
-      obj["value"] = coord_array;
-      break;
+      return coord_array;
     }
     case LST_QUATERNION: {
       json::array_t coord_array;
@@ -415,21 +562,96 @@ void JSONScriptCompiler::pushConstant(LSLConstant *cv) {
       coord_array.push_back(float_to_json(vec_val->y));
       coord_array.push_back(float_to_json(vec_val->z));
       coord_array.push_back(float_to_json(vec_val->s));
-      obj["value"] = coord_array;
-      break;
+      return coord_array;
     }
     case LST_LIST: {
       // only know how to write the default empty list as a constant
       auto *list_val = (LSLListConstant *) cv;
       assert(!list_val->getLength());
-      obj["value"] = json::array();
-      break;
+      return json::array();
     }
     default:
       assert(0);
+      return nullptr;
   }
+}
+
+void JSONScriptCompiler::pushConstant(LSLConstant *cv) {
+  if (!cv)
+    return;
+
+  writeOp({
+      {"op", "PUSH_CONSTANT"},
+      {"type", JSON_TYPE_NAMES[cv->getIType()]},
+      {"value", constant_to_json(cv)}
+  });
+}
 
-  writeOp(obj);
+static json default_value_json(const std::string &type) {
+  if (type == "integer")
+    return 0;
+  if (type == "float")
+    return 0.0;
+  if (type == "string" || type == "key")
+    return "";
+  if (type == "vector")
+    return {0.0, 0.0, 0.0};
+  if (type == "rotation")
+    return {0.0, 0.0, 0.0, 1.0};
+  return json::array();
+}
+
+// Finds the constant a global starts out with, false if its initializer has to be run as code
+bool JSONScriptCompiler::getGlobalData(LSLGlobalVariable *glob_var, uint32_t *index) {
+  auto *sym = glob_var->getSymbol();
+  auto *initializer = glob_var->getInitializer();
+  if (!initializer) {
+    *index = addDataConstant(JSON_TYPE_NAMES[sym->getIType()], nullptr);
+    return true;
+  }
+  auto *cv = initializer->getConstantValue();
+  if (!cv || has_side_effects(initializer))
+    return false;
+  if (cv->getIType() == sym->getIType()) {
+    *index = addDataConstant(cv);
+    return true;
+  }
+  // the same implicit conversions the store would have gotten
+  if (sym->getIType() == LST_FLOATINGPOINT && cv->getIType() == LST_INTEGER) {
+    *index = addDataConstant("float", float_to_json((float) ((LSLIntegerConstant *) cv)->getValue()));
+    return true;
+  }
+  if (sym->getIType() == LST_KEY && cv->getIType() == LST_STRING) {
+    *index = addDataConstant("key", ((LSLStringConstant *) cv)->getValue());
+    return true;
+  }
+  return false;
+}
+
+uint32_t JSONScriptCompiler::addDataConstant(LSLConstant *cv) {
+  if (cv->getIType() != LST_LIST)
+    return addDataConstant(JSON_TYPE_NAMES[cv->getIType()], constant_to_json(cv));
+  // List elements are constants of their own, a list's value is their indices
+  json::array_t elems;
+  for (auto *elem : *cv)
+    elems.push_back(addDataConstant((LSLConstant *) elem));
+  return addDataConstant("list", elems);
+}
+
+// A null `value` means the type's default value
+uint32_t JSONScriptCompiler::addDataConstant(const std::string &type, const json &value) {
+  json constant = {
+      {"type", type},
+      {"value", value.is_null() ? default_value_json(type) : value}
+  };
+  auto key = constant.dump();
+  auto index_iter = _mDataConstantIndices.find(key);
+  if (index_iter != _mDataConstantIndices.end())
+    return index_iter->second;
+  auto index = (uint32_t) _mDataConstants.size();
+  _mDataConstants.push_back(std::move(constant));
+  _mDataConstantIndices[key] = index;
+  return index;
 }
 
 void JSONScriptCompiler::storeToLValue(LSLLValueExpression *lvalue, bool push_result) {
@@ -502,10 +724,17 @@ void JSONScriptCompiler::buildFunction(LSLASTNode *func) {
   _mFunction["locals"] = locals;
 
   _mCode.clear();
+  _mLabelNames.clear();
+  _mUsedLabelNames.clear();
   visitChildren(func);
   if (!func_sym->getAllPathsReturn())
     writeOp({{"op", "RET"}});
+  finishCode(locals.size(), args.size());
   _mFunction["code"] = _mCode;
+  if (_mOptions.cfg_format == IR_CFG_JSON)
+    _mFunction["cfg"] = IRControlFlowGraph(_mCode).toJSON();
+  else if (_mOptions.cfg_format == IR_CFG_DOT)
+    _mFunction["cfg"] = IRControlFlowGraph(_mCode).toDOT(func_sym->getName(), _mCode);
 }
 
 bool JSONScriptCompiler::visit(LSLConstantExpression *constant_expr) {
@@ -514,14 +743,16 @@ bool JSONScriptCompiler::visit(LSLConstantExpression *constant_expr) {
 }
 
 bool JSONScriptCompiler::visit(LSLTypecastExpression *cast_expr) {
-  cast_expr->getChildExpr()->visit(this);
+  // skip over any casts in between that can't change the result
+  auto *source_expr = get_cast_source(cast_expr);
+  source_expr->visit(this);
   // this is a no-op cast, don't emit anything.
-  if (cast_expr->getIType() == cast_expr->getChildExpr()->getIType())
+  if (cast_expr->getIType() == source_expr->getIType())
     return false;
 
   writeOp({
       {"op", "CAST"},
-      {"from_type", JSON_TYPE_NAMES[cast_expr->getChildExpr()->getIType()]},
+      {"from_type", JSON_TYPE_NAMES[source_expr->getIType()]},
       {"to_type", JSON_TYPE_NAMES[cast_expr->getIType()]}
   });
   return false;
@@ -594,6 +825,8 @@ bool JSONScriptCompiler::visit(LSLFunctionExpression *func_expr) {
         {"name", func_sym->getName()}
     });
   } else {
+    if (_mOptions.tree_shaker)
+      func_sym = _mOptions.tree_shaker->resolve(func_sym);
     writeOp({
         {"op", "CALL"},
         {"name", func_sym->getName()}
@@ -672,14 +905,21 @@ bool JSONScriptCompiler::visit(LSLBinaryExpression *bin_expr) {
     return false;
   }
 
-  right->visit(this);
-  left->visit(this);
-  writeOp({
-      {"op", "BIN_OP"},
-      {"left_type", JSON_TYPE_NAMES[left->getIType()]},
-      {"right_type", JSON_TYPE_NAMES[right->getIType()]},
-      {"operation", operation_to_json_operation(bin_expr->getOperation())}
-  });
+  // Generated scripts can have chains like `a + b + c + ...` with thousands of operands.
+  // Walk down their left side in a loop rather than recursing once per operand.
+  auto chain = collect_left_chain(bin_expr);
+  for (auto *link : chain)
+    link->getRHS()->visit(this);
+  chain.back()->getLHS()->visit(this);
+  for (auto link_iter = chain.rbegin(); link_iter != chain.rend(); ++link_iter) {
+    auto *link = *link_iter;
+    writeOp({
+        {"op", "BIN_OP"},
+        {"left_type", JSON_TYPE_NAMES[link->getLHS()->getIType()]},
+        {"right_type", JSON_TYPE_NAMES[link->getRHS()->getIType()]},
+        {"operation", operation_to_json_operation(link->getOperation())}
+    });
+  }
 
   return false;
 }
@@ -752,6 +992,39 @@ bool JSONScriptCompiler::visit(LSLUnaryExpression *unary_expr) {
   return false;
 }
 
+std::string ir_bin_op_result_type(const std::string &operation, const std::string &left_type, const std::string &right_type) {
+  if (operation == "LESS" || operation == "GREATER" || operation == "LEQ" || operation == "GEQ"
+      || operation == "EQ" || operation == "NEQ" || operation == "BOOLEAN_AND" || operation == "BOOLEAN_OR"
+      || operation == "BIT_AND" || operation == "BIT_OR" || operation == "BIT_XOR"
+      || operation == "SHIFT_LEFT" || operation == "SHIFT_RIGHT")
+    return "integer";
+  if (left_type == "list" || right_type == "list")
+    return "list";
+  bool left_numeric = left_type == "integer" || left_type == "float";
+  bool right_numeric = right_type == "integer" || right_type == "float";
+  if (left_numeric && right_numeric)
+    return (left_type == "float" || right_type == "float") ? "float" : "integer";
+  // only `+` is allowed on these
+  if (left_type == "string" || left_type == "key")
+    return "string";
+  if (left_type == "vector") {
+    // `vector * vector` is the dot product, `%` is the cross product
+    if (right_type == "vector" && operation == "MUL")
+      return "float";
+    return "vector";
+  }
+  // scaling a vector by a number
+  if (right_type == "vector")
+    return "vector";
+  return "rotation";
+}
+
+std::string ir_un_op_result_type(const std::string &operation, const std::string &type) {
+  if (operation == "MINUS")
+    return type;
+  return "integer";
+}
+
 bool JSONScriptCompiler::visit(LSLPrintExpression *print_expr) {
   print_expr->getChildExpr()->visit(this);
   writeOp({{"op", "DUMP"}});
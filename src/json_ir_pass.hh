@@ -1,9 +1,17 @@
 #pragma once
 
+#include <map>
+#include <set>
+#include <string>
 #include <vector>
 
 #include <tailslide/tailslide.hh>
 #include "../extern/json.hh"
+#include "ir_cfg.hh"
+#include "ir_peephole.hh"
+#include "ir_superinstructions.hh"
+#include "switch_detection.hh"
+#include "tree_shaking.hh"
 
 namespace Tailslide {
 
@@ -21,28 +29,87 @@ typedef std::map<Tailslide::LSLSymbol *, JSONSymbolData> JSONSymbolDataMap;
 
 // Walks the script, figuring out how much space to reserve for data slots
 // and what order to place them in.
+//
+// With `reuse_local_slots`, a local's slot goes back to a pool once the block that declared it ends,
+// and later locals of the same type take from it. Every declaration stores to its local, so a reused
+// slot never leaks an old value. Functions with labels don't reuse slots, a jump could skip
+// the declaration that would have initialized the local.
 class JSONResourceVisitor : public ASTVisitor {
   public:
-  explicit JSONResourceVisitor(JSONSymbolDataMap *sym_data) : _mSymData(sym_data) {}
+  explicit JSONResourceVisitor(JSONSymbolDataMap *sym_data, bool reuse_local_slots=false)
+    : _mSymData(sym_data), _mReuseLocalSlots(reuse_local_slots) {}
+
+  // how many locals were declared, and how many of them got a slot some other local used before
+  uint32_t mDeclaredLocals = 0;
+  uint32_t mReusedLocalSlots = 0;
 
   protected:
   bool visit(Tailslide::LSLGlobalFunction *glob_func) override;
   bool visit(Tailslide::LSLEventHandler *handler) override;
+  bool visit(Tailslide::LSLCompoundStatement *compound_stmt) override;
   bool visit(Tailslide::LSLDeclaration *decl_stmt) override;
   bool visit(Tailslide::LSLGlobalVariable *global_var) override;
   // not relevant
   bool visit(Tailslide::LSLExpression *expr) override { return false; };
   void handleFuncDecl(LSLASTNode *func_decl);
+  void startFunc(LSLASTNode *func);
 
   JSONSymbolData *getSymbolData(Tailslide::LSLSymbol *sym);
 
   JSONSymbolData *_mCurrentFunc = nullptr;
   JSONSymbolDataMap *_mSymData = nullptr;
   uint32_t _mGlobals = 0;
+  bool _mReuseLocalSlots = false;
+  bool _mReuseInFunc = false;
+  // slots of locals whose blocks have ended, by type
+  std::map<LSLIType, std::vector<uint32_t>> _mFreeLocalSlots;
+  // slots of locals declared in the blocks we're currently inside
+  std::vector<uint32_t> _mScopeLocalSlots;
+};
+
+struct IRFunctionSignature {
+  std::string ret;
+  std::vector<std::string> args;
+};
+
+// function name -> its return and argument types, using the IR's type names
+typedef std::map<std::string, IRFunctionSignature> IRSignatureMap;
+
+// Finds the signature of every builtin function the script calls,
+// the stack IR doesn't say how many arguments a `CALL_LIB` takes.
+class BuiltinSignatureVisitor : public ASTVisitor {
+  public:
+    IRSignatureMap mSignatures;
+
+  protected:
+    bool visit(LSLFunctionExpression *func_expr) override;
 };
 
 struct JSONCompilationOptions {
   bool omit_unnecessary_pushes = false;
+  // Emit `JUMP_TABLE` ops for long `if` chains comparing a variable against constants
+  bool jump_tables = false;
+  // Leave out functions that can't be called and call a single copy of identical functions
+  const TreeShaker *tree_shaker = nullptr;
+  // Clean up each function's code with these rules before it's written out
+  const IRPeepholeOptions *peephole = nullptr;
+  // Remove unreachable blocks and stores to locals and args that are never read
+  bool eliminate_dead_stores = false;
+  // Fuse common runs of ops into single ops like `INCR_LOCAL`, done after everything else
+  bool superinstructions = false;
+  // Include each function's control flow graph alongside its code
+  IRCFGFormat cfg_format = IR_CFG_NONE;
+  // Refer to jump targets, functions, builtins and states by index rather than by name
+  bool resolve = false;
+  // Let locals in blocks that are never live at the same time share slots
+  bool reuse_local_slots = false;
+  // Annotate ops with their stack effects, labels with the stack depth on entry and functions with `max_stack`
+  bool stack_depths = false;
+  // Check the types of everything on the stack and annotate ops with them as `stack_types`
+  bool verify_types = false;
+  // Give every global its initial value in a data section of shared constants,
+  // only initializers that aren't constant are left to `init_code`
+  bool data_section = false;
 };
 
 class JSONScriptCompiler : public ASTVisitor {
@@ -51,6 +118,8 @@ class JSONScriptCompiler : public ASTVisitor {
         _mAllocator(allocator), _mOptions(options) {};
 
     nlohmann::json mIR;
+    // only set if the IR we generated turned out to be malformed
+    std::vector<std::string> mErrors;
   protected:
     virtual bool visit(LSLScript *script);
     virtual bool visit(LSLGlobalVariable *glob_var);
@@ -59,8 +128,14 @@ class JSONScriptCompiler : public ASTVisitor {
     void writeLabel(const std::string &label);
     void writeJump(const std::string &label, const std::string &jump_type);
     void writePop(uint32_t num_pops);
+    std::string newTempLabel();
+    const std::string &getLabelName(LSLSymbol *label_sym);
+    void finishCode(size_t num_locals, size_t num_args);
     void pushLValue(LSLLValueExpression *lvalue);
     void pushConstant(LSLConstant *cv);
+    bool getGlobalData(LSLGlobalVariable *glob_var, uint32_t *index);
+    uint32_t addDataConstant(LSLConstant *cv);
+    uint32_t addDataConstant(const std::string &type, const nlohmann::json &value);
     void storeToLValue(LSLLValueExpression *lvalue, bool push_result);
 
     virtual bool visit(LSLEventHandler *handler);
@@ -73,6 +148,7 @@ class JSONScriptCompiler : public ASTVisitor {
     virtual bool visit(LSLJumpStatement *jump_stmt);
     virtual bool visit(LSLDeclaration *decl_stmt);
     virtual bool visit(LSLIfStatement *if_stmt);
+    void writeJumpTable(const SwitchChain &chain);
     virtual bool visit(LSLForStatement *for_stmt);
     virtual bool visit(LSLWhileStatement *while_stmt);
     virtual bool visit(LSLDoStatement *do_stmt);
@@ -104,6 +180,15 @@ class JSONScriptCompiler : public ASTVisitor {
     JSONCompilationOptions _mOptions {};
     bool _mPushOmitted = false;
     uint32_t _mJumpNum = 0;
+    // names given to the current function's labels
+    std::map<LSLSymbol *, std::string> _mLabelNames;
+    // every label name taken in the current function, ours included
+    std::set<std::string> _mUsedLabelNames;
+    IRPeepholeStats _mPeepholeStats {};
+    IRDataflowStats _mDataflowStats {};
+    // the data section's constants, and where each one is by type and value
+    nlohmann::json::array_t _mDataConstants;
+    std::map<std::string, uint32_t> _mDataConstantIndices;
 
     nlohmann::json::object_t _mFunction;
     nlohmann::json::array_t _mCode;
@@ -121,4 +206,8 @@ const char * const JSON_TYPE_NAMES[LST_MAX] = {
     "ERROR"
 };
 
+// The type a `BIN_OP` or `UN_OP` leaves on the stack, given the IR names of its operand types
+std::string ir_bin_op_result_type(const std::string &operation, const std::string &left_type, const std::string &right_type);
+std::string ir_un_op_result_type(const std::string &operation, const std::string &type);
+
 }
@@ -0,0 +1,810 @@
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <tailslide/visitor.hh>
+
+#include "lsl_pass.hh"
+
+namespace Tailslide {
+
+// Names nothing declared by the script can be given
+static const std::set<std::string> LSL_RESERVED_NAMES {
+  "default", "state", "event", "jump", "return", "if", "else", "for", "do", "while", "print",
+  "integer", "float", "string", "key", "vector", "rotation", "quaternion", "list",
+};
+
+// Pairs of characters that would lex as a single token if written next to each other
+static const std::set<std::string> JOINABLE_TOKENS {
+  "++", "--", "+=", "-=", "*=", "/=", "%=", "==", "!=", "<=", ">=", "<<", ">>", "&&", "||", "//", "/*",
+};
+
+static bool is_reserved_name(const std::string &name) {
+  // library functions all start with `ll`, and library constants are all uppercase.
+  return LSL_RESERVED_NAMES.count(name) || name.rfind("ll", 0) == 0;
+}
+
+// `a`, `b`, ..., `z`, `aa`, `ab`, ...
+static std::string make_short_name(size_t idx) {
+  std::string name;
+  for (++idx; idx; idx /= 26) {
+    --idx;
+    name.insert(name.begin(), (char)('a' + idx % 26));
+  }
+  return name;
+}
+
+static bool is_word_char(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+static std::string format_float(float f_val, bool in_coord) {
+  // no literals for these, but the casts get folded the same way.
+  if (std::isnan(f_val))
+    return "(float)\"nan\"";
+  if (std::isinf(f_val))
+    return f_val > 0 ? "(float)\"inf\"" : "(float)\"-inf\"";
+
+  // shortest form that still reads back as the same float
+  char buf[32];
+  for (int precision = 1; precision <= 9; ++precision) {
+    snprintf(buf, sizeof(buf), "%.*g", precision, f_val);
+    if (strtof(buf, nullptr) == f_val)
+      break;
+  }
+  std::string s_val {buf};
+
+  // `1e+07` -> `1e7`, `1.5e-05` -> `1.5e-5`
+  auto exp_pos = s_val.find('e');
+  if (exp_pos != std::string::npos) {
+    std::string exponent = s_val.substr(exp_pos + 1);
+    bool negative_exp = exponent[0] == '-';
+    exponent = exponent.substr(exponent.find_first_not_of("+-0"));
+    s_val = s_val.substr(0, exp_pos) + (negative_exp ? "e-" : "e") + exponent;
+  }
+  // `0.5` -> `.5`
+  if (s_val.rfind("0.", 0) == 0)
+    s_val.erase(0, 1);
+  else if (s_val.rfind("-0.", 0) == 0)
+    s_val.erase(1, 1);
+  // Needs to look like a float unless it'll be promoted to one anyway
+  if (!in_coord && s_val.find_first_of(".e") == std::string::npos)
+    s_val += '.';
+  return s_val;
+}
+
+static std::string format_int(int32_t i_val) {
+  // `-2147483648` would be read as negating an out-of-range literal
+  if (i_val == INT32_MIN)
+    return "0x80000000";
+  return std::to_string(i_val);
+}
+
+static bool is_negative_constant(LSLConstant *cv) {
+  switch (cv->getIType()) {
+    case LST_INTEGER:
+      return ((LSLIntegerConstant *) cv)->getValue() < 0;
+    case LST_FLOATINGPOINT:
+      return std::signbit(((LSLFloatConstant *) cv)->getValue());
+    default:
+      return false;
+  }
+}
+
+static const char *operation_to_lsl_operation(LSLOperator op) {
+  switch (op) {
+    case '=':            return "=";
+    case '+':            return "+";
+    case '-':            return "-";
+    case '*':            return "*";
+    case '/':            return "/";
+    case '%':            return "%";
+    case OP_ADD_ASSIGN:  return "+=";
+    case OP_SUB_ASSIGN:  return "-=";
+    case OP_MUL_ASSIGN:  return "*=";
+    case OP_DIV_ASSIGN:  return "/=";
+    case OP_MOD_ASSIGN:  return "%=";
+    case OP_BOOLEAN_NOT: return "!";
+    case OP_BOOLEAN_AND: return "&&";
+    case OP_BOOLEAN_OR:  return "||";
+    case OP_LESS:        return "<";
+    case OP_GREATER:     return ">";
+    case OP_LEQ:         return "<=";
+    case OP_GEQ:         return ">=";
+    case OP_EQ:          return "==";
+    case OP_NEQ:         return "!=";
+    case OP_BIT_NOT:     return "~";
+    case OP_BIT_XOR:     return "^";
+    case OP_BIT_AND:     return "&";
+    case OP_BIT_OR:      return "|";
+    case OP_SHIFT_LEFT:  return "<<";
+    case OP_SHIFT_RIGHT: return ">>";
+    case OP_PRE_INCR:
+    case OP_POST_INCR:   return "++";
+    case OP_PRE_DECR:
+    case OP_POST_DECR:   return "--";
+    default:
+      assert(0);
+      return "<ERROR>";
+  }
+}
+
+// Collects everything declared within a function body that can be renamed
+class LocalSymbolVisitor : public ASTVisitor {
+  public:
+    std::vector<LSLSymbol *> mSymbols;
+
+  protected:
+    bool visit(LSLDeclaration *decl_stmt) override {
+      mSymbols.push_back(decl_stmt->getSymbol());
+      return false;
+    }
+    bool visit(LSLLabel *label_stmt) override {
+      mSymbols.push_back(label_stmt->getSymbol());
+      return false;
+    }
+    bool visit(LSLExpression *expr) override { return false; }
+};
+
+// `print()` doesn't change any state, but it does have to stay.
+class EffectFindingVisitor : public AssignmentFindingVisitor {
+  protected:
+    bool visit(LSLPrintExpression *print_expr) override {
+      mFound = true;
+      return false;
+    }
+};
+
+static bool has_effects(LSLASTNode *node) {
+  EffectFindingVisitor effect_visitor;
+  node->visit(&effect_visitor);
+  return effect_visitor.mFound;
+}
+
+
+void LSLMinifyingVisitor::writeToken(const std::string &token) {
+  if (token.empty())
+    return;
+  // keep tokens from running together, `a - -1` can't be `a--1`.
+  char first = token.front();
+  if ((is_word_char(_mLastChar) && is_word_char(first))
+      || JOINABLE_TOKENS.count(std::string {_mLastChar, first}))
+    mStr << ' ';
+  mStr << token;
+  _mLastChar = token.back();
+}
+
+void LSLMinifyingVisitor::writeNewline() {
+  mStr << '\n';
+  _mLastChar = '\n';
+}
+
+std::string LSLMinifyingVisitor::getSymbolName(LSLSymbol *sym) {
+  auto name_iter = _mShortNames.find(sym);
+  if (name_iter != _mShortNames.end())
+    return name_iter->second;
+  return sym->getName();
+}
+
+void LSLMinifyingVisitor::assignShortNames(LSLScript *script) {
+  std::set<std::string> state_names;
+  for (auto *state : *script->getStates())
+    state_names.insert(state->getSymbol()->getName());
+
+  size_t name_idx = 0;
+  auto next_name = [&]() {
+    std::string name;
+    do {
+      name = make_short_name(name_idx++);
+    } while (is_reserved_name(name) || state_names.count(name));
+    return name;
+  };
+
+  for (auto *glob : *script->getGlobals()) {
+    auto *sym = glob->getSymbol();
+    if (glob->getNodeType() == NODE_GLOBAL_VARIABLE ? isDeadVar(sym) : !isFuncKept(sym))
+      continue;
+    _mShortNames[sym] = next_name();
+  }
+
+  // Locals get names nothing global is using so they can't shadow anything,
+  // but each function can start over from the first of those.
+  size_t first_local_idx = name_idx;
+  auto name_locals = [&](LSLASTNode *func_like, LSLASTNode *params) {
+    name_idx = first_local_idx;
+    for (auto *param : *params)
+      _mShortNames[param->getSymbol()] = next_name();
+    LocalSymbolVisitor local_visitor;
+    func_like->visit(&local_visitor);
+    for (auto *sym : local_visitor.mSymbols)
+      _mShortNames[sym] = next_name();
+  };
+  for (auto *glob : *script->getGlobals()) {
+    if (glob->getNodeType() == NODE_GLOBAL_FUNCTION && isFuncKept(glob->getSymbol()))
+      name_locals(glob, ((LSLGlobalFunction *) glob)->getArguments());
+  }
+  for (auto *state : *script->getStates()) {
+    for (auto *handler : *((LSLState *) state)->getEventHandlers())
+      name_locals(handler, ((LSLEventHandler *) handler)->getArguments());
+  }
+}
+
+bool LSLMinifyingVisitor::isDeadVar(LSLSymbol *sym) {
+  if (!_mOptions.remove_dead_code)
+    return false;
+  switch (sym->getSubType()) {
+    case SYM_LOCAL:
+      return _mVarUsage.mRead.find(sym) == _mVarUsage.mRead.end();
+    case SYM_GLOBAL:
+      return _mVarUsage.mReferenced.find(sym) == _mVarUsage.mReferenced.end();
+    default:
+      return false;
+  }
+}
+
+bool LSLMinifyingVisitor::isFuncKept(LSLSymbol *func_sym) {
+  return !_mOptions.tree_shaker || _mOptions.tree_shaker->isKept(func_sym);
+}
+
+LSLSymbol *LSLMinifyingVisitor::resolveFunc(LSLSymbol *func_sym) {
+  if (!_mOptions.tree_shaker)
+    return func_sym;
+  return _mOptions.tree_shaker->resolve(func_sym);
+}
+
+bool LSLMinifyingVisitor::isDeadStore(LSLBinaryExpression *bin_expr) {
+  if (bin_expr->getOperation() != '=')
+    return false;
+  auto *sym = bin_expr->getLHS()->getSymbol();
+  return sym->getSubType() == SYM_LOCAL && isDeadVar(sym);
+}
+
+bool LSLMinifyingVisitor::isDefaultInitializer(LSLSymbol *sym, LSLExpression *initializer) {
+  // `integer i = 0;` means the same thing as `integer i;`, for globals and locals alike.
+  if (!_mOptions.fold_constants || has_effects(initializer))
+    return false;
+  auto *const_val = initializer->getConstantValue();
+  if (!const_val || const_val->getIType() != sym->getIType())
+    return false;
+  switch (const_val->getIType()) {
+    case LST_INTEGER:
+      return ((LSLIntegerConstant *) const_val)->getValue() == 0;
+    case LST_FLOATINGPOINT: {
+      float f_val = ((LSLFloatConstant *) const_val)->getValue();
+      return f_val == 0.0f && !std::signbit(f_val);
+    }
+    case LST_STRING:
+      return !*((LSLStringConstant *) const_val)->getValue();
+    default:
+      return false;
+  }
+}
+
+bool LSLMinifyingVisitor::declaresLocals(LSLASTNode *stmt) {
+  if (stmt->getNodeSubType() != NODE_COMPOUND_STATEMENT)
+    return false;
+  for (auto *child : *stmt) {
+    if (child->getNodeSubType() == NODE_DECLARATION)
+      return true;
+  }
+  return false;
+}
+
+bool LSLMinifyingVisitor::getConstantTruth(LSLExpression *expr, bool *truth) {
+  auto *const_val = expr->getConstantValue();
+  if (!const_val || const_val->getIType() != LST_INTEGER || has_effects(expr))
+    return false;
+  *truth = ((LSLIntegerConstant *) const_val)->getValue() != 0;
+  return true;
+}
+
+bool LSLMinifyingVisitor::visit(LSLScript *script) {
+  if (_mOptions.remove_dead_code)
+    script->visit(&_mVarUsage);
+  if (_mOptions.shorten_identifiers)
+    assignShortNames(script);
+
+  for (auto *glob : *script->getGlobals()) {
+    auto *sym = glob->getSymbol();
+    if (glob->getNodeType() == NODE_GLOBAL_VARIABLE ? isDeadVar(sym) : !isFuncKept(sym))
+      continue;
+    glob->visit(this);
+    writeNewline();
+  }
+  for (auto *state : *script->getStates()) {
+    writeState((LSLState *) state);
+    writeNewline();
+  }
+  return false;
+}
+
+void LSLMinifyingVisitor::writeState(LSLState *state) {
+  std::string state_name {state->getSymbol()->getName()};
+  if (state_name != "default")
+    writeToken("state");
+  writeToken(state_name);
+  writeToken("{");
+  for (auto *handler : *state->getEventHandlers())
+    handler->visit(this);
+  writeToken("}");
+}
+
+bool LSLMinifyingVisitor::visit(LSLGlobalVariable *glob_var) {
+  auto *sym = glob_var->getSymbol();
+  writeToken(LSL_TYPE_NAMES[sym->getIType()]);
+  writeToken(getSymbolName(sym));
+  auto *initializer = (LSLExpression *) glob_var->getInitializer();
+  if (initializer && !isDefaultInitializer(sym, initializer)) {
+    writeToken("=");
+    initializer->visit(this);
+  }
+  writeToken(";");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLGlobalFunction *glob_func) {
+  auto *func_sym = glob_func->getSymbol();
+  writeToken(LSL_TYPE_NAMES[func_sym->getIType()]);
+  writeToken(getSymbolName(func_sym));
+  writeParams(glob_func->getArguments());
+  glob_func->getStatements()->visit(this);
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLEventHandler *event_handler) {
+  writeToken(event_handler->getIdentifier()->getName());
+  writeParams(event_handler->getArguments());
+  event_handler->getStatements()->visit(this);
+  return false;
+}
+
+void LSLMinifyingVisitor::writeParams(LSLASTNode *params) {
+  writeToken("(");
+  for (auto *param : *params) {
+    auto *param_sym = param->getSymbol();
+    writeToken(LSL_TYPE_NAMES[param_sym->getIType()]);
+    writeToken(getSymbolName(param_sym));
+    if (param->getNext())
+      writeToken(",");
+  }
+  writeToken(")");
+}
+
+
+bool LSLMinifyingVisitor::visit(LSLCompoundStatement *compound_stmt) {
+  writeToken("{");
+  writeBlockContents(compound_stmt);
+  writeToken("}");
+  return false;
+}
+
+void LSLMinifyingVisitor::writeBlockContents(LSLASTNode *compound_stmt) {
+  bool reachable = true;
+  for (auto *stmt : *compound_stmt) {
+    // Nothing can get past a `return` or `jump` except by jumping to a label after it.
+    // Declarations stay so anything after such a label can still refer to them.
+    if (!reachable) {
+      if (contains_label(stmt))
+        reachable = true;
+      else if (stmt->getNodeSubType() != NODE_DECLARATION)
+        continue;
+    }
+    stmt->visit(this);
+    auto stmt_type = stmt->getNodeSubType();
+    if (_mOptions.remove_dead_code && (stmt_type == NODE_RETURN_STATEMENT || stmt_type == NODE_JUMP_STATEMENT))
+      reachable = false;
+  }
+}
+
+void LSLMinifyingVisitor::writeSubStatement(LSLASTNode *stmt) {
+  // `{x;}` can just be `x;`, but anything that might end in an `if` keeps its
+  // braces so a following `else` can't get attached to the wrong `if`.
+  if (stmt->getNodeSubType() == NODE_COMPOUND_STATEMENT) {
+    LSLASTNode *only_child = nullptr;
+    size_t num_children = 0;
+    for (auto *child : *stmt) {
+      only_child = child;
+      ++num_children;
+    }
+    if (num_children == 1) {
+      auto child_type = only_child->getNodeSubType();
+      if (child_type == NODE_EXPRESSION_STATEMENT || child_type == NODE_RETURN_STATEMENT
+          || child_type == NODE_JUMP_STATEMENT)
+        stmt = only_child;
+    }
+  }
+
+  auto start_pos = mStr.tellp();
+  stmt->visit(this);
+  // everything in here may have been eliminated
+  if (mStr.tellp() == start_pos)
+    writeToken(";");
+}
+
+bool LSLMinifyingVisitor::visit(LSLNopStatement *nop_stmt) {
+  // Only matters as the body of something, and `writeSubStatement()` handles that.
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLExpressionStatement *expr_stmt) {
+  auto *expr = expr_stmt->getExpr();
+  if (_mOptions.remove_dead_code) {
+    // Stores to dead locals only need to keep the side effects of the value being stored
+    if (expr->getNodeSubType() == NODE_BINARY_EXPRESSION) {
+      auto *bin_expr = (LSLBinaryExpression *) expr;
+      if (isDeadStore(bin_expr))
+        expr = bin_expr->getRHS();
+    }
+    if (!has_effects(expr))
+      return false;
+  }
+  expr->visit(this);
+  writeToken(";");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLDeclaration *decl_stmt) {
+  auto *sym = decl_stmt->getSymbol();
+  auto *initializer = (LSLExpression *) decl_stmt->getInitializer();
+  if (isDeadVar(sym)) {
+    if (initializer && has_effects(initializer)) {
+      initializer->visit(this);
+      writeToken(";");
+    }
+    return false;
+  }
+  writeToken(LSL_TYPE_NAMES[sym->getIType()]);
+  writeToken(getSymbolName(sym));
+  if (initializer && !isDefaultInitializer(sym, initializer)) {
+    writeToken("=");
+    initializer->visit(this);
+  }
+  writeToken(";");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLIfStatement *if_stmt) {
+  auto *true_branch = if_stmt->getTrueBranch();
+  auto *false_branch = if_stmt->getFalseBranch();
+  bool truth;
+  if (_mOptions.remove_dead_code && getConstantTruth(if_stmt->getCheckExpr(), &truth)) {
+    auto *taken = truth ? true_branch : false_branch;
+    auto *skipped = truth ? false_branch : true_branch;
+    if (!skipped || !contains_label(skipped)) {
+      bool in_block = if_stmt->getParent()->getNodeSubType() == NODE_COMPOUND_STATEMENT;
+      if (!taken) {
+        // Something like a loop body still needs a statement there.
+        if (!in_block)
+          writeToken(";");
+      } else if (in_block && !declaresLocals(taken) && !contains_label(taken)) {
+        // Nothing in it can clash with the enclosing block, so it doesn't need braces.
+        if (taken->getNodeSubType() == NODE_COMPOUND_STATEMENT)
+          writeBlockContents(taken);
+        else
+          taken->visit(this);
+      } else {
+        // Braced so that it's still a single statement, and can't pick up an `else`
+        bool needs_braces = taken->getNodeSubType() != NODE_COMPOUND_STATEMENT;
+        if (needs_braces)
+          writeToken("{");
+        taken->visit(this);
+        if (needs_braces)
+          writeToken("}");
+      }
+      return false;
+    }
+  }
+
+  writeToken("if");
+  writeToken("(");
+  if_stmt->getCheckExpr()->visit(this);
+  writeToken(")");
+  writeSubStatement(true_branch);
+  if (false_branch) {
+    writeToken("else");
+    writeSubStatement(false_branch);
+  }
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLForStatement *for_stmt) {
+  writeToken("for");
+  writeToken("(");
+  writeExprList(for_stmt->getInitExprs());
+  writeToken(";");
+  for_stmt->getCheckExpr()->visit(this);
+  writeToken(";");
+  writeExprList(for_stmt->getIncrExprs());
+  writeToken(")");
+  writeSubStatement(for_stmt->getBody());
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLWhileStatement *while_stmt) {
+  bool truth;
+  if (_mOptions.remove_dead_code && getConstantTruth(while_stmt->getCheckExpr(), &truth)
+      && !truth && !contains_label(while_stmt->getBody()))
+    return false;
+  writeToken("while");
+  writeToken("(");
+  while_stmt->getCheckExpr()->visit(this);
+  writeToken(")");
+  writeSubStatement(while_stmt->getBody());
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLDoStatement *do_stmt) {
+  writeToken("do");
+  writeSubStatement(do_stmt->getBody());
+  writeToken("while");
+  writeToken("(");
+  do_stmt->getCheckExpr()->visit(this);
+  writeToken(")");
+  writeToken(";");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLJumpStatement *jump_stmt) {
+  writeToken("jump");
+  writeToken(getSymbolName(jump_stmt->getSymbol()));
+  writeToken(";");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLLabel *label_stmt) {
+  writeToken("@" + getSymbolName(label_stmt->getSymbol()));
+  writeToken(";");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLReturnStatement *return_stmt) {
+  writeToken("return");
+  if (auto *ret_expr = return_stmt->getExpr())
+    ret_expr->visit(this);
+  writeToken(";");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLStateStatement *state_stmt) {
+  writeToken("state");
+  writeToken(state_stmt->getSymbol()->getName());
+  writeToken(";");
+  return false;
+}
+
+
+bool LSLMinifyingVisitor::writeFoldedConstant(LSLExpression *expr) {
+  if (!_mOptions.fold_constants)
+    return false;
+  auto *const_val = expr->getConstantValue();
+  if (!const_val || has_effects(expr))
+    return false;
+  // keys and lists can't be written as literals
+  switch (const_val->getIType()) {
+    case LST_INTEGER:
+    case LST_FLOATINGPOINT:
+    case LST_STRING:
+    case LST_VECTOR:
+    case LST_QUATERNION:
+      break;
+    default:
+      return false;
+  }
+  // `(string)(-1.5)` isn't the same as `(string)-1.5`
+  auto parent_type = expr->getParent()->getNodeSubType();
+  bool needs_parens = is_negative_constant(const_val)
+      && (parent_type == NODE_UNARY_EXPRESSION || parent_type == NODE_TYPECAST_EXPRESSION);
+  if (needs_parens)
+    writeToken("(");
+  const_val->visit(this);
+  if (needs_parens)
+    writeToken(")");
+  return true;
+}
+
+void LSLMinifyingVisitor::writeExprList(LSLASTNode *exprs) {
+  for (auto *expr : *exprs) {
+    expr->visit(this);
+    if (expr->getNext())
+      writeToken(",");
+  }
+}
+
+bool LSLMinifyingVisitor::visit(LSLConstantExpression *const_expr) {
+  if (!writeFoldedConstant(const_expr))
+    const_expr->getConstantValue()->visit(this);
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLIntegerConstant *int_const) {
+  writeToken(format_int(int_const->getValue()));
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLFloatConstant *float_const) {
+  writeToken(format_float(float_const->getValue(), false));
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLStringConstant *str_const) {
+  writeToken(std::string("\"") + escape_string(str_const->getValue()) + "\"");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLKeyConstant *key_const) {
+  writeToken(std::string("(key)\"") + escape_string(key_const->getValue()) + "\"");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLVectorConstant *vec_const) {
+  auto *val = vec_const->getValue();
+  writeToken("<");
+  writeToken(format_float(val->x, true));
+  writeToken(",");
+  writeToken(format_float(val->y, true));
+  writeToken(",");
+  writeToken(format_float(val->z, true));
+  writeToken(">");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLQuaternionConstant *quat_const) {
+  auto *val = quat_const->getValue();
+  writeToken("<");
+  writeToken(format_float(val->x, true));
+  writeToken(",");
+  writeToken(format_float(val->y, true));
+  writeToken(",");
+  writeToken(format_float(val->z, true));
+  writeToken(",");
+  writeToken(format_float(val->s, true));
+  writeToken(">");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLListConstant *list_const) {
+  writeToken("[");
+  writeExprList(list_const);
+  writeToken("]");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLVectorExpression *vec_expr) {
+  if (writeFoldedConstant(vec_expr))
+    return false;
+  writeToken("<");
+  writeExprList(vec_expr);
+  writeToken(">");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLQuaternionExpression *quat_expr) {
+  if (writeFoldedConstant(quat_expr))
+    return false;
+  writeToken("<");
+  writeExprList(quat_expr);
+  writeToken(">");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLListExpression *list_expr) {
+  writeToken("[");
+  writeExprList(list_expr);
+  writeToken("]");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLTypecastExpression *cast_expr) {
+  if (writeFoldedConstant(cast_expr))
+    return false;
+  writeToken("(");
+  writeToken(LSL_TYPE_NAMES[cast_expr->getIType()]);
+  writeToken(")");
+  cast_expr->getChildExpr()->visit(this);
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLFunctionExpression *func_expr) {
+  writeToken(getSymbolName(resolveFunc(func_expr->getSymbol())));
+  writeToken("(");
+  writeExprList(func_expr->getArguments());
+  writeToken(")");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLLValueExpression *lvalue) {
+  std::string name = getSymbolName(lvalue->getSymbol());
+  if (auto *member = lvalue->getMember())
+    name += std::string(".") + member->getName();
+  writeToken(name);
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLBinaryExpression *bin_expr) {
+  if (writeFoldedConstant(bin_expr))
+    return false;
+  if (isDeadStore(bin_expr)) {
+    // nothing will ever read the stored value, just evaluate to it. The store would
+    // have converted it to the variable's type, so cast it if that's not a no-op.
+    auto *rhs = bin_expr->getRHS();
+    auto lhs_type = bin_expr->getLHS()->getIType();
+    writeToken("(");
+    if (lhs_type != rhs->getIType()) {
+      writeToken("(");
+      writeToken(LSL_TYPE_NAMES[lhs_type]);
+      writeToken(")");
+      writeToken("(");
+      rhs->visit(this);
+      writeToken(")");
+    } else {
+      rhs->visit(this);
+    }
+    writeToken(")");
+    return false;
+  }
+  // The parse is kept as-is, and parentheses are their own nodes,
+  // so writing the operands in order is enough.
+  // Generated scripts can have chains like `a + b + c + ...` with thousands of operands.
+  // Walk down their left side in a loop rather than recursing once per operand.
+  auto chain = collect_left_chain(bin_expr, [this](LSLBinaryExpression *link) {
+    return !_mOptions.fold_constants || !link->getConstantValue();
+  });
+  chain.back()->getLHS()->visit(this);
+  for (auto link_iter = chain.rbegin(); link_iter != chain.rend(); ++link_iter) {
+    writeToken(operation_to_lsl_operation((*link_iter)->getOperation()));
+    (*link_iter)->getRHS()->visit(this);
+  }
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLUnaryExpression *unary_expr) {
+  if (writeFoldedConstant(unary_expr))
+    return false;
+  auto op = unary_expr->getOperation();
+  const char *op_str = operation_to_lsl_operation(op);
+  bool post = op == OP_POST_INCR || op == OP_POST_DECR;
+  if (!post)
+    writeToken(op_str);
+  unary_expr->getChildExpr()->visit(this);
+  if (post)
+    writeToken(op_str);
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLPrintExpression *print_expr) {
+  writeToken("print");
+  writeToken("(");
+  print_expr->getChildExpr()->visit(this);
+  writeToken(")");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLParenthesisExpression *parens_expr) {
+  // A folded coordinate might have a `>` that needs to stay inside the parentheses
+  auto type = parens_expr->getIType();
+  if (type != LST_VECTOR && type != LST_QUATERNION && writeFoldedConstant(parens_expr))
+    return false;
+  // Nothing can bind tighter than a variable reference or a call
+  auto *child_expr = parens_expr->getChildExpr();
+  auto child_type = child_expr->getNodeSubType();
+  if (child_type == NODE_LVALUE_EXPRESSION || child_type == NODE_FUNCTION_EXPRESSION) {
+    child_expr->visit(this);
+    return false;
+  }
+  writeToken("(");
+  child_expr->visit(this);
+  writeToken(")");
+  return false;
+}
+
+bool LSLMinifyingVisitor::visit(LSLBoolConversionExpression *bool_expr) {
+  bool_expr->getChildExpr()->visit(this);
+  return false;
+}
+
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <tailslide/tailslide.hh>
+
+#include "ast_utils.hh"
+#include "tree_shaking.hh"
+
+namespace Tailslide {
+
+struct LSLCompilationOptions {
+  // Write expressions Tailslide was able to compute the value of as that value
+  bool fold_constants = true;
+  // Leave out unused globals, locals that are never read, branches that can
+  // never be taken and statements after a `return` or `jump`
+  bool remove_dead_code = true;
+  // Give globals, functions, locals and labels the shortest names available.
+  // States and event handlers keep their names.
+  bool shorten_identifiers = true;
+  // Functions that can't be called are left out, and calls to identical
+  // functions all go to a single copy.
+  const TreeShaker *tree_shaker = nullptr;
+};
+
+// Writes a checked script back out as LSL, with as little in it as possible
+class LSLMinifyingVisitor : public ASTVisitor {
+  public:
+  explicit LSLMinifyingVisitor(LSLCompilationOptions options={}) : _mOptions(options) {}
+
+  std::stringstream mStr;
+
+  protected:
+  void writeToken(const std::string &token);
+  void writeNewline();
+  std::string getSymbolName(LSLSymbol *sym);
+  void assignShortNames(LSLScript *script);
+  bool isDeadVar(LSLSymbol *sym);
+  bool isFuncKept(LSLSymbol *func_sym);
+  LSLSymbol *resolveFunc(LSLSymbol *func_sym);
+  bool isDeadStore(LSLBinaryExpression *bin_expr);
+  bool isDefaultInitializer(LSLSymbol *sym, LSLExpression *initializer);
+  bool getConstantTruth(LSLExpression *expr, bool *truth);
+  bool declaresLocals(LSLASTNode *stmt);
+
+  virtual bool visit(LSLScript *script);
+  void writeState(LSLState *state);
+  virtual bool visit(LSLGlobalVariable *glob_var);
+  virtual bool visit(LSLGlobalFunction *glob_func);
+  virtual bool visit(LSLEventHandler *event_handler);
+  void writeParams(LSLASTNode *params);
+
+  virtual bool visit(LSLCompoundStatement *compound_stmt);
+  void writeBlockContents(LSLASTNode *compound_stmt);
+  void writeSubStatement(LSLASTNode *stmt);
+  virtual bool visit(LSLNopStatement *nop_stmt);
+  virtual bool visit(LSLExpressionStatement *expr_stmt);
+  virtual bool visit(LSLDeclaration *decl_stmt);
+  virtual bool visit(LSLIfStatement *if_stmt);
+  virtual bool visit(LSLForStatement *for_stmt);
+  virtual bool visit(LSLWhileStatement *while_stmt);
+  virtual bool visit(LSLDoStatement *do_stmt);
+  virtual bool visit(LSLJumpStatement *jump_stmt);
+  virtual bool visit(LSLLabel *label_stmt);
+  virtual bool visit(LSLReturnStatement *return_stmt);
+  virtual bool visit(LSLStateStatement *state_stmt);
+
+  bool writeFoldedConstant(LSLExpression *expr);
+  void writeExprList(LSLASTNode *exprs);
+  virtual bool visit(LSLConstantExpression *const_expr);
+  virtual bool visit(LSLIntegerConstant *int_const);
+  virtual bool visit(LSLFloatConstant *float_const);
+  virtual bool visit(LSLStringConstant *str_const);
+  virtual bool visit(LSLKeyConstant *key_const);
+  virtual bool visit(LSLVectorConstant *vec_const);
+  virtual bool visit(LSLQuaternionConstant *quat_const);
+  virtual bool visit(LSLListConstant *list_const);
+  virtual bool visit(LSLVectorExpression *vec_expr);
+  virtual bool visit(LSLQuaternionExpression *quat_expr);
+  virtual bool visit(LSLListExpression *list_expr);
+  virtual bool visit(LSLTypecastExpression *cast_expr);
+  virtual bool visit(LSLFunctionExpression *func_expr);
+  virtual bool visit(LSLLValueExpression *lvalue);
+  virtual bool visit(LSLBinaryExpression *bin_expr);
+  virtual bool visit(LSLUnaryExpression *unary_expr);
+  virtual bool visit(LSLPrintExpression *print_expr);
+  virtual bool visit(LSLParenthesisExpression *parens_expr);
+  virtual bool visit(LSLBoolConversionExpression *bool_expr);
+
+  LSLCompilationOptions _mOptions {};
+  VarUsageVisitor _mVarUsage;
+  std::map<LSLSymbol *, std::string> _mShortNames;
+  // last character written, so we know when tokens need a space between them
+  char _mLastChar = '\0';
+};
+
+}
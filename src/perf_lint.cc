@@ -0,0 +1,300 @@
+#include <cstring>
+
+#include <tailslide/visitor.hh>
+
+#include "ast_utils.hh"
+#include "perf_lint.hh"
+
+namespace Tailslide {
+
+static LSLExpression *strip_parens(LSLExpression *expr) {
+  while (expr->getNodeSubType() == NODE_PARENTHESIS_EXPRESSION)
+    expr = ((LSLParenthesisExpression *) expr)->getChildExpr();
+  return expr;
+}
+
+static bool is_same_var(LSLExpression *expr, LSLSymbol *sym) {
+  expr = strip_parens(expr);
+  return expr->getNodeSubType() == NODE_LVALUE_EXPRESSION && expr->getSymbol() == sym
+      && !((LSLLValueExpression *) expr)->getMember();
+}
+
+// Builtins whose result only depends on their arguments, but that have to walk
+// over a list or string to compute it.
+static bool is_costly_query(const char *name) {
+  return !strcmp(name, "llGetListLength") || !strcmp(name, "llStringLength")
+      || !strncmp(name, "llList2", strlen("llList2"));
+}
+
+class ReferencedVarsVisitor : public ASTVisitor {
+  public:
+    std::vector<LSLSymbol *> mSyms;
+
+  protected:
+    bool visit(LSLLValueExpression *lvalue) override {
+      mSyms.push_back(lvalue->getSymbol());
+      return false;
+    }
+};
+
+// Finds calls in a loop condition that'll give the same result on every iteration
+class LoopConditionCallVisitor : public ASTVisitor {
+  public:
+    explicit LoopConditionCallVisitor(const AssignedVarsVisitor &loop_assignments) :
+        _mLoopAssignments(loop_assignments) {}
+    std::vector<LSLFunctionExpression *> mCalls;
+
+  protected:
+    bool visit(LSLFunctionExpression *func_expr) override {
+      auto *sym = func_expr->getSymbol();
+      if (sym->getSubType() != SYM_BUILTIN || !is_costly_query(sym->getName()))
+        return true;
+      // If the loop changes what it's being asked about, it does need to be asked again.
+      for (auto *arg : *func_expr->getArguments()) {
+        ReferencedVarsVisitor refs_visitor;
+        arg->visit(&refs_visitor);
+        for (auto *ref_sym : refs_visitor.mSyms) {
+          if (_mLoopAssignments.mightChange(ref_sym))
+            return true;
+        }
+      }
+      mCalls.push_back(func_expr);
+      return true;
+    }
+
+    const AssignedVarsVisitor &_mLoopAssignments;
+};
+
+
+bool AssignedVarsVisitor::mightChange(LSLSymbol *sym) const {
+  if (_mAssigned.find(sym) != _mAssigned.end())
+    return true;
+  return _mCallsUserFunc && sym->getSubType() == SYM_GLOBAL;
+}
+
+bool AssignedVarsVisitor::visit(LSLBinaryExpression *bin_expr) {
+  if (is_assignment_op(bin_expr->getOperation()))
+    _mAssigned.insert(bin_expr->getLHS()->getSymbol());
+  return true;
+}
+
+bool AssignedVarsVisitor::visit(LSLUnaryExpression *unary_expr) {
+  if (is_incr_decr_op(unary_expr->getOperation()))
+    _mAssigned.insert(unary_expr->getChildExpr()->getSymbol());
+  return true;
+}
+
+bool AssignedVarsVisitor::visit(LSLFunctionExpression *func_expr) {
+  if (func_expr->getSymbol()->getSubType() != SYM_BUILTIN)
+    _mCallsUserFunc = true;
+  return true;
+}
+
+
+void PerfLintVisitor::addFinding(LSLASTNode *node, const char *code, const std::string &message) {
+  auto *loc = node->getLoc();
+  mFindings.push_back({loc->first_line, loc->first_column, code, message});
+}
+
+bool PerfLintVisitor::visit(LSLScript *script) {
+  // Figure out which functions might call themselves, directly or otherwise.
+  std::map<LSLSymbol *, std::vector<LSLSymbol *>> callees;
+  for (auto *glob : *script->getGlobals()) {
+    if (glob->getNodeType() != NODE_GLOBAL_FUNCTION)
+      continue;
+    CalleeCollectingVisitor callee_visitor;
+    glob->visit(&callee_visitor);
+    callees[glob->getSymbol()] = std::move(callee_visitor.mCallees);
+  }
+  for (auto &func_callees : callees) {
+    auto &reachable = _mReachableCalls[func_callees.first];
+    std::vector<LSLSymbol *> pending {func_callees.second};
+    while (!pending.empty()) {
+      auto *sym = pending.back();
+      pending.pop_back();
+      if (!reachable.insert(sym).second)
+        continue;
+      pending.insert(pending.end(), callees[sym].begin(), callees[sym].end());
+    }
+  }
+
+  visitChildren(script);
+  return false;
+}
+
+bool PerfLintVisitor::visit(LSLGlobalFunction *glob_func) {
+  visitFuncLike(glob_func, glob_func->getSymbol());
+  return false;
+}
+
+bool PerfLintVisitor::visit(LSLEventHandler *handler) {
+  // Nothing can call an event handler, so there's no recursion to check for.
+  visitFuncLike(handler, nullptr);
+  return false;
+}
+
+void PerfLintVisitor::visitFuncLike(LSLASTNode *func_like, LSLSymbol *func_sym) {
+  _mFunc = func_like;
+  _mFuncSym = func_sym;
+  AssignedVarsVisitor func_assignments;
+  func_like->visit(&func_assignments);
+  _mFuncAssignments = &func_assignments;
+  visitChildren(func_like);
+  _mFuncAssignments = nullptr;
+  _mFunc = nullptr;
+  _mFuncSym = nullptr;
+  _mSawConditionalReturn = false;
+  _mCastCounts.clear();
+}
+
+bool PerfLintVisitor::visit(LSLIfStatement *if_stmt) {
+  if_stmt->getCheckExpr()->visit(this);
+  ++_mConditionalDepth;
+  if_stmt->getTrueBranch()->visit(this);
+  if (auto *false_branch = if_stmt->getFalseBranch())
+    false_branch->visit(this);
+  --_mConditionalDepth;
+  return false;
+}
+
+bool PerfLintVisitor::visit(LSLForStatement *for_stmt) {
+  for_stmt->getInitExprs()->visit(this);
+  checkLoopCondition(for_stmt->getCheckExpr(), for_stmt);
+  ++_mLoopDepth;
+  for_stmt->getCheckExpr()->visit(this);
+  visitLoopBody(for_stmt->getBody());
+  for_stmt->getIncrExprs()->visit(this);
+  --_mLoopDepth;
+  return false;
+}
+
+bool PerfLintVisitor::visit(LSLWhileStatement *while_stmt) {
+  checkLoopCondition(while_stmt->getCheckExpr(), while_stmt);
+  ++_mLoopDepth;
+  while_stmt->getCheckExpr()->visit(this);
+  visitLoopBody(while_stmt->getBody());
+  --_mLoopDepth;
+  return false;
+}
+
+bool PerfLintVisitor::visit(LSLDoStatement *do_stmt) {
+  checkLoopCondition(do_stmt->getCheckExpr(), do_stmt);
+  ++_mLoopDepth;
+  do_stmt->getBody()->visit(this);
+  do_stmt->getCheckExpr()->visit(this);
+  --_mLoopDepth;
+  return false;
+}
+
+void PerfLintVisitor::visitLoopBody(LSLASTNode *body) {
+  ++_mConditionalDepth;
+  body->visit(this);
+  --_mConditionalDepth;
+}
+
+void PerfLintVisitor::checkLoopCondition(LSLExpression *check_expr, LSLASTNode *loop_stmt) {
+  AssignedVarsVisitor loop_assignments;
+  loop_stmt->visit(&loop_assignments);
+  LoopConditionCallVisitor call_visitor(loop_assignments);
+  check_expr->visit(&call_visitor);
+  for (auto *call : call_visitor.mCalls) {
+    addFinding(call, "loop-condition-call", std::string("`") + call->getSymbol()->getName()
+        + "()` is called again on every iteration, store its result in a local before the loop");
+  }
+}
+
+bool PerfLintVisitor::visit(LSLReturnStatement *return_stmt) {
+  if (_mConditionalDepth)
+    _mSawConditionalReturn = true;
+  return true;
+}
+
+bool PerfLintVisitor::visit(LSLBinaryExpression *bin_expr) {
+  auto op = bin_expr->getOperation();
+  auto type = bin_expr->getLHS()->getIType();
+  if (!_mLoopDepth || (op != '=' && op != OP_ADD_ASSIGN) || (type != LST_LIST && type != LST_STRING))
+    return true;
+  auto *sym = bin_expr->getLHS()->getSymbol();
+
+  // `l += x`, `l = l + x` or `l = x + l`, all of which copy `l` to make the new value.
+  bool accumulates = op == OP_ADD_ASSIGN;
+  auto *rhs = strip_parens(bin_expr->getRHS());
+  if (!accumulates && rhs->getNodeSubType() == NODE_BINARY_EXPRESSION) {
+    auto chain = collect_left_chain((LSLBinaryExpression *) rhs, [](LSLBinaryExpression *link) {
+      return link->getOperation() == '+';
+    });
+    if (chain.front()->getOperation() == '+') {
+      accumulates = is_same_var(chain.back()->getLHS(), sym);
+      for (auto *link : chain)
+        accumulates = accumulates || is_same_var(link->getRHS(), sym);
+    }
+  }
+  if (accumulates) {
+    addFinding(bin_expr, "loop-accumulation", std::string("`") + sym->getName()
+        + "` is copied every time it's added to within a loop, building it up this way takes quadratic time");
+  }
+  return true;
+}
+
+bool PerfLintVisitor::visit(LSLListExpression *list_expr) {
+  // Globals are only built once
+  if (!_mFunc)
+    return true;
+  size_t num_elems = 0;
+  for (auto *elem : *list_expr) {
+    // Lists of things that change each time have to be rebuilt anyway
+    if (!((LSLExpression *) elem)->getConstantValue())
+      return true;
+    ++num_elems;
+  }
+  if (num_elems >= LARGE_LIST_ELEMS) {
+    addFinding(list_expr, "large-list-literal", "list of " + std::to_string(num_elems)
+        + " constants is built again every time this runs, consider building it once in a global");
+  }
+  return true;
+}
+
+bool PerfLintVisitor::visit(LSLTypecastExpression *cast_expr) {
+  if (!_mFunc)
+    return true;
+  auto *source = strip_parens(cast_expr->getChildExpr());
+  auto from_type = source->getIType();
+  auto to_type = cast_expr->getIType();
+  // converting between numbers is cheap, anything involving strings or lists isn't.
+  bool is_numeric = (from_type == LST_INTEGER || from_type == LST_FLOATINGPOINT)
+      && (to_type == LST_INTEGER || to_type == LST_FLOATINGPOINT);
+  if (source->getNodeSubType() != NODE_LVALUE_EXPRESSION || from_type == to_type || is_numeric)
+    return true;
+
+  auto *lvalue = (LSLLValueExpression *) source;
+  auto *sym = lvalue->getSymbol();
+  // Casting the same variable again only gives the same result if it can't have changed.
+  if (_mFuncAssignments->mightChange(sym))
+    return true;
+
+  std::string member = lvalue->getMember() ? lvalue->getMember()->getName() : "";
+  if (++_mCastCounts[std::make_tuple(sym, member, to_type)] == 2) {
+    std::string name = sym->getName();
+    if (!member.empty())
+      name += "." + member;
+    addFinding(cast_expr, "repeated-cast", "`" + name + "` is cast to " + LSL_TYPE_NAMES[to_type]
+        + " more than once, cast it once and reuse the result");
+  }
+  return true;
+}
+
+bool PerfLintVisitor::visit(LSLFunctionExpression *func_expr) {
+  auto *callee = func_expr->getSymbol();
+  if (!_mFuncSym || callee->getSubType() == SYM_BUILTIN)
+    return true;
+  const auto &callee_reachable = _mReachableCalls[callee];
+  bool recursive = callee == _mFuncSym || callee_reachable.find(_mFuncSym) != callee_reachable.end();
+  // Nothing stops this call from being made every time the function runs.
+  if (recursive && !_mConditionalDepth && !_mSawConditionalReturn) {
+    addFinding(func_expr, "unbounded-recursion", std::string("`") + _mFuncSym->getName()
+        + "` always recurses through this call, it'll run until the script runs out of memory");
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <tailslide/tailslide.hh>
+
+namespace Tailslide {
+
+struct PerfLintFinding {
+  int line = 0;
+  int column = 0;
+  // Short name for the kind of problem, like `loop-accumulation`
+  std::string code;
+  std::string message;
+};
+
+// List literals with at least this many elements get flagged when they're built within a function
+const size_t LARGE_LIST_ELEMS = 16;
+
+// Collects every variable that might be assigned to within a node. Calling one of the
+// script's own functions might assign to any global.
+class AssignedVarsVisitor : public ASTVisitor {
+  public:
+    bool mightChange(LSLSymbol *sym) const;
+
+  protected:
+    bool visit(LSLBinaryExpression *bin_expr) override;
+    bool visit(LSLUnaryExpression *unary_expr) override;
+    bool visit(LSLFunctionExpression *func_expr) override;
+
+    std::set<LSLSymbol *> _mAssigned;
+    bool _mCallsUserFunc = false;
+};
+
+// Walks a checked script looking for patterns that are known to be slow or to waste
+// memory in-world. Purely syntactic, so it errs on the side of saying nothing.
+class PerfLintVisitor : public ASTVisitor {
+  public:
+    std::vector<PerfLintFinding> mFindings;
+
+  protected:
+    bool visit(LSLScript *script) override;
+    bool visit(LSLGlobalFunction *glob_func) override;
+    bool visit(LSLEventHandler *handler) override;
+    void visitFuncLike(LSLASTNode *func_like, LSLSymbol *func_sym);
+    bool visit(LSLIfStatement *if_stmt) override;
+    bool visit(LSLForStatement *for_stmt) override;
+    bool visit(LSLWhileStatement *while_stmt) override;
+    bool visit(LSLDoStatement *do_stmt) override;
+    void checkLoopCondition(LSLExpression *check_expr, LSLASTNode *loop_stmt);
+    void visitLoopBody(LSLASTNode *body);
+    bool visit(LSLReturnStatement *return_stmt) override;
+    bool visit(LSLBinaryExpression *bin_expr) override;
+    bool visit(LSLListExpression *list_expr) override;
+    bool visit(LSLTypecastExpression *cast_expr) override;
+    bool visit(LSLFunctionExpression *func_expr) override;
+
+    void addFinding(LSLASTNode *node, const char *code, const std::string &message);
+
+    // function -> every function it might end up calling, including itself if it's recursive
+    std::map<LSLSymbol *, std::set<LSLSymbol *>> _mReachableCalls;
+    LSLASTNode *_mFunc = nullptr;
+    LSLSymbol *_mFuncSym = nullptr;
+    int _mLoopDepth = 0;
+    // how many `if` branches or loop bodies we're within
+    int _mConditionalDepth = 0;
+    bool _mSawConditionalReturn = false;
+    // variables the current function might assign to
+    const AssignedVarsVisitor *_mFuncAssignments = nullptr;
+    // casts of variables within the current function, and how many times each was seen
+    std::map<std::tuple<LSLSymbol *, std::string, LSLIType>, int> _mCastCounts;
+};
+
+}
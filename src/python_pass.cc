@@ -1,7 +1,13 @@
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 
 #include "python_pass.hh"
+#include "ast_utils.hh"
+#include "cast_simplification.hh"
+#include "switch_detection.hh"
 
 using namespace Tailslide;
 
@@ -29,6 +35,15 @@ static const char * const PY_PRELUDE_TYPE_NAMES[LST_MAX] {
   "<ERROR>"
 };
 
+static const char * const TYPED_IMPORTS =
+  "from typing import Any, List\n"
+  "\n"
+  "from lummao import (\n"
+  "    Key, Quaternion, StateChangeException, SyncLSLScript, Vector, bin2float, bitnot, boolnot, cond, neg,\n"
+  "    radd, rbitand, rbitor, rbitxor, rbooland, rboolor, rdiv, req, rgeq, rgreater, rleq, rless, rmod,\n"
+  "    rmul, rneq, rshl, rshr, rsub, replace_coord_axis, typecast,\n"
+  ")\n";
+
 class ScopedTabSetter {
   public:
     ScopedTabSetter(PythonVisitor *visitor, int tabs): _mOldTabs(visitor->mTabs), _mVisitor(visitor) {
@@ -43,6 +58,70 @@ class ScopedTabSetter {
 };
 
 
+// Figures out which globals a loop uses, and whether they can be cached in Python locals
+// for the duration of the loop. Any call could observe or clobber the globals, and anything
+// that could enter the loop without passing through its head would see stale locals.
+class LoopGlobalsVisitor : public ASTVisitor {
+  public:
+    std::vector<LSLSymbol *> mGlobals;
+    bool mPromotable = true;
+
+  protected:
+    bool visit(LSLLValueExpression *lvalue) override {
+      auto *sym = lvalue->getSymbol();
+      if (sym->getSubType() == SYM_GLOBAL && std::find(mGlobals.begin(), mGlobals.end(), sym) == mGlobals.end())
+        mGlobals.push_back(sym);
+      return false;
+    }
+    bool visit(LSLFunctionExpression *func_expr) override {
+      mPromotable = false;
+      return false;
+    }
+    bool visit(LSLStateStatement *state_stmt) override {
+      mPromotable = false;
+      return false;
+    }
+    bool visit(LSLLabel *label_stmt) override {
+      mPromotable = false;
+      return false;
+    }
+    bool visit(LSLReturnStatement *return_stmt) override {
+      // Promoted globals get written back before the return, so the returned
+      // expression itself can't be allowed to assign to anything.
+      if (auto *ret_expr = return_stmt->getExpr()) {
+        AssignmentFindingVisitor assignment_visitor;
+        ret_expr->visit(&assignment_visitor);
+        if (assignment_visitor.mFound)
+          mPromotable = false;
+      }
+      return mPromotable;
+    }
+};
+
+// Counts how often each function gets called within a function body. Calls in loops
+// count double, since they're likely to be made more than once.
+class CallCountingVisitor : public ASTVisitor {
+  public:
+    std::map<LSLSymbol *, int> mCallCounts;
+
+  protected:
+    bool visit(LSLFunctionExpression *func_expr) override {
+      mCallCounts[func_expr->getSymbol()] += _mLoopDepth ? 2 : 1;
+      return true;
+    }
+    bool visit(LSLForStatement *for_stmt) override { return visitLoop(for_stmt); }
+    bool visit(LSLWhileStatement *while_stmt) override { return visitLoop(while_stmt); }
+    bool visit(LSLDoStatement *do_stmt) override { return visitLoop(do_stmt); }
+    bool visitLoop(LSLASTNode *loop_stmt) {
+      ++_mLoopDepth;
+      visitChildren(loop_stmt);
+      --_mLoopDepth;
+      return false;
+    }
+
+    int _mLoopDepth = 0;
+};
+
 
 void PythonVisitor::writeChildrenSep(LSLASTNode *parent, const char *separator) {
   for (auto *child: *parent) {
@@ -115,9 +194,17 @@ void PythonVisitor::writeFloat(float f_val) {
   mStr << "bin2float('" << s_val << "', '" << (const char*)&hex_val << "')";
 }
 
+const char *PythonVisitor::getTypeAnnotation(LSLIType type) {
+  // `mypy --strict` won't accept a bare `list` in annotations
+  if (_mOptions.typed_output && type == LST_LIST)
+    return "List[Any]";
+  return PY_TYPE_NAMES[type];
+}
+
 std::string PythonVisitor::getSymbolName(LSLSymbol *sym) {
   switch (sym->getSubType()) {
     // Stop common stuff from colliding with Python builtins (not a good solution!)
+    // Locals the compiler makes up itself never start with `_`, so they can't collide with these.
     case SYM_LOCAL:
     case SYM_FUNCTION_PARAMETER:
     case SYM_EVENT_PARAMETER:
@@ -127,12 +214,55 @@ std::string PythonVisitor::getSymbolName(LSLSymbol *sym) {
   }
 }
 
+bool PythonVisitor::isSelfAttribute(LSLSymbol *sym) {
+  return sym->getSubType() == SYM_GLOBAL && _mPromotedGlobals.find(sym) == _mPromotedGlobals.end();
+}
+
+std::string PythonVisitor::getSymbolRefName(LSLSymbol *sym) {
+  auto promoted_iter = _mPromotedGlobals.find(sym);
+  if (promoted_iter != _mPromotedGlobals.end())
+    return promoted_iter->second;
+  return getSymbolName(sym);
+}
+
+void PythonVisitor::writeHelper(const char *name) {
+  if (_mBindingHelpers)
+    _mUsedHelpers.insert(name);
+  mStr << name;
+}
+
+void PythonVisitor::writeSymbolRef(LSLSymbol *sym) {
+  if (isSelfAttribute(sym))
+    mStr << "self.";
+  mStr << getSymbolRefName(sym);
+}
+
+std::string PythonVisitor::getHandlerName(LSLEventHandler *event_handler) {
+  auto *state_sym = event_handler->getParent()->getParent()->getSymbol();
+  return "e" + getSymbolName(state_sym) + event_handler->getIdentifier()->getName();
+}
+
+std::string PythonVisitor::getFuncLikeName(LSLASTNode *func_like) {
+  if (func_like->getNodeType() == NODE_GLOBAL_FUNCTION)
+    return getSymbolName(func_like->getSymbol());
+  return getHandlerName((LSLEventHandler *) func_like);
+}
+
 bool PythonVisitor::visit(LSLScript *script) {
   // Need to make any casts explicit
   class DeSugaringVisitor de_sugaring_visitor(script->mContext->allocator, true);
   script->visit(&de_sugaring_visitor);
-  mStr << "from lummao import *\n\n\n";
-  mStr << "class Script(BaseLSLScript):\n";
+  if (_mOptions.eliminate_dead_vars) {
+    script->visit(&_mVarUsage);
+    script->visit(&_mDeadStores);
+  }
+  // mypyc won't resolve names brought in through `import *`, so typed scripts import what they use by name
+  if (_mOptions.typed_output)
+    mStr << TYPED_IMPORTS;
+  else
+    mStr << "from lummao import *\n";
+  mStr << "\n\n";
+  mStr << "class Script(" << (_mOptions.typed_output ? "SyncLSLScript" : "BaseLSLScript") << "):\n";
   // everything after this must be indented
   ScopedTabSetter tab_setter(this, mTabs + 1);
 
@@ -142,21 +272,23 @@ bool PythonVisitor::visit(LSLScript *script) {
       continue;
     auto *glob_var = (LSLGlobalVariable *)glob;
     auto *sym = glob_var->getSymbol();
+    if (isDeadVar(sym))
+      continue;
     doTabs();
-    mStr << getSymbolName(sym) << ": " << PY_TYPE_NAMES[sym->getIType()] << '\n';
+    mStr << getSymbolName(sym) << ": " << getTypeAnnotation(sym->getIType()) << '\n';
   }
 
   mStr << '\n';
   // then generate an __init__() where they're actually initialized
   doTabs();
-  mStr << "def __init__(self):\n";
+  mStr << "def __init__(self)" << (_mOptions.typed_output ? " -> None" : "") << ":\n";
   {
     // needs to be indented one more level within the __init__()
     ScopedTabSetter tab_setter_2(this, mTabs + 1);
     doTabs();
     mStr << "super().__init__()\n";
     for (auto *glob: *script->getGlobals()) {
-      if (glob->getNodeType() != NODE_GLOBAL_VARIABLE)
+      if (glob->getNodeType() != NODE_GLOBAL_VARIABLE || isDeadVar(glob->getSymbol()))
         continue;
       glob->visit(this);
     }
@@ -165,13 +297,69 @@ bool PythonVisitor::visit(LSLScript *script) {
 
   // now the global functions
   for (auto *glob : *script->getGlobals()) {
-    if (glob->getNodeType() != NODE_GLOBAL_FUNCTION)
+    if (glob->getNodeType() != NODE_GLOBAL_FUNCTION || !isFuncKept(glob->getSymbol()))
       continue;
-    glob->visit(this);
+    if (_mOptions.lazy_methods)
+      writeLazyMethod(glob, getSymbolName(glob->getSymbol()));
+    else
+      glob->visit(this);
+  }
+
+  // Merged functions stay callable under their own names from outside the script
+  if (_mOptions.tree_shaker) {
+    bool wrote_alias = false;
+    for (auto *glob : *script->getGlobals()) {
+      if (glob->getNodeType() != NODE_GLOBAL_FUNCTION)
+        continue;
+      auto *sym = glob->getSymbol();
+      auto *target_sym = resolveFunc(sym);
+      if (!_mOptions.tree_shaker->isReachable(sym) || target_sym == sym)
+        continue;
+      doTabs();
+      mStr << getSymbolName(sym) << " = " << getSymbolName(target_sym) << '\n';
+      wrote_alias = true;
+    }
+    if (wrote_alias)
+      mStr << '\n';
   }
 
   // and the states and their event handlers
-  script->getStates()->visit(this);
+  if (_mOptions.lazy_methods) {
+    for (auto *state : *script->getStates()) {
+      for (auto *handler : *((LSLState *)state)->getEventHandlers()) {
+        writeLazyMethod(handler, getHandlerName((LSLEventHandler *)handler));
+      }
+    }
+  } else {
+    script->getStates()->visit(this);
+  }
+
+  // Typed setters for globals assigned in expression context
+  for (auto *glob : *script->getGlobals()) {
+    if (glob->getNodeType() != NODE_GLOBAL_VARIABLE)
+      continue;
+    auto *sym = glob->getSymbol();
+    if (_mGlobalSetters.find(sym) == _mGlobalSetters.end())
+      continue;
+    const char *type_name = getTypeAnnotation(sym->getIType());
+    doTabs();
+    mStr << "def _set_" << getSymbolName(sym) << "(self, val: " << type_name << ") -> " << type_name << ":\n";
+    {
+      ScopedTabSetter tab_setter_2(this, mTabs + 1);
+      doTabs();
+      mStr << "self." << getSymbolName(sym) << " = val\n";
+      doTabs();
+      mStr << "return val\n";
+    }
+    mStr << '\n';
+  }
+
+  // Tables for any switches go after the class, at the module level
+  if (!_mSwitchTables.empty()) {
+    mStr << '\n';
+    for (const auto &table : _mSwitchTables)
+      mStr << table;
+  }
   return false;
 }
 
@@ -190,44 +378,50 @@ bool PythonVisitor::visit(LSLGlobalVariable *glob_var) {
 
 bool PythonVisitor::visit(LSLGlobalFunction *glob_func) {
   auto *func_sym = glob_func->getSymbol();
-  if (func_sym->getHasJumps()) {
+  if (func_sym->getHasJumps() && !_mOptions.typed_output) {
     doTabs();
     mStr << "@with_goto\n";
   }
   doTabs();
-  mStr << "async def " << getSymbolName(func_sym) << "(self";
+  mStr << (_mOptions.typed_output ? "def " : "async def ") << getSymbolName(func_sym) << "(self";
   for (auto *arg : *glob_func->getArguments()) {
     auto *arg_sym = arg->getSymbol();
-    mStr << ", " << getSymbolName(arg_sym) << ": " << PY_TYPE_NAMES[arg_sym->getIType()];
+    mStr << ", " << getSymbolName(arg_sym) << ": " << getTypeAnnotation(arg_sym->getIType());
   }
-  mStr << ") -> " << PY_TYPE_NAMES[func_sym->getIType()] << ":\n";
-  visitFuncLike(glob_func, glob_func->getStatements());
+  visitFuncLike(glob_func, glob_func->getStatements(), getTypeAnnotation(func_sym->getIType()));
   return false;
 }
 
 bool PythonVisitor::visit(LSLEventHandler *event_handler) {
-  auto *state_sym = event_handler->getParent()->getParent()->getSymbol();
   auto *id = event_handler->getIdentifier();
   auto *func_sym = event_handler->getSymbol();
-  if (func_sym->getHasJumps()) {
+  if (func_sym->getHasJumps() && !_mOptions.typed_output) {
     doTabs();
     mStr << "@with_goto\n";
   }
   doTabs();
-  mStr << "async def e" << getSymbolName(state_sym) << id->getName() << "(self";
+  mStr << (_mOptions.typed_output ? "def " : "async def ") << getHandlerName(event_handler) << "(self";
   for (auto *arg : *event_handler->getArguments()) {
     auto *arg_sym = arg->getSymbol();
-    mStr << ", " << getSymbolName(arg_sym) << ": " << PY_TYPE_NAMES[arg_sym->getIType()];
+    mStr << ", " << getSymbolName(arg_sym) << ": " << getTypeAnnotation(arg_sym->getIType());
   }
-  mStr << ") -> " << PY_TYPE_NAMES[id->getIType()] << ":\n";
-  visitFuncLike(event_handler, event_handler->getStatements());
+  visitFuncLike(event_handler, event_handler->getStatements(), getTypeAnnotation(id->getIType()));
   return false;
 }
 
-void PythonVisitor::visitFuncLike(LSLASTNode *func_like, LSLASTNode *body) {
+void PythonVisitor::visitFuncLike(LSLASTNode *func_like, LSLASTNode *body, const char *ret_type) {
+  // Caller has already written the start of the signature, up to the last parameter.
   ScopedTabSetter tab_setter(this, mTabs + 1);
   _mFuncPreludeTabs = mTabs;
   _mFuncSym = func_like->getSymbol();
+  std::string func_name = getFuncLikeName(func_like);
+  // Functions that never ran while profiling aren't worth spending code size on
+  _mFuncIsCold = _mOptions.profile && !_mOptions.profile->getCalls(func_name);
+
+  if (_mOptions.bind_helpers && !_mFuncIsCold) {
+    _mBindingHelpers = true;
+    bindMethods(body);
+  }
 
   std::stringstream orig_stream(std::move(mStr));
   mStr = std::stringstream();
@@ -235,14 +429,89 @@ void PythonVisitor::visitFuncLike(LSLASTNode *func_like, LSLASTNode *body) {
   std::string func_body_str {mStr.str()};
   mStr = std::move(orig_stream);
 
+  if (_mBindingHelpers && !_mUsedHelpers.empty()) {
+    // Helpers are bound as keyword-only defaults so they're fast locals rather
+    // than global lookups. `rebind_helpers()` can swap them out after the fact.
+    mStr << ", *";
+    for (const auto &helper : _mUsedHelpers)
+      mStr << ", " << helper << '=' << helper;
+  }
+  mStr << ") -> " << ret_type << ":\n";
+
+  if (_mOptions.instrument) {
+    doTabs();
+    mStr << "self.profile.record_call(\"" << func_name << "\")\n";
+  }
+  for (auto *sym : _mBoundMethodsOrder) {
+    doTabs();
+    mStr << _mBoundMethods[sym] << " = self.";
+    if (sym->getSubType() == SYM_BUILTIN)
+      mStr << "builtin_funcs.";
+    mStr << getSymbolName(sym) << '\n';
+  }
   mStr << _mFuncPreludeStr.str();
   mStr << func_body_str;
 
   _mFuncPreludeStr.str("");
   _mFuncPreludeStr.clear();
+  _mBindingHelpers = false;
+  _mFuncIsCold = false;
+  _mFlatTemps = 0;
+  _mUsedHelpers.clear();
+  _mBoundMethods.clear();
+  _mBoundMethodsOrder.clear();
   mStr << '\n';
 }
 
+void PythonVisitor::bindMethods(LSLASTNode *body) {
+  // Functions called more than once, or called from within a loop, get looked up once
+  // at the start of the function and stuffed in a local.
+  CallCountingVisitor call_visitor;
+  body->visit(&call_visitor);
+  // calls to merged functions all go to the same method
+  std::map<LSLSymbol *, int> call_counts;
+  for (auto &call_count : call_visitor.mCallCounts)
+    call_counts[resolveFunc(call_count.first)] += call_count.second;
+  for (auto &call_count : call_counts) {
+    if (call_count.second < 2)
+      continue;
+    _mBoundMethodsOrder.push_back(call_count.first);
+  }
+  // Keep output stable regardless of where the symbols happened to be allocated
+  std::sort(_mBoundMethodsOrder.begin(), _mBoundMethodsOrder.end(), [](LSLSymbol *a, LSLSymbol *b) {
+    return strcmp(a->getName(), b->getName()) < 0;
+  });
+  for (auto *sym : _mBoundMethodsOrder)
+    _mBoundMethods[sym] = std::string("bound_") + sym->getName();
+}
+
+void PythonVisitor::writeLazyMethod(LSLASTNode *func_like, const std::string &method_name) {
+  // Generate the method as if it were a standalone function at the leftmost column,
+  // then stuff its source into a string that only gets compiled on first access.
+  std::stringstream orig_stream(std::move(mStr));
+  mStr = std::stringstream();
+  {
+    ScopedTabSetter tab_setter(this, 0);
+    func_like->visit(this);
+  }
+  std::string method_src {mStr.str()};
+  mStr = std::move(orig_stream);
+
+  // visitFuncLike() leaves a blank line after the body, we don't need it in the string.
+  while (method_src.size() > 1 && method_src[method_src.size() - 2] == '\n')
+    method_src.pop_back();
+
+  doTabs();
+  mStr << method_name << " = lazy_method(\"" << method_name << "\", \"\"\"\n";
+  // Escaping every quote means the source can never contain a stray `"""`.
+  for (char c : method_src) {
+    if (c == '\\' || c == '"')
+      mStr << '\\';
+    mStr << c;
+  }
+  mStr << "\"\"\")\n\n";
+}
+
 bool PythonVisitor::visit(LSLIntegerConstant *int_const) {
   // Usually you'd need an `S32()`, but we natively deal in int32 anyway.
   mStr << int_const->getValue();
@@ -262,13 +531,15 @@ bool PythonVisitor::visit(LSLStringConstant *str_const) {
 
 bool PythonVisitor::visit(LSLKeyConstant *key_const) {
   // TODO: Probably not correctly accounting for encoding.
-  mStr << "Key(\"" << escape_string(key_const->getValue()) << "\")";
+  writeHelper("Key");
+  mStr << "(\"" << escape_string(key_const->getValue()) << "\")";
   return false;
 }
 
 bool PythonVisitor::visit(LSLVectorConstant *vec_const) {
   auto *val = vec_const->getValue();
-  mStr << "Vector((";
+  writeHelper("Vector");
+  mStr << "((";
   writeFloat(val->x);
   mStr << ", ";
   writeFloat(val->y);
@@ -280,7 +551,8 @@ bool PythonVisitor::visit(LSLVectorConstant *vec_const) {
 
 bool PythonVisitor::visit(LSLQuaternionConstant *quat_const) {
   auto *val = quat_const->getValue();
-  mStr << "Quaternion((";
+  writeHelper("Quaternion");
+  mStr << "((";
   writeFloat(val->x);
   mStr << ", ";
   writeFloat(val->y);
@@ -293,23 +565,27 @@ bool PythonVisitor::visit(LSLQuaternionConstant *quat_const) {
 }
 
 bool PythonVisitor::visit(LSLVectorExpression *vec_expr) {
-  mStr << "Vector((";
+  writeHelper("Vector");
+  mStr << "((";
   writeChildrenSep(vec_expr, ", ");
   mStr << "))";
   return false;
 }
 
 bool PythonVisitor::visit(LSLQuaternionExpression *quat_expr) {
-  mStr << "Quaternion((";
+  writeHelper("Quaternion");
+  mStr << "((";
   writeChildrenSep(quat_expr, ", ");
   mStr << "))";
   return false;
 }
 
 bool PythonVisitor::visit(LSLTypecastExpression *cast_expr) {
-  auto *child_expr = cast_expr->getChildExpr();
+  auto *child_expr = _mOptions.simplify_casts ? get_cast_source(cast_expr) : cast_expr->getChildExpr();
   auto from_type = child_expr->getIType();
   auto to_type = cast_expr->getIType();
+  if (_mOptions.simplify_casts && writeSimpleCast(child_expr, to_type))
+    return false;
   if (from_type == LST_INTEGER && to_type == LST_FLOATINGPOINT) {
     // these are less annoying to read and basically the same thing
     if (child_expr->getNodeSubType() == NODE_CONSTANT_EXPRESSION) {
@@ -323,12 +599,34 @@ bool PythonVisitor::visit(LSLTypecastExpression *cast_expr) {
     }
     return false;
   }
-  mStr << "typecast(";
+  writeHelper("typecast");
+  mStr << '(';
   child_expr->visit(this);
   mStr << ", " << PY_TYPE_NAMES[cast_expr->getIType()] << ")";
   return false;
 }
 
+bool PythonVisitor::writeSimpleCast(LSLExpression *child_expr, LSLIType to_type) {
+  auto from_type = child_expr->getIType();
+  if (from_type == to_type) {
+    // values are always already normalized for their type, nothing to do.
+    child_expr->visit(this);
+  } else if (from_type == LST_INTEGER && to_type == LST_STRING) {
+    // ints are always in int32 range and get formatted the same as Python's
+    mStr << "str(";
+    child_expr->visit(this);
+    mStr << ')';
+  } else if (to_type == LST_LIST) {
+    // anything other than a list just gets wrapped in one
+    mStr << '[';
+    child_expr->visit(this);
+    mStr << ']';
+  } else {
+    return false;
+  }
+  return true;
+}
+
 bool PythonVisitor::visit(LSLListConstant *list_const) {
   mStr << '[';
   writeChildrenSep(list_const, ", ");
@@ -344,12 +642,20 @@ bool PythonVisitor::visit(LSLListExpression *list_expr) {
 }
 
 bool PythonVisitor::visit(LSLFunctionExpression *func_expr) {
-  auto *sym = func_expr->getSymbol();
-  mStr << "await self.";
-  if (sym->getSubType() == SYM_BUILTIN) {
-    mStr << "builtin_funcs.";
+  auto *sym = resolveFunc(func_expr->getSymbol());
+  if (!_mOptions.typed_output)
+    mStr << "await ";
+  auto bound_iter = _mBoundMethods.find(sym);
+  if (bound_iter != _mBoundMethods.end()) {
+    mStr << bound_iter->second;
+  } else {
+    mStr << "self.";
+    if (sym->getSubType() == SYM_BUILTIN) {
+      mStr << "builtin_funcs.";
+    }
+    mStr << getSymbolName(sym);
   }
-  mStr << getSymbolName(sym) << "(";
+  mStr << "(";
   for (auto *arg : *func_expr->getArguments()) {
     arg->visit(this);
     if (arg->getNext())
@@ -375,9 +681,7 @@ static int member_to_offset(const char *member) {
 }
 
 bool PythonVisitor::visit(LSLLValueExpression *lvalue) {
-  if (lvalue->getSymbol()->getSubType() == SYM_GLOBAL)
-    mStr << "self.";
-  mStr << getSymbolName(lvalue->getSymbol());
+  writeSymbolRef(lvalue->getSymbol());
   if (auto *member = lvalue->getMember()) {
     mStr << '[' << member_to_offset(member->getName()) << ']';
   }
@@ -388,11 +692,58 @@ void PythonVisitor::constructMutatedMember(LSLSymbol *sym, LSLIdentifier *member
   // Member case is special. We actually need to construct a new version of the same
   // type of object with only the selected member swapped out, and then assign _that_.
   int member_offset = member_to_offset(member->getName());
-  mStr << "replace_coord_axis(";
-  if (sym->getSubType() == SYM_GLOBAL)
-    mStr << "self.";
-  mStr << getSymbolName(sym) << ", " << member_offset << ", ";
-  rhs->visit(this);
+
+  AssignmentFindingVisitor assignment_visitor(sym);
+  rhs->visit(&assignment_visitor);
+  if (assignment_visitor.mFound) {
+    // Building the coordinate directly would read some of the other members after the
+    // RHS changed them, fall back to the helper that grabs them all up front.
+    writeHelper("replace_coord_axis");
+    mStr << '(';
+    writeSymbolRef(sym);
+    mStr << ", " << member_offset << ", ";
+    rhs->visit(this);
+    mStr << ')';
+    return;
+  }
+  writeMutatedCoord(sym, member_offset, [&]() { rhs->visit(this); });
+}
+
+void PythonVisitor::writeMutatedCoord(LSLSymbol *sym, int member_offset, const std::function<void()> &write_member) {
+  // `Vector((_v[0], new_y, _v[2]))`, much cheaper than looping over the members at runtime.
+  int num_members = (sym->getIType() == LST_QUATERNION) ? 4 : 3;
+  writeHelper(PY_TYPE_NAMES[sym->getIType()]);
+  mStr << "((";
+  for (int i = 0; i < num_members; ++i) {
+    if (i)
+      mStr << ", ";
+    if (i == member_offset) {
+      write_member();
+    } else {
+      writeSymbolRef(sym);
+      mStr << '[' << i << ']';
+    }
+  }
+  mStr << "))";
+}
+
+void PythonVisitor::writeExprAssign(LSLSymbol *sym, const std::function<void()> &write_value) {
+  if (!isSelfAttribute(sym)) {
+    // We need to wrap this assignment in parens so we can use the walrus operator.
+    // walrus operator works regardless of expression or statement context, but doesn't
+    // work for cases like `(self.foo := 2)` where we're assigning to an attribute rather than
+    // just a single identifier...
+    mStr << '(' << getSymbolRefName(sym) << " := ";
+  } else if (_mOptions.typed_output) {
+    // no poking at `__dict__`, each global that needs one gets a typed setter method.
+    _mGlobalSetters.insert(sym);
+    mStr << "self._set_" << getSymbolName(sym) << '(';
+  } else {
+    // walrus operator can't assign to these, need to use special assignment helper.
+    writeHelper("assign");
+    mStr << "(self.__dict__, \"" << getSymbolName(sym) << "\", ";
+  }
+  write_value();
   mStr << ')';
 }
 
@@ -404,36 +755,32 @@ bool PythonVisitor::visit(LSLBinaryExpression *bin_expr) {
   if (op == '=') {
     auto *lvalue = (LSLLValueExpression *) lhs;
     auto *sym = lvalue->getSymbol();
+    if (isDeadStore(bin_expr)) {
+      // nothing will ever read the stored value, just evaluate to it.
+      mStr << '(';
+      rhs->visit(this);
+      mStr << ')';
+      return false;
+    }
     // If our result isn't needed, this expression will be put in a statement context in Python.
     // We can just directly assign, no special song and dance. There are some other cases where
     // we can do this but we'll worry about them later since they don't come up as often.
     if (!bin_expr->getResultNeeded()) {
-      if (sym->getSubType() == SYM_GLOBAL)
-        mStr << "self.";
-      mStr << getSymbolName(sym) << " = ";
+      writeSymbolRef(sym);
+      mStr << " = ";
       if (auto *member = lvalue->getMember()) {
         constructMutatedMember(sym, member, rhs);
       } else {
         rhs->visit(this);
       }
     } else {
-      if (sym->getSubType() == SYM_GLOBAL) {
-        // walrus operator can't assign to these, need to use special assignment helper.
-        mStr << "assign(self.__dict__, \"" << getSymbolName(sym) << "\", ";
-      } else {
-        // We need to wrap this assignment in parens so we can use the walrus operator.
-        // walrus operator works regardless of expression or statement context, but doesn't
-        // work for cases like `(self.foo := 2)` where we're assigning to an attribute rather than
-        // just a single identifier...
-        mStr << '(' << getSymbolName(sym) << " := ";
-      }
-
-      if (auto *member = lvalue->getMember()) {
-        constructMutatedMember(sym, member, rhs);
-      } else {
-        rhs->visit(this);
-      }
-      mStr << ')';
+      writeExprAssign(sym, [&]() {
+        if (auto *member = lvalue->getMember()) {
+          constructMutatedMember(sym, member, rhs);
+        } else {
+          rhs->visit(this);
+        }
+      });
       if (auto *member = lvalue->getMember()) {
         mStr << '[' << member_to_offset(member->getName()) << ']';
       }
@@ -443,48 +790,264 @@ bool PythonVisitor::visit(LSLBinaryExpression *bin_expr) {
   if (op == OP_MUL_ASSIGN) {
     // int *= float case
     auto *sym = lhs->getSymbol();
-    if (sym->getSubType() == SYM_GLOBAL) {
-      // walrus operator can't assign to these, need to use special assignment helper.
-      mStr << "assign(self.__dict__, \"" << getSymbolName(sym) << "\", ";
-    } else {
-      mStr << '(' << getSymbolName(sym) << " := ";
-    }
     // don't have to consider the member case, no such thing as coordinates with int members.
-    mStr << "typecast(rmul(";
-    rhs->visit(this);
-    mStr << ", ";
-    lhs->visit(this);
-    mStr << "), int))";
+    writeExprAssign(sym, [&]() {
+      writeHelper("typecast");
+      mStr << '(';
+      writeHelper("rmul");
+      mStr << '(';
+      rhs->visit(this);
+      mStr << ", ";
+      lhs->visit(this);
+      mStr << "), int)";
+    });
+    return false;
+  }
+  if (_mOptions.elide_int_wraparound && writePlainIntOp(bin_expr))
     return false;
+  // Generated scripts can have chains like `a + b + c + ...` with thousands of operands.
+  // Walk down their left side in a loop rather than recursing once per operand, stopping
+  // at anything that might want to be written as a plain int op instead.
+  auto chain = collect_left_chain(bin_expr, [this](LSLBinaryExpression *link) {
+    return !_mOptions.elide_int_wraparound || _mIntRanges.canWrap(link);
+  });
+  if (_mOptions.max_expression_depth > 0 && getExprDepth(bin_expr) > _mOptions.max_expression_depth) {
+    writeFlattenedChain(chain);
+    return false;
+  }
+  for (auto *link : chain) {
+    writeHelper(getBinaryHelperName(link->getOperation()));
+    mStr << '(';
+    link->getRHS()->visit(this);
+    mStr << ", ";
+  }
+  chain.back()->getLHS()->visit(this);
+  for (size_t i = 0; i < chain.size(); ++i)
+    mStr << ')';
+  return false;
+}
+
+void PythonVisitor::writeFlattenedChain(const std::vector<LSLBinaryExpression *> &chain) {
+  // Splits the chain into segments nested no deeper than `max_expression_depth`, each of which
+  // becomes an element of a flat tuple that passes its result to the next through a temporary:
+  // `((flat0 := radd(c, radd(b, a))), (flat1 := radd(e, radd(d, flat0))))[-1]`
+  //
+  // Operands too deep to fit in any segment get a temporary of their own. Chains within them
+  // put their own segments in the same tuple, ahead of the operand, so it never nests.
+  //
+  // LSL evaluates every right operand outside-in before anything else, so right operands
+  // of outer segments would now be evaluated late. If anything in the chain has side
+  // effects, those get captured up front in their original order.
+  int max_depth = _mOptions.max_expression_depth;
+  size_t num_links = chain.size();
+  auto *innermost = chain.back()->getLHS();
+  bool any_side_effects = has_side_effects(innermost);
+  for (auto *link : chain)
+    any_side_effects = any_side_effects || has_side_effects(link->getRHS());
+
+  // Anything that needs a temporary has to be evaluated before the first segment
+  std::vector<bool> captured(num_links);
+  size_t capture_end = 0;
+  for (size_t i = 0; i < num_links; ++i) {
+    if (getExprDepth(chain[i]->getRHS()) >= max_depth) {
+      captured[i] = true;
+      capture_end = i + 1;
+    }
+  }
+  bool capture_innermost = getExprDepth(innermost) >= max_depth;
+  if (capture_innermost)
+    capture_end = num_links;
+
+  // Find where each segment starts, working outwards from the innermost link
+  std::vector<size_t> seg_starts;
+  int inner_depth = capture_innermost ? 0 : getExprDepth(innermost);
+  for (size_t seg_end = num_links; seg_end; seg_end = seg_starts.back()) {
+    size_t seg_start = seg_end;
+    int seg_depth = inner_depth;
+    while (seg_start) {
+      auto *rhs = chain[seg_start - 1]->getRHS();
+      int link_depth = std::max(seg_depth, captured[seg_start - 1] ? 0 : getExprDepth(rhs)) + 1;
+      if (seg_start != seg_end && link_depth > max_depth)
+        break;
+      seg_depth = link_depth;
+      --seg_start;
+    }
+    seg_starts.push_back(seg_start);
+    // every segment after the first nests around the previous one's temporary
+    inner_depth = 0;
+  }
+  if (any_side_effects) {
+    capture_end = std::max(capture_end, seg_starts.front());
+    for (size_t i = 0; i < capture_end; ++i)
+      captured[i] = captured[i] || chain[i]->getRHS()->getNodeSubType() != NODE_CONSTANT_EXPRESSION;
+  }
+
+  // Only a chain that's getting a temporary of its own can put its pieces ahead of it in
+  // an outer chain's tuple. Anywhere else, they'd run before things that should come first.
+  std::vector<std::string> spills;
+  auto *outer_spills = _mFlatSpills;
+  bool joins_outer = outer_spills && chain.front() == _mSpillingExpr;
+  if (!joins_outer)
+    _mFlatSpills = &spills;
+
+  std::vector<std::string> operand_temps(num_links);
+  for (size_t i = 0; i < num_links; ++i) {
+    if (captured[i])
+      operand_temps[i] = spillToTemp(chain[i]->getRHS());
+  }
+  std::string prev_temp;
+  if (capture_innermost)
+    prev_temp = spillToTemp(innermost);
+
+  // The outermost segment is written in place, the rest go before it
+  std::stringstream orig_stream(std::move(mStr));
+  size_t seg_end = num_links;
+  for (size_t seg_start : seg_starts) {
+    mStr = std::stringstream();
+    for (size_t i = seg_start; i < seg_end; ++i) {
+      writeHelper(getBinaryHelperName(chain[i]->getOperation()));
+      mStr << '(';
+      if (!operand_temps[i].empty())
+        mStr << operand_temps[i];
+      else
+        chain[i]->getRHS()->visit(this);
+      mStr << ", ";
+    }
+    if (prev_temp.empty())
+      innermost->visit(this);
+    else
+      mStr << prev_temp;
+    for (size_t i = seg_start; i < seg_end; ++i)
+      mStr << ')';
+    if (seg_start) {
+      prev_temp = "flat" + std::to_string(_mFlatTemps++);
+      _mFlatSpills->push_back("(" + prev_temp + " := " + mStr.str() + ")");
+    }
+    seg_end = seg_start;
+  }
+  std::string outer_segment {mStr.str()};
+  mStr = std::move(orig_stream);
+
+  _mFlatSpills = outer_spills;
+  if (joins_outer || spills.empty()) {
+    mStr << outer_segment;
+    return;
   }
+  mStr << '(';
+  for (const auto &spill : spills)
+    mStr << spill << ", ";
+  mStr << outer_segment << ")[-1]";
+}
+
+std::string PythonVisitor::spillToTemp(LSLExpression *expr) {
+  // Anything `expr` needs to spill itself goes first
+  auto *outer_spilling = _mSpillingExpr;
+  _mSpillingExpr = expr;
+  while (_mSpillingExpr->getNodeSubType() == NODE_PARENTHESIS_EXPRESSION)
+    _mSpillingExpr = ((LSLParenthesisExpression *) _mSpillingExpr)->getChildExpr();
+  std::stringstream orig_stream(std::move(mStr));
+  mStr = std::stringstream();
+  expr->visit(this);
+  _mSpillingExpr = outer_spilling;
+  std::string temp = "flat" + std::to_string(_mFlatTemps++);
+  _mFlatSpills->push_back("(" + temp + " := " + mStr.str() + ")");
+  mStr = std::move(orig_stream);
+  return temp;
+}
+
+int PythonVisitor::getExprDepth(LSLASTNode *expr) {
+  // Worked out without recursing, expressions can be thousands of levels deep.
+  std::vector<std::pair<LSLASTNode *, bool>> pending {{expr, false}};
+  while (!pending.empty()) {
+    auto *node = pending.back().first;
+    bool children_done = pending.back().second;
+    pending.pop_back();
+    if (_mExprDepths.find(node) != _mExprDepths.end())
+      continue;
+    auto node_type = node->getNodeSubType();
+    // Nothing in these nests any deeper
+    if (node_type == NODE_LVALUE_EXPRESSION || node_type == NODE_CONSTANT_EXPRESSION) {
+      _mExprDepths[node] = 0;
+      continue;
+    }
+    if (!children_done) {
+      pending.emplace_back(node, true);
+      for (auto *child : *node)
+        pending.emplace_back(child, false);
+      continue;
+    }
+    int depth = 0;
+    for (auto *child : *node)
+      depth = std::max(depth, _mExprDepths[child]);
+    switch (node_type) {
+      // these are all written as calls or parenthesized
+      case NODE_BINARY_EXPRESSION:
+      case NODE_UNARY_EXPRESSION:
+      case NODE_FUNCTION_EXPRESSION:
+      case NODE_TYPECAST_EXPRESSION:
+      case NODE_PARENTHESIS_EXPRESSION:
+      case NODE_BOOL_CONVERSION_EXPRESSION:
+      // and these in brackets or a constructor call
+      case NODE_VECTOR_EXPRESSION:
+      case NODE_QUATERNION_EXPRESSION:
+      case NODE_LIST_EXPRESSION:
+        ++depth;
+        break;
+      default:
+        break;
+    }
+    _mExprDepths[node] = depth;
+  }
+  return _mExprDepths[expr];
+}
+
+const char *PythonVisitor::getBinaryHelperName(LSLOperator op) {
   switch(op) {
-    case '+':            mStr << "radd("; break;
-    case '-':            mStr << "rsub("; break;
-    case '*':            mStr << "rmul("; break;
-    case '/':            mStr << "rdiv("; break;
-    case '%':            mStr << "rmod("; break;
-    case OP_EQ:          mStr << "req("; break;
-    case OP_NEQ:         mStr << "rneq("; break;
-    case OP_GREATER:     mStr << "rgreater("; break;
-    case OP_LESS:        mStr << "rless("; break;
-    case OP_GEQ:         mStr << "rgeq("; break;
-    case OP_LEQ:         mStr << "rleq("; break;
-    case OP_BOOLEAN_AND: mStr << "rbooland("; break;
-    case OP_BOOLEAN_OR:  mStr << "rboolor("; break;
-    case OP_BIT_AND:     mStr << "rbitand("; break;
-    case OP_BIT_OR:      mStr << "rbitor("; break;
-    case OP_BIT_XOR:     mStr << "rbitxor("; break;
-    case OP_SHIFT_LEFT:  mStr << "rshl("; break;
-    case OP_SHIFT_RIGHT: mStr << "rshr("; break;
+    case '+':            return "radd";
+    case '-':            return "rsub";
+    case '*':            return "rmul";
+    case '/':            return "rdiv";
+    case '%':            return "rmod";
+    case OP_EQ:          return "req";
+    case OP_NEQ:         return "rneq";
+    case OP_GREATER:     return "rgreater";
+    case OP_LESS:        return "rless";
+    case OP_GEQ:         return "rgeq";
+    case OP_LEQ:         return "rleq";
+    case OP_BOOLEAN_AND: return "rbooland";
+    case OP_BOOLEAN_OR:  return "rboolor";
+    case OP_BIT_AND:     return "rbitand";
+    case OP_BIT_OR:      return "rbitor";
+    case OP_BIT_XOR:     return "rbitxor";
+    case OP_SHIFT_LEFT:  return "rshl";
+    case OP_SHIFT_RIGHT: return "rshr";
     default:
       assert(0);
-      mStr << "<ERROR>";
+      return "<ERROR>";
   }
-  rhs->visit(this);
-  mStr << ", ";
-  lhs->visit(this);
+}
+
+bool PythonVisitor::writePlainIntOp(LSLBinaryExpression *bin_expr) {
+  if (_mIntRanges.canWrap(bin_expr))
+    return false;
+  auto op = bin_expr->getOperation();
+  auto *lhs = bin_expr->getLHS();
+  auto *rhs = bin_expr->getRHS();
+  LSLExpression *first = lhs, *second = rhs;
+  if (has_side_effects(lhs) || has_side_effects(rhs)) {
+    // LSL evaluates the right operand first, we can only swap the operands
+    // around to get the same order if the operation is commutative.
+    if (op == '-')
+      return false;
+    first = rhs;
+    second = lhs;
+  }
+  mStr << '(';
+  first->visit(this);
+  mStr << ' ' << (char)op << ' ';
+  second->visit(this);
   mStr << ')';
-  return false;
+  return true;
 }
 
 bool PythonVisitor::visit(LSLUnaryExpression *unary_expr) {
@@ -495,38 +1058,64 @@ bool PythonVisitor::visit(LSLUnaryExpression *unary_expr) {
     int negative = op == OP_POST_DECR || op == OP_PRE_DECR;
     auto *lvalue = (LSLLValueExpression *) child_expr;
     auto *sym = lvalue->getSymbol();
-    bool global = sym->getSubType() == SYM_GLOBAL;
     auto *member = lvalue->getMember();
 
-    if (unary_expr->getResultNeeded() || member) {
+    if (unary_expr->getResultNeeded() && _mOptions.typed_output) {
+      // No frame hacks allowed, assign the new value with a walrus or setter instead.
+      // Post-increments stash the old value in a tuple alongside the assignment.
+      if (post) {
+        mStr << '(';
+        child_expr->visit(this);
+        mStr << ", ";
+      }
+      writeExprAssign(sym, [&]() {
+        auto write_new_val = [&]() {
+          writeHelper(negative ? "rsub" : "radd");
+          mStr << '(';
+          child_expr->getType()->getOneValue()->visit(this);
+          mStr << ", ";
+          child_expr->visit(this);
+          mStr << ')';
+        };
+        if (member)
+          writeMutatedCoord(sym, member_to_offset(member->getName()), write_new_val);
+        else
+          write_new_val();
+      });
+      if (post)
+        mStr << ")[0]";
+      else if (member)
+        mStr << '[' << member_to_offset(member->getName()) << ']';
+    } else if (unary_expr->getResultNeeded()) {
       // this is in expression context, not statement context. We need to emulate the
       // side-effects of ++foo and foo++ in an expression, since that construct doesn't exist
       // in python.
-      if (post)
-        mStr << "post";
-      else
-        mStr << "pre";
-
-      if (negative)
-        mStr << "decr";
-      else
-        mStr << "incr";
-
+      writeHelper(post ? (negative ? "postdecr" : "postincr") : (negative ? "predecr" : "preincr"));
       mStr << '(';
-      if (global)
+      if (isSelfAttribute(sym))
         mStr << "self.__dict__";
       else
         mStr << "locals()";
-      mStr << ", \"" << getSymbolName(sym) << "\"";
+      mStr << ", \"" << getSymbolRefName(sym) << "\"";
       if (auto *member = lvalue->getMember()) {
         mStr << ", " << member_to_offset(member->getName());
       }
       mStr << ')';
+    } else if (member) {
+      // in statement context we can just assign a new coordinate with the member changed.
+      writeSymbolRef(sym);
+      mStr << " = ";
+      writeMutatedCoord(sym, member_to_offset(member->getName()), [&]() {
+        writeHelper(negative ? "rsub" : "radd");
+        mStr << '(';
+        child_expr->getType()->getOneValue()->visit(this);
+        mStr << ", ";
+        writeSymbolRef(sym);
+        mStr << '[' << member_to_offset(member->getName()) << "])";
+      });
     } else {
       // in statement context, we can use the more idiomatic foo += 1 or foo -= 1.
-      if (sym->getSubType() == SYM_GLOBAL)
-        mStr << "self.";
-      mStr << getSymbolName(sym);
+      writeSymbolRef(sym);
       if (op == OP_POST_DECR || op == OP_PRE_DECR) {
         mStr << " -= ";
       } else {
@@ -537,14 +1126,22 @@ bool PythonVisitor::visit(LSLUnaryExpression *unary_expr) {
     return false;
   }
 
+  if (op == '-' && _mOptions.elide_int_wraparound && !_mIntRanges.canWrap(unary_expr)) {
+    mStr << "(-";
+    child_expr->visit(this);
+    mStr << ')';
+    return false;
+  }
+
   switch (op) {
-    case '-': mStr << "neg("; break;
-    case '~': mStr << "bitnot("; break;
-    case '!': mStr << "boolnot("; break;
+    case '-': writeHelper("neg"); break;
+    case '~': writeHelper("bitnot"); break;
+    case '!': writeHelper("boolnot"); break;
     default:
       assert(0);
       mStr << "<ERROR>";
   }
+  mStr << '(';
   child_expr->visit(this);
   mStr << ')';
   return false;
@@ -565,7 +1162,8 @@ bool PythonVisitor::visit(LSLParenthesisExpression *parens_expr) {
 }
 
 bool PythonVisitor::visit(LSLBoolConversionExpression *bool_expr) {
-  mStr << "cond(";
+  writeHelper("cond");
+  mStr << '(';
   bool_expr->getChildExpr()->visit(this);
   mStr << ")";
   return false;
@@ -580,7 +1178,13 @@ bool PythonVisitor::visit(LSLNopStatement *nop_stmt) {
 
 bool PythonVisitor::visit(LSLCompoundStatement *compound_stmt) {
   if (compound_stmt->hasChildren()) {
+    auto start_pos = mStr.tellp();
     visitChildren(compound_stmt);
+    // everything in here may have been eliminated
+    if (mStr.tellp() == start_pos) {
+      doTabs();
+      mStr << "pass\n";
+    }
   } else {
     doTabs();
     mStr << "pass\n";
@@ -589,15 +1193,89 @@ bool PythonVisitor::visit(LSLCompoundStatement *compound_stmt) {
 }
 
 bool PythonVisitor::visit(LSLExpressionStatement *expr_stmt) {
+  if (!writeExprLine(expr_stmt->getExpr()))
+    writeRemovedStatement(expr_stmt);
+  return false;
+}
+
+bool PythonVisitor::isDeadVar(LSLSymbol *sym) {
+  if (!_mOptions.eliminate_dead_vars)
+    return false;
+  switch (sym->getSubType()) {
+    case SYM_LOCAL:
+      return _mVarUsage.mRead.find(sym) == _mVarUsage.mRead.end();
+    case SYM_GLOBAL:
+      return _mVarUsage.mRead.find(sym) == _mVarUsage.mRead.end();
+    default:
+      return false;
+  }
+}
+
+bool PythonVisitor::isFuncKept(LSLSymbol *func_sym) {
+  return !_mOptions.tree_shaker || _mOptions.tree_shaker->isKept(func_sym);
+}
+
+LSLSymbol *PythonVisitor::resolveFunc(LSLSymbol *func_sym) {
+  if (!_mOptions.tree_shaker)
+    return func_sym;
+  return _mOptions.tree_shaker->resolve(func_sym);
+}
+
+bool PythonVisitor::isDeadStore(LSLExpression *expr) {
+  if (expr->getNodeSubType() != NODE_BINARY_EXPRESSION)
+    return false;
+  auto *bin_expr = (LSLBinaryExpression *) expr;
+  if (bin_expr->getOperation() != '=')
+    return false;
+  if (_mDeadStores.mDeadStores.find(bin_expr) != _mDeadStores.mDeadStores.end())
+    return true;
+  auto *sym = bin_expr->getLHS()->getSymbol();
+  return (sym->getSubType() == SYM_LOCAL || sym->getSubType() == SYM_GLOBAL) && isDeadVar(sym);
+}
+
+bool PythonVisitor::writeExprLine(LSLExpression *expr) {
+  // Stores to dead variables only need to keep the side effects of the value being stored
+  if (isDeadStore(expr)) {
+    expr = ((LSLBinaryExpression *) expr)->getRHS();
+    if (!has_side_effects(expr))
+      return false;
+  }
   doTabs();
-  expr_stmt->getExpr()->visit(this);
+  expr->visit(this);
   mStr << '\n';
-  return false;
+  return true;
+}
+
+void PythonVisitor::writeRemovedStatement(LSLASTNode *stmt) {
+  // Compound statements will write a `pass` if they end up empty, but
+  // something like an `if` with a single statement as its body won't.
+  if (stmt->getParent()->getNodeSubType() != NODE_COMPOUND_STATEMENT) {
+    doTabs();
+    mStr << "pass\n";
+  }
 }
 
 bool PythonVisitor::visit(LSLDeclaration *decl_stmt) {
-  doTabs();
   auto *sym = decl_stmt->getSymbol();
+  bool dead_var = isDeadVar(sym);
+  if (dead_var || _mDeadStores.mDeadStores.find(decl_stmt) != _mDeadStores.mDeadStores.end()) {
+    auto *initializer = decl_stmt->getInitializer();
+    bool wrote_initializer = initializer && has_side_effects(initializer);
+    if (wrote_initializer) {
+      doTabs();
+      initializer->visit(this);
+      mStr << '\n';
+    }
+    if (!dead_var) {
+      // Every path stores something else before reading it, it only needs its type.
+      doTabs();
+      mStr << getSymbolName(sym) << ": " << getTypeAnnotation(sym->getIType()) << '\n';
+    } else if (!wrote_initializer) {
+      writeRemovedStatement(decl_stmt);
+    }
+    return false;
+  }
+  doTabs();
 
   if (_mFuncSym->getHasUnstructuredJumps()) {
     // get down to our nasty declaration hoisting business.
@@ -640,7 +1318,7 @@ bool PythonVisitor::visit(LSLDeclaration *decl_stmt) {
     mStr << getSymbolName(sym) << " = ";
   } else {
     // don't need hoisting, do the declaration inline
-    mStr << getSymbolName(sym) << ": " << PY_TYPE_NAMES[sym->getIType()] << " = ";
+    mStr << getSymbolName(sym) << ": " << getTypeAnnotation(sym->getIType()) << " = ";
   }
 
   LSLASTNode *initializer = decl_stmt->getInitializer();
@@ -652,10 +1330,70 @@ bool PythonVisitor::visit(LSLDeclaration *decl_stmt) {
   return false;
 }
 
+bool PythonVisitor::usingSwitchDispatch() {
+  // Switches would hide which branches were taken from the profile
+  return _mOptions.switch_dispatch && !_mOptions.instrument && !_mFuncIsCold;
+}
+
+bool PythonVisitor::writeSpecialChain(LSLIfStatement *if_stmt, bool dry_run) {
+  SwitchChain chain;
+  if (usingSwitchDispatch() && find_switch_chain(if_stmt, chain)) {
+    if (!dry_run)
+      writeSwitch(chain);
+    return true;
+  }
+  if (!_mOptions.profile || _mOptions.instrument)
+    return false;
+
+  // Only one case of a switch-like chain can match, so if the profile says later cases
+  // match more often than earlier ones we can check them first.
+  chain = SwitchChain();
+  collect_switch_chain(if_stmt, chain);
+  std::vector<size_t> case_order;
+  for (size_t i = 0; i < chain.cases.size(); ++i)
+    case_order.push_back(i);
+  std::stable_sort(case_order.begin(), case_order.end(), [&](size_t a, size_t b) {
+    return _mOptions.profile->getBranch(chain.cases[a].if_stmt).taken
+        > _mOptions.profile->getBranch(chain.cases[b].if_stmt).taken;
+  });
+  if (std::is_sorted(case_order.begin(), case_order.end()))
+    return false;
+  if (dry_run)
+    return true;
+
+  for (size_t i = 0; i < case_order.size(); ++i) {
+    const auto &switch_case = chain.cases[case_order[i]];
+    doTabs();
+    mStr << (i ? "elif " : "if ");
+    writeIfCheck(switch_case.if_stmt);
+    mStr << ":\n";
+    ScopedTabSetter tab_setter(this, mTabs + 1);
+    switch_case.body->visit(this);
+  }
+  if (chain.default_body) {
+    doTabs();
+    mStr << "else:\n";
+    ScopedTabSetter tab_setter(this, mTabs + 1);
+    chain.default_body->visit(this);
+  }
+  return true;
+}
+
+void PythonVisitor::writeIfCheck(LSLIfStatement *if_stmt) {
+  if (_mOptions.instrument)
+    mStr << "self.profile.record_branch(\"" << get_profile_key(if_stmt) << "\", ";
+  if_stmt->getCheckExpr()->visit(this);
+  if (_mOptions.instrument)
+    mStr << ')';
+}
+
 bool PythonVisitor::visit(LSLIfStatement *if_stmt) {
+  if (writeSpecialChain(if_stmt, false))
+    return false;
+
   doTabs();
   mStr << "if ";
-  if_stmt->getCheckExpr()->visit(this);
+  writeIfCheck(if_stmt);
   mStr << ":\n";
   {
     ScopedTabSetter tab_setter(this, mTabs + 1);
@@ -665,6 +1403,9 @@ bool PythonVisitor::visit(LSLIfStatement *if_stmt) {
   if(auto *false_branch = if_stmt->getFalseBranch()) {
     doTabs();
     bool chained_if = false_branch->getNodeSubType() == NODE_IF_STATEMENT;
+    // can't be an `elif` if the rest of the chain gets special treatment
+    if (chained_if)
+      chained_if = !writeSpecialChain((LSLIfStatement *) false_branch, true);
     if (chained_if) {
       mStr << "el";
       // make the "if" branch's "if" merge into an "elif", no leading tab!
@@ -679,13 +1420,126 @@ bool PythonVisitor::visit(LSLIfStatement *if_stmt) {
   return false;
 }
 
-bool PythonVisitor::visit(LSLForStatement *for_stmt) {
-  // initializer expressions come as ExpressionStatements before the actual loop
-  for (auto *init_expr : *for_stmt->getInitExprs()) {
+void PythonVisitor::writeSwitch(const SwitchChain &chain) {
+  // The case values live in a dict at the module level mapping them to their index
+  // in the chain, then we only need to binary search on the index to find the case.
+  std::string table_name = "switch" + std::to_string(_mSwitchTables.size());
+  std::string idx_name = table_name + "_idx";
+  std::stringstream orig_stream(std::move(mStr));
+  mStr = std::stringstream();
+  mStr << table_name << " = {";
+  for (size_t i = 0; i < chain.cases.size(); ++i) {
+    if (i)
+      mStr << ", ";
+    chain.cases[i].value->visit(this);
+    mStr << ": " << i;
+  }
+  mStr << "}\n";
+  _mSwitchTables.push_back(mStr.str());
+  mStr = std::move(orig_stream);
+
+  doTabs();
+  mStr << idx_name << " = " << table_name << ".get(";
+  chain.subject->visit(this);
+  // the default case comes after all the others
+  mStr << ", " << chain.cases.size() << ")\n";
+  writeSwitchTree(chain, idx_name, 0, chain.cases.size());
+}
+
+void PythonVisitor::writeSwitchTree(const SwitchChain &chain, const std::string &idx_name, size_t first, size_t last) {
+  if (first == last) {
+    LSLASTNode *body = (first < chain.cases.size()) ? chain.cases[first].body : chain.default_body;
+    if (body) {
+      body->visit(this);
+    } else {
+      doTabs();
+      mStr << "pass\n";
+    }
+    return;
+  }
+  size_t mid = (first + last + 1) / 2;
+  doTabs();
+  mStr << "if " << idx_name << " < " << mid << ":\n";
+  {
+    ScopedTabSetter tab_setter(this, mTabs + 1);
+    writeSwitchTree(chain, idx_name, first, mid - 1);
+  }
+  doTabs();
+  mStr << "else:\n";
+  {
+    ScopedTabSetter tab_setter(this, mTabs + 1);
+    writeSwitchTree(chain, idx_name, mid, last);
+  }
+}
+
+bool PythonVisitor::isHotLoop(LSLASTNode *loop_stmt) {
+  if (!_mOptions.profile)
+    return true;
+  // Not worth the setup and writeback unless the loop usually goes around more than once
+  const auto &loop_profile = _mOptions.profile->getLoop(loop_stmt);
+  return loop_profile.entries && loop_profile.iterations >= loop_profile.entries * 2;
+}
+
+void PythonVisitor::writeLoopEntryHook(LSLASTNode *loop_stmt) {
+  if (!_mOptions.instrument)
+    return;
+  doTabs();
+  mStr << "self.profile.record_loop_entry(\"" << get_profile_key(loop_stmt) << "\")\n";
+}
+
+void PythonVisitor::writeLoopIterationHook(LSLASTNode *loop_stmt) {
+  if (!_mOptions.instrument)
+    return;
+  doTabs();
+  mStr << "self.profile.record_loop_iteration(\"" << get_profile_key(loop_stmt) << "\")\n";
+}
+
+bool PythonVisitor::promoteLoopGlobals(LSLASTNode *loop_stmt) {
+  // nested loops just keep using the outermost loop's promoted locals
+  if (!_mOptions.promote_loop_globals || !_mPromotedGlobals.empty())
+    return false;
+  if (!isHotLoop(loop_stmt))
+    return false;
+
+  LoopGlobalsVisitor globals_visitor;
+  loop_stmt->visit(&globals_visitor);
+  // Globals nothing reads don't exist on `self` at all, their stores are dropped.
+  globals_visitor.mGlobals.erase(std::remove_if(
+      globals_visitor.mGlobals.begin(), globals_visitor.mGlobals.end(),
+      [this](LSLSymbol *sym) { return isDeadVar(sym); }
+  ), globals_visitor.mGlobals.end());
+  if (!globals_visitor.mPromotable || globals_visitor.mGlobals.empty())
+    return false;
+
+  for (auto *sym : globals_visitor.mGlobals) {
     doTabs();
-    init_expr->visit(this);
-    mStr << '\n';
+    _mPromotedGlobals[sym] = "promoted_" + getSymbolName(sym);
+    mStr << _mPromotedGlobals[sym] << " = self." << getSymbolName(sym) << '\n';
+  }
+  // keep the order they were used in so the output is stable
+  _mPromotedGlobalsOrder = std::move(globals_visitor.mGlobals);
+  return true;
+}
+
+void PythonVisitor::writePromotedGlobalsBack() {
+  for (auto *sym : _mPromotedGlobalsOrder) {
+    doTabs();
+    mStr << "self." << getSymbolName(sym) << " = " << _mPromotedGlobals[sym] << '\n';
   }
+}
+
+void PythonVisitor::endLoopGlobalPromotion() {
+  writePromotedGlobalsBack();
+  _mPromotedGlobals.clear();
+  _mPromotedGlobalsOrder.clear();
+}
+
+bool PythonVisitor::visit(LSLForStatement *for_stmt) {
+  bool promoted = promoteLoopGlobals(for_stmt);
+  // initializer expressions come as ExpressionStatements before the actual loop
+  for (auto *init_expr : *for_stmt->getInitExprs())
+    writeExprLine((LSLExpression *) init_expr);
+  writeLoopEntryHook(for_stmt);
   // all loops are represented as `while`s in Python for consistency
   // since LSL's loop semantics are different from Python's
   doTabs();
@@ -706,33 +1560,41 @@ bool PythonVisitor::visit(LSLForStatement *for_stmt) {
       mStr << "break\n";
     }
 
+    writeLoopIterationHook(for_stmt);
     for_stmt->getBody()->visit(this);
-    for (auto *incr_expr : *for_stmt->getIncrExprs()) {
-      doTabs();
-      incr_expr->visit(this);
-      mStr << '\n';
-    }
+    for (auto *incr_expr : *for_stmt->getIncrExprs())
+      writeExprLine((LSLExpression *) incr_expr);
   }
+  if (promoted)
+    endLoopGlobalPromotion();
   return false;
 }
 
 bool PythonVisitor::visit(LSLWhileStatement *while_stmt) {
+  bool promoted = promoteLoopGlobals(while_stmt);
+  writeLoopEntryHook(while_stmt);
   doTabs();
   mStr << "while ";
   while_stmt->getCheckExpr()->visit(this);
   mStr << ":\n";
   {
     ScopedTabSetter tab_setter_1(this, mTabs + 1);
+    writeLoopIterationHook(while_stmt);
     while_stmt->getBody()->visit(this);
   }
+  if (promoted)
+    endLoopGlobalPromotion();
   return false;
 }
 
 bool PythonVisitor::visit(LSLDoStatement *do_stmt) {
+  bool promoted = promoteLoopGlobals(do_stmt);
+  writeLoopEntryHook(do_stmt);
   doTabs();
   mStr << "while True == True:\n";
   {
     ScopedTabSetter tab_setter_1(this, mTabs + 1);
+    writeLoopIterationHook(do_stmt);
     do_stmt->getBody()->visit(this);
     doTabs();
     mStr << "if not ";
@@ -744,10 +1606,26 @@ bool PythonVisitor::visit(LSLDoStatement *do_stmt) {
       mStr << "break\n";
     }
   }
+  if (promoted)
+    endLoopGlobalPromotion();
   return false;
 }
 
+void PythonVisitor::addError(LSLASTNode *node, const std::string &message) {
+  auto *loc = node->getLoc();
+  char loc_buf[64];
+  snprintf(loc_buf, sizeof(loc_buf), "ERROR:: (%3d,%3d): ", loc->first_line, loc->first_column);
+  mErrors.push_back(loc_buf + message);
+}
+
 bool PythonVisitor::visit(LSLJumpStatement *jump_stmt) {
+  if (_mOptions.typed_output) {
+    // There's no goto without bytecode patching
+    addError(jump_stmt, "jumps can't be used in typed output");
+    return false;
+  }
+  // Promoted loops can't contain labels, so this must be jumping out of the loop.
+  writePromotedGlobalsBack();
   doTabs();
   // We could check `continueLike` or `breakLike` here, but
   // LSL's `for` semantics differ from Python's, so we'd have to use
@@ -758,6 +1636,10 @@ bool PythonVisitor::visit(LSLJumpStatement *jump_stmt) {
 }
 
 bool PythonVisitor::visit(LSLLabel *label_stmt) {
+  if (_mOptions.typed_output) {
+    addError(label_stmt, "labels can't be used in typed output");
+    return false;
+  }
   doTabs();
   mStr << "label ." << getSymbolName(label_stmt->getSymbol()) << "\n";
   return false;
@@ -783,6 +1665,7 @@ bool PythonVisitor::visit(LSLReturnStatement *return_stmt) {
 }
 
 void PythonVisitor::writeReturn(LSLExpression *ret_expr) {
+  writePromotedGlobalsBack();
   doTabs();
   if (ret_expr) {
     mStr << "return ";
@@ -1,18 +1,82 @@
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
 #include <tailslide/tailslide.hh>
 #include <tailslide/passes/desugaring.hh>
 
+#include "ast_utils.hh"
+#include "int_ranges.hh"
+#include "script_profile.hh"
+#include "switch_detection.hh"
+#include "tree_shaking.hh"
+
 namespace Tailslide {
+
+struct PythonCompilationOptions {
+  // Emit each function and event handler as a separately compiled unit that
+  // only gets `exec`ed the first time it's looked up on the `Script` class.
+  bool lazy_methods = false;
+  // Cache globals in Python locals for the duration of loops that can't
+  // observe them through calls, writing them back when the loop is left.
+  bool promote_loop_globals = false;
+  // Use plain Python arithmetic for integer operations that provably can't
+  // overflow an int32, rather than going through the wrapping helpers.
+  bool elide_int_wraparound = false;
+  // Skip casts that can't change their operand, and use plain Python
+  // expressions for casts that don't need the generic `typecast()`.
+  bool simplify_casts = false;
+  // Bind runtime helpers as keyword-only defaults of each method, and look up
+  // methods that get called repeatedly once per call of the calling function.
+  bool bind_helpers = false;
+  // Dispatch long `if` chains comparing a variable against constants through a dict
+  bool switch_dispatch = false;
+  // Generate plain synchronous, strictly typed code that mypyc can compile.
+  // No frame hacks or bytecode patching, so scripts using `jump` are rejected.
+  bool typed_output = false;
+  // Record call counts, branch outcomes and loop trip counts into `self.profile`
+  bool instrument = false;
+  // Profile from an instrumented run. Cases of switch-like `if` chains get checked
+  // in order of how often they matched, and code that never ran or loops that rarely
+  // repeat don't get optimizations that trade code size for speed.
+  const ScriptProfile *profile = nullptr;
+  // Drop locals that are never read along with their stores, and globals that
+  // are never referenced at all. Stores to globals are kept since they may be
+  // observed from outside the script.
+  bool eliminate_dead_vars = false;
+  // Functions that can't be called are left out, and identical functions share one
+  // definition, with the duplicates left as aliases of it.
+  const TreeShaker *tree_shaker = nullptr;
+  // Chains of binary operations with more links than this get split into segments
+  // sequenced through temporaries, so CPython doesn't choke on deeply nested calls.
+  // 0 means no limit.
+  int max_expression_depth = 0;
+};
+
 class PythonVisitor : public ASTVisitor {
+  public:
+  explicit PythonVisitor(PythonCompilationOptions options={}) : _mOptions(options) {}
+
   protected:
   void writeChildrenSep(LSLASTNode *parent, const char *separator);
   void writeFloat(float f_val);
+  const char *getTypeAnnotation(LSLIType type);
   std::string getSymbolName(LSLSymbol *sym);
+  std::string getSymbolRefName(LSLSymbol *sym);
+  bool isSelfAttribute(LSLSymbol *sym);
+  void writeSymbolRef(LSLSymbol *sym);
+  void writeHelper(const char *name);
+  std::string getHandlerName(LSLEventHandler *event_handler);
+  std::string getFuncLikeName(LSLASTNode *func_like);
 
   virtual bool visit(LSLScript *script);
   virtual bool visit(LSLGlobalVariable *glob_var);
   virtual bool visit(LSLGlobalFunction *glob_func);
   virtual bool visit(LSLEventHandler *event_handler);
-  void visitFuncLike(LSLASTNode *func_like, LSLASTNode *body);
+  void visitFuncLike(LSLASTNode *func_like, LSLASTNode *body, const char *ret_type);
+  void bindMethods(LSLASTNode *body);
+  void writeLazyMethod(LSLASTNode *func_like, const std::string &method_name);
 
   virtual bool visit(LSLIntegerConstant *int_const);
   virtual bool visit(LSLFloatConstant *float_const);
@@ -25,10 +89,18 @@ class PythonVisitor : public ASTVisitor {
   virtual bool visit(LSLListConstant *list_const);
   virtual bool visit(LSLListExpression *list_expr);
   virtual bool visit(LSLTypecastExpression *cast_expr);
+  bool writeSimpleCast(LSLExpression *child_expr, LSLIType to_type);
   virtual bool visit(LSLFunctionExpression *func_expr);
   virtual bool visit(LSLLValueExpression *lvalue);
   void constructMutatedMember(LSLSymbol *sym, LSLIdentifier *member, LSLExpression *rhs);
+  void writeExprAssign(LSLSymbol *sym, const std::function<void()> &write_value);
+  void writeMutatedCoord(LSLSymbol *sym, int member_offset, const std::function<void()> &write_member);
   virtual bool visit(LSLBinaryExpression *bin_expr);
+  static const char *getBinaryHelperName(LSLOperator op);
+  void writeFlattenedChain(const std::vector<LSLBinaryExpression *> &chain);
+  std::string spillToTemp(LSLExpression *expr);
+  int getExprDepth(LSLASTNode *expr);
+  bool writePlainIntOp(LSLBinaryExpression *bin_expr);
   virtual bool visit(LSLUnaryExpression *unary_expr);
   virtual bool visit(LSLPrintExpression *print_expr);
   virtual bool visit(LSLParenthesisExpression *parens_expr);
@@ -38,23 +110,67 @@ class PythonVisitor : public ASTVisitor {
   virtual bool visit(LSLNopStatement *nop_stmt);
   virtual bool visit(LSLCompoundStatement *compound_stmt);
   virtual bool visit(LSLExpressionStatement *expr_stmt);
+  bool isDeadVar(LSLSymbol *sym);
+  bool isFuncKept(LSLSymbol *func_sym);
+  LSLSymbol *resolveFunc(LSLSymbol *func_sym);
+  bool isDeadStore(LSLExpression *expr);
+  bool writeExprLine(LSLExpression *expr);
+  void writeRemovedStatement(LSLASTNode *stmt);
   virtual bool visit(LSLDeclaration *decl_stmt);
   virtual bool visit(LSLIfStatement *if_stmt);
+  bool usingSwitchDispatch();
+  bool writeSpecialChain(LSLIfStatement *if_stmt, bool dry_run);
+  void writeIfCheck(LSLIfStatement *if_stmt);
+  void writeSwitch(const SwitchChain &chain);
+  void writeSwitchTree(const SwitchChain &chain, const std::string &idx_name, size_t first, size_t last);
+  bool isHotLoop(LSLASTNode *loop_stmt);
+  void writeLoopEntryHook(LSLASTNode *loop_stmt);
+  void writeLoopIterationHook(LSLASTNode *loop_stmt);
+  bool promoteLoopGlobals(LSLASTNode *loop_stmt);
+  void writePromotedGlobalsBack();
+  void endLoopGlobalPromotion();
   virtual bool visit(LSLForStatement *for_stmt);
   virtual bool visit(LSLWhileStatement *while_stmt);
   virtual bool visit(LSLDoStatement *do_stmt);
+  void addError(LSLASTNode *node, const std::string &message);
   virtual bool visit(LSLJumpStatement *jump_stmt);
   virtual bool visit(LSLLabel *label_stmt);
   virtual bool visit(LSLReturnStatement *return_stmt);
   void writeReturn(LSLExpression *ret_expr);
   virtual bool visit(LSLStateStatement *state_stmt);
 
+  PythonCompilationOptions _mOptions {};
   int _mFuncPreludeTabs = 0;
   std::stringstream _mFuncPreludeStr;
   LSLSymbol *_mFuncSym = nullptr;
+  bool _mFuncIsCold = false;
+  // temporaries used for flattening expressions within the current function
+  int _mFlatTemps = 0;
+  // assignments to them for the outermost expression currently being flattened
+  std::vector<std::string> *_mFlatSpills = nullptr;
+  LSLExpression *_mSpillingExpr = nullptr;
+  // roughly how deeply the Python written for each expression nests
+  std::map<LSLASTNode *, int> _mExprDepths;
+  // globals currently cached in locals, and the names of those locals
+  std::map<LSLSymbol *, std::string> _mPromotedGlobals;
+  std::vector<LSLSymbol *> _mPromotedGlobalsOrder;
+  IntRangeAnalysis _mIntRanges;
+  VarUsageVisitor _mVarUsage;
+  DeadStoreFindingVisitor _mDeadStores;
+  // runtime helpers used by the current function, and functions it's bound to locals
+  bool _mBindingHelpers = false;
+  std::set<std::string> _mUsedHelpers;
+  std::map<LSLSymbol *, std::string> _mBoundMethods;
+  std::vector<LSLSymbol *> _mBoundMethodsOrder;
+  // module-level lookup tables for switches
+  std::vector<std::string> _mSwitchTables;
+  // globals that need setters for assignment in expression context
+  std::set<LSLSymbol *> _mGlobalSetters;
 
   public:
   std::stringstream mStr;
+  // Things the script uses that can't be expressed with the current options
+  std::vector<std::string> mErrors;
   int mTabs = 0;
   bool mSuppressNextTab = false;
 
@@ -0,0 +1,671 @@
+#include <set>
+
+#include "register_ir.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+static json::object_t copy_fields(const json &instr, std::initializer_list<const char *> fields) {
+  json::object_t obj;
+  for (const auto *field : fields)
+    obj[field] = instr.at(field);
+  return obj;
+}
+
+// Stands in for the space `PUSH_EMPTY` reserves for a call's return value
+static const uint32_t RETURN_SLOT = UINT32_MAX;
+
+class RegisterFuncBuilder {
+  public:
+    RegisterFuncBuilder(const IRSignatureMap &functions, const IRSignatureMap &builtins, std::string *error) :
+        _mFunctions(functions), _mBuiltins(builtins), _mError(error) {}
+
+    bool build(const json &code, json::object_t *out);
+
+  protected:
+    bool convertOp(const json &instr);
+    uint32_t newRegister(const std::string &type);
+    bool pop(uint32_t *reg);
+    bool popValues(size_t num_values, json::array_t *regs);
+    void emit(json::object_t instr);
+    bool emitTerminator(json::object_t instr);
+    void startBlock(const std::string &label);
+    void closeBlock();
+    bool fail(const std::string &message);
+
+    const IRSignatureMap &_mFunctions;
+    const IRSignatureMap &_mBuiltins;
+    std::string *_mError;
+
+    json::array_t _mRegisters;
+    json::array_t _mBlocks;
+    std::string _mBlockLabel;
+    json::array_t _mBlockCode;
+    bool _mInBlock = false;
+    // the last block ended in a conditional jump that doesn't know its `else_label` yet
+    bool _mNeedElseLabel = false;
+    uint32_t _mNumGeneratedLabels = 0;
+    // registers holding what would've been on the stack
+    std::vector<uint32_t> _mStack;
+};
+
+bool RegisterFuncBuilder::build(const json &code, json::object_t *out) {
+  for (const auto &instr : code) {
+    if (instr["instr_type"] == "label") {
+      auto label = instr["label"].get<std::string>();
+      if (!_mStack.empty())
+        return fail("values left on the stack at label " + label);
+      startBlock(label);
+      continue;
+    }
+    // anything after a jump or return starts a new block, even without a label.
+    if (!_mInBlock)
+      startBlock("_block" + std::to_string(_mNumGeneratedLabels++));
+    if (!convertOp(instr))
+      return false;
+  }
+  // A conditional jump at the very end still needs somewhere to go when it isn't taken
+  if (_mNeedElseLabel)
+    startBlock("_block" + std::to_string(_mNumGeneratedLabels++));
+  if (!_mStack.empty())
+    return fail("values left on the stack at the end of the function");
+  if (_mInBlock)
+    closeBlock();
+  (*out)["registers"] = _mRegisters;
+  (*out)["blocks"] = _mBlocks;
+  return true;
+}
+
+bool RegisterFuncBuilder::convertOp(const json &instr) {
+  const auto op = instr["op"].get<std::string>();
+  uint32_t src;
+  if (op == "PUSH") {
+    auto load = copy_fields(instr, {"type", "whence", "index"});
+    load["op"] = "LOAD";
+    load["dest"] = newRegister(instr["type"].get<std::string>());
+    emit(load);
+  } else if (op == "PUSH_CONSTANT") {
+    auto constant = copy_fields(instr, {"type", "value"});
+    constant["op"] = "CONST";
+    constant["dest"] = newRegister(instr["type"].get<std::string>());
+    emit(constant);
+  } else if (op == "PUSH_EMPTY") {
+    _mStack.push_back(RETURN_SLOT);
+  } else if (op == "DUP") {
+    // Both copies can just share the register
+    if (!pop(&src))
+      return false;
+    _mStack.push_back(src);
+    _mStack.push_back(src);
+  } else if (op == "POP_N") {
+    json::array_t popped;
+    if (!popValues(instr["num"].get<uint32_t>(), &popped))
+      return false;
+  } else if (op == "STORE") {
+    if (!pop(&src))
+      return false;
+    auto store = copy_fields(instr, {"op", "type", "whence", "index"});
+    store["src"] = src;
+    emit(store);
+  } else if (op == "STORE_DEFAULT") {
+    emit(copy_fields(instr, {"op", "type", "whence", "index"}));
+  } else if (op == "CHANGE_STATE") {
+    emit(copy_fields(instr, {"op", "state"}));
+  } else if (op == "TAKE_MEMBER") {
+    if (!pop(&src))
+      return false;
+    auto take = copy_fields(instr, {"op", "type", "offset"});
+    take["src"] = src;
+    take["dest"] = newRegister("float");
+    emit(take);
+  } else if (op == "REPLACE_MEMBER") {
+    // the containing object is on top, the new value for the member is below it
+    uint32_t member_src;
+    if (!pop(&src) || !pop(&member_src))
+      return false;
+    auto replace = copy_fields(instr, {"op", "type", "offset"});
+    replace["src"] = src;
+    replace["member_src"] = member_src;
+    replace["dest"] = newRegister(instr["type"].get<std::string>());
+    emit(replace);
+  } else if (op == "CAST") {
+    if (!pop(&src))
+      return false;
+    auto cast = copy_fields(instr, {"op", "from_type", "to_type"});
+    cast["src"] = src;
+    cast["dest"] = newRegister(instr["to_type"].get<std::string>());
+    emit(cast);
+  } else if (op == "BOOL") {
+    if (!pop(&src))
+      return false;
+    auto to_bool = copy_fields(instr, {"op", "type"});
+    to_bool["src"] = src;
+    to_bool["dest"] = newRegister("integer");
+    emit(to_bool);
+  } else if (op == "UN_OP") {
+    if (!pop(&src))
+      return false;
+    auto un_op = copy_fields(instr, {"op", "type", "operation"});
+    un_op["src"] = src;
+    un_op["dest"] = newRegister(ir_un_op_result_type(instr["operation"].get<std::string>(), instr["type"].get<std::string>()));
+    emit(un_op);
+  } else if (op == "BIN_OP") {
+    // The left hand side is evaluated last, so it's on top
+    uint32_t left, right;
+    if (!pop(&left) || !pop(&right))
+      return false;
+    auto bin_op = copy_fields(instr, {"op", "left_type", "right_type", "operation"});
+    bin_op["left"] = left;
+    bin_op["right"] = right;
+    bin_op["dest"] = newRegister(ir_bin_op_result_type(instr["operation"].get<std::string>(),
+        instr["left_type"].get<std::string>(), instr["right_type"].get<std::string>()));
+    emit(bin_op);
+  } else if (op == "BUILD_COORD" || op == "BUILD_LIST") {
+    size_t num_elems = (op == "BUILD_LIST") ? instr["num_elems"].get<size_t>() : (instr["type"] == "vector" ? 3 : 4);
+    json::array_t srcs;
+    if (!popValues(num_elems, &srcs))
+      return false;
+    auto build = copy_fields(instr, {"op"});
+    if (op == "BUILD_COORD")
+      build["type"] = instr["type"];
+    build["srcs"] = srcs;
+    build["dest"] = newRegister(op == "BUILD_LIST" ? "list" : instr["type"].get<std::string>());
+    emit(build);
+  } else if (op == "CALL" || op == "CALL_LIB") {
+    auto name = instr["name"].get<std::string>();
+    const auto &signatures = (op == "CALL") ? _mFunctions : _mBuiltins;
+    auto sig_iter = signatures.find(name);
+    if (sig_iter == signatures.end())
+      return fail("no signature for " + name);
+    const auto &sig = sig_iter->second;
+    json::array_t args;
+    if (!popValues(sig.args.size(), &args))
+      return false;
+    json::object_t call {{"op", op}, {"name", name}, {"args", args}};
+    if (sig.ret != "void") {
+      // Calls to our own functions had space reserved for the return value, that's where it goes.
+      if (op == "CALL") {
+        if (_mStack.empty() || _mStack.back() != RETURN_SLOT)
+          return fail("no space reserved for the return value of " + name);
+        _mStack.pop_back();
+      }
+      call["dest"] = newRegister(sig.ret);
+    }
+    emit(call);
+  } else if (op == "DUMP") {
+    if (!pop(&src))
+      return false;
+    emit({{"op", "DUMP"}, {"src", src}});
+  } else if (op == "JUMP") {
+    auto jump = copy_fields(instr, {"op", "jump_type", "label"});
+    bool conditional = instr["jump_type"] != "ALWAYS";
+    if (conditional) {
+      if (!pop(&src))
+        return false;
+      jump["cond"] = src;
+    }
+    if (!emitTerminator(jump))
+      return false;
+    _mNeedElseLabel = conditional;
+  } else if (op == "JUMP_TABLE") {
+    if (!pop(&src))
+      return false;
+    auto table = copy_fields(instr, {"op", "type", "cases", "default_label"});
+    table["src"] = src;
+    return emitTerminator(table);
+  } else if (op == "RET") {
+    return emitTerminator({{"op", "RET"}});
+  } else {
+    return fail("can't convert " + op + " to register form");
+  }
+  return true;
+}
+
+uint32_t RegisterFuncBuilder::newRegister(const std::string &type) {
+  _mRegisters.push_back(type);
+  auto reg = (uint32_t)(_mRegisters.size() - 1);
+  _mStack.push_back(reg);
+  return reg;
+}
+
+bool RegisterFuncBuilder::pop(uint32_t *reg) {
+  if (_mStack.empty() || _mStack.back() == RETURN_SLOT)
+    return fail("stack underflow");
+  *reg = _mStack.back();
+  _mStack.pop_back();
+  return true;
+}
+
+bool RegisterFuncBuilder::popValues(size_t num_values, json::array_t *regs) {
+  if (_mStack.size() < num_values)
+    return fail("stack underflow");
+  auto first = _mStack.end() - (ptrdiff_t)num_values;
+  for (auto reg_iter = first; reg_iter != _mStack.end(); ++reg_iter) {
+    if (*reg_iter == RETURN_SLOT)
+      return fail("stack underflow");
+    regs->push_back(*reg_iter);
+  }
+  _mStack.erase(first, _mStack.end());
+  return true;
+}
+
+void RegisterFuncBuilder::emit(json::object_t instr) {
+  _mBlockCode.push_back(std::move(instr));
+}
+
+bool RegisterFuncBuilder::emitTerminator(json::object_t instr) {
+  emit(std::move(instr));
+  if (!_mStack.empty())
+    return fail("values left on the stack at the end of block " + _mBlockLabel);
+  closeBlock();
+  return true;
+}
+
+void RegisterFuncBuilder::startBlock(const std::string &label) {
+  // falling through into the next block has to be explicit
+  if (_mInBlock) {
+    emit({{"op", "JUMP"}, {"jump_type", "ALWAYS"}, {"label", label}});
+    closeBlock();
+  }
+  if (_mNeedElseLabel) {
+    _mBlocks.back()["code"].back()["else_label"] = label;
+    _mNeedElseLabel = false;
+  }
+  _mBlockLabel = label;
+  _mInBlock = true;
+}
+
+void RegisterFuncBuilder::closeBlock() {
+  _mBlocks.push_back({
+      {"label", _mBlockLabel},
+      {"code", std::move(_mBlockCode)}
+  });
+  _mBlockCode.clear();
+  _mInBlock = false;
+}
+
+bool RegisterFuncBuilder::fail(const std::string &message) {
+  *_mError = message;
+  return false;
+}
+
+bool build_register_ir(const json &stack_ir, const IRSignatureMap &builtins, json *register_ir, std::string *error) {
+  IRSignatureMap functions;
+  for (const auto &func : stack_ir["functions"]) {
+    auto &sig = functions[func["name"].get<std::string>()];
+    sig.ret = func["return"].get<std::string>();
+    for (const auto &arg : func["args"])
+      sig.args.push_back(arg.get<std::string>());
+  }
+  auto build_func_like = [&](const json &func_like, json::object_t *out) {
+    RegisterFuncBuilder builder(functions, builtins, error);
+    return builder.build(func_like, out);
+  };
+
+  json out;
+  out["globals"] = stack_ir["globals"];
+  // the stack IR passes' stats still describe what they did to the code we were given
+  for (const auto *field : {"constants", "data", "peephole_stats", "dataflow_stats", "local_slot_stats"}) {
+    if (stack_ir.contains(field))
+      out[field] = stack_ir[field];
+  }
+  json::object_t init_code;
+  if (!build_func_like(stack_ir["init_code"], &init_code))
+    return false;
+  out["init_code"] = init_code;
+
+  json::array_t functions_out;
+  for (const auto &func : stack_ir["functions"]) {
+    auto reg_func = copy_fields(func, {"name", "return", "args", "locals"});
+    if (!build_func_like(func["code"], &reg_func))
+      return false;
+    functions_out.push_back(reg_func);
+  }
+  out["functions"] = functions_out;
+
+  json::array_t states_out;
+  for (const auto &state : stack_ir["states"]) {
+    json::array_t handlers_out;
+    for (const auto &handler : state["handlers"]) {
+      auto reg_handler = copy_fields(handler, {"name", "return", "args", "locals"});
+      if (!build_func_like(handler["code"], &reg_handler))
+        return false;
+      handlers_out.push_back(reg_handler);
+    }
+    states_out.push_back({
+        {"name", state["name"]},
+        {"handlers", handlers_out}
+    });
+  }
+  out["states"] = states_out;
+  *register_ir = std::move(out);
+  return true;
+}
+
+
+bool is_register_ir_field(const std::string &field) {
+  static const std::set<std::string> fields(std::begin(REGISTER_IR_FIELDS), std::end(REGISTER_IR_FIELDS));
+  return fields.find(field) != fields.end();
+}
+
+std::vector<uint32_t> get_register_operands(const json &instr) {
+  std::vector<uint32_t> operands;
+  for_each_register_operand(instr, [&](const json &reg) {
+    operands.push_back(reg.get<uint32_t>());
+  });
+  return operands;
+}
+
+static bool is_conditional_jump(const json &instr) {
+  return instr.at("op") == "JUMP" && instr.value("jump_type", "ALWAYS") != "ALWAYS";
+}
+
+class StackFuncEmitter {
+  public:
+    // `locals` is where new locals for holding registers get added, `nullptr` if there can't be any.
+    StackFuncEmitter(const json &func_like, json::array_t *locals, std::string *error) :
+        _mBlocks(func_like.at("blocks")), _mRegisters(func_like.at("registers")), _mLocals(locals), _mError(error) {}
+
+    bool emit(json::array_t *code);
+
+  protected:
+    bool countUses();
+    bool findStackViolation();
+    size_t numKept(const std::vector<uint32_t> &operands);
+    bool isFallthroughJump(size_t block_idx, const json &instr);
+    bool fail(const std::string &message);
+
+    const json &_mBlocks;
+    const json &_mRegisters;
+    json::array_t *_mLocals;
+    std::string *_mError;
+
+    std::vector<uint32_t> _mUseCounts;
+    // registers that have to be stored to a local, since they can't just stay on the stack
+    std::vector<bool> _mSpilled;
+};
+
+bool StackFuncEmitter::countUses() {
+  size_t num_regs = _mRegisters.size();
+  _mUseCounts.assign(num_regs, 0);
+  _mSpilled.assign(num_regs, false);
+  std::vector<size_t> def_blocks(num_regs, SIZE_MAX);
+  for (size_t block_idx = 0; block_idx < _mBlocks.size(); ++block_idx) {
+    for (const auto &instr : _mBlocks[block_idx].at("code")) {
+      for (auto reg : get_register_operands(instr)) {
+        if (reg >= num_regs)
+          return fail("unknown register " + std::to_string(reg));
+        ++_mUseCounts[reg];
+        // the stack is empty between blocks, values have to be passed between them in locals.
+        if (def_blocks[reg] != block_idx)
+          _mSpilled[reg] = true;
+      }
+      if (instr.contains("dest")) {
+        auto dest = instr.at("dest").get<uint32_t>();
+        if (dest >= num_regs)
+          return fail("unknown register " + std::to_string(dest));
+        def_blocks[dest] = block_idx;
+      }
+    }
+  }
+  for (size_t reg = 0; reg < num_regs; ++reg) {
+    if (_mUseCounts[reg] && def_blocks[reg] == SIZE_MAX)
+      return fail("register " + std::to_string(reg) + " is used but never assigned");
+    if (_mUseCounts[reg] > 1)
+      _mSpilled[reg] = true;
+  }
+  return true;
+}
+
+size_t StackFuncEmitter::numKept(const std::vector<uint32_t> &operands) {
+  size_t num_kept = 0;
+  while (num_kept < operands.size() && !_mSpilled[operands[num_kept]])
+    ++num_kept;
+  return num_kept;
+}
+
+// Pretends to run the code with the registers that aren't spilled kept on the stack.
+// If any of them wouldn't be where they need to be, spills them and returns true.
+bool StackFuncEmitter::findStackViolation() {
+  for (const auto &block : _mBlocks) {
+    std::vector<uint32_t> stack;
+    for (const auto &instr : block.at("code")) {
+      auto operands = get_register_operands(instr);
+      // Kept operands have to be on top of the stack in order, spilled ones get loaded above them.
+      size_t num_kept = numKept(operands);
+      bool ok = stack.size() >= num_kept;
+      for (size_t i = 0; ok && i < operands.size(); ++i) {
+        if (i < num_kept)
+          ok = stack[stack.size() - num_kept + i] == operands[i];
+        else
+          ok = _mSpilled[operands[i]];
+      }
+      if (!ok) {
+        for (auto reg : operands)
+          _mSpilled[reg] = true;
+        return true;
+      }
+      stack.resize(stack.size() - num_kept);
+      if (instr.contains("dest")) {
+        auto dest = instr.at("dest").get<uint32_t>();
+        if (!_mSpilled[dest] && _mUseCounts[dest])
+          stack.push_back(dest);
+      }
+    }
+    if (!stack.empty()) {
+      for (auto reg : stack)
+        _mSpilled[reg] = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool StackFuncEmitter::isFallthroughJump(size_t block_idx, const json &instr) {
+  return instr.at("op") == "JUMP" && !is_conditional_jump(instr) && block_idx + 1 < _mBlocks.size()
+      && _mBlocks[block_idx + 1].at("label") == instr.at("label");
+}
+
+bool StackFuncEmitter::emit(json::array_t *code) {
+  if (!countUses())
+    return false;
+  // Every violation spills at least one more register, so this has to stop eventually.
+  while (findStackViolation()) {}
+
+  std::map<uint32_t, uint32_t> spill_slots;
+  for (uint32_t reg = 0; reg < _mSpilled.size(); ++reg) {
+    if (!_mSpilled[reg])
+      continue;
+    if (!_mLocals)
+      return fail("register " + std::to_string(reg) + " would need to be stored in a local");
+    spill_slots[reg] = (uint32_t)_mLocals->size();
+    _mLocals->push_back(_mRegisters[reg]);
+  }
+  auto spill_op = [&](const char *op, uint32_t reg) {
+    return json::object_t {
+        {"instr_type", "op"},
+        {"op", op},
+        {"type", _mRegisters[reg]},
+        {"whence", "LOCAL"},
+        {"index", spill_slots[reg]}
+    };
+  };
+
+  // where the ops that leave each kept register on the stack start, in case
+  // something needs to be pushed underneath.
+  std::map<uint32_t, size_t> starts;
+  for (size_t block_idx = 0; block_idx < _mBlocks.size(); ++block_idx) {
+    const auto &block = _mBlocks[block_idx];
+    code->push_back({
+        {"instr_type", "label"},
+        {"label", block.at("label")}
+    });
+    for (const auto &instr : block.at("code")) {
+      if (isFallthroughJump(block_idx, instr))
+        continue;
+      auto operands = get_register_operands(instr);
+      size_t num_kept = numKept(operands);
+      size_t start = num_kept ? starts[operands[0]] : code->size();
+
+      const auto op = instr.at("op").get<std::string>();
+      if (op == "CALL" && instr.contains("dest")) {
+        // The return value goes in a space reserved below the arguments
+        code->insert(code->begin() + (ptrdiff_t)start, json {
+            {"instr_type", "op"},
+            {"op", "PUSH_EMPTY"},
+            {"type", _mRegisters[instr.at("dest").get<uint32_t>()]}
+        });
+      }
+      for (size_t i = num_kept; i < operands.size(); ++i)
+        code->push_back(spill_op("PUSH", operands[i]));
+
+      json::object_t stack_op {{"instr_type", "op"}};
+      for (const auto &field : instr.items()) {
+        if (!is_register_ir_field(field.key()))
+          stack_op[field.key()] = field.value();
+      }
+      if (op == "LOAD")
+        stack_op["op"] = "PUSH";
+      else if (op == "CONST")
+        stack_op["op"] = "PUSH_CONSTANT";
+      else if (op == "BUILD_LIST")
+        stack_op["num_elems"] = instr.at("srcs").size();
+      code->push_back(stack_op);
+
+      if (is_conditional_jump(instr) && instr.contains("else_label")) {
+        bool falls_through = block_idx + 1 < _mBlocks.size()
+            && _mBlocks[block_idx + 1].at("label") == instr.at("else_label");
+        if (!falls_through) {
+          code->push_back({
+              {"instr_type", "op"},
+              {"op", "JUMP"},
+              {"jump_type", "ALWAYS"},
+              {"label", instr.at("else_label")}
+          });
+        }
+      }
+
+      if (instr.contains("dest")) {
+        auto dest = instr.at("dest").get<uint32_t>();
+        if (_mSpilled[dest])
+          code->push_back(spill_op("STORE", dest));
+        else if (!_mUseCounts[dest])
+          code->push_back({{"instr_type", "op"}, {"op", "POP_N"}, {"num", 1}});
+        else
+          starts[dest] = start;
+      }
+    }
+  }
+
+  // Drop the labels we made up for blocks that nothing jumps to anymore
+  std::set<std::string> referenced;
+  for (const auto &instr : *code) {
+    if (instr.at("instr_type") != "op")
+      continue;
+    if (instr.contains("label"))
+      referenced.insert(instr.at("label").get<std::string>());
+    if (instr.contains("default_label"))
+      referenced.insert(instr.at("default_label").get<std::string>());
+    if (instr.contains("cases")) {
+      for (const auto &jump_case : instr.at("cases"))
+        referenced.insert(jump_case.at("label").get<std::string>());
+    }
+  }
+  json::array_t used_code;
+  for (auto &instr : *code) {
+    if (instr.at("instr_type") == "label") {
+      auto label = instr.at("label").get<std::string>();
+      if (label.rfind("_block", 0) == 0 && referenced.find(label) == referenced.end())
+        continue;
+    }
+    used_code.push_back(std::move(instr));
+  }
+  *code = std::move(used_code);
+  return true;
+}
+
+bool StackFuncEmitter::fail(const std::string &message) {
+  *_mError = message;
+  return false;
+}
+
+bool register_ir_to_stack_ir(const json &register_ir, json *stack_ir, std::string *error) {
+  json out;
+  out["globals"] = register_ir.at("globals");
+  for (const auto *field : {"constants", "data"}) {
+    if (register_ir.contains(field))
+      out[field] = register_ir.at(field);
+  }
+
+  json::array_t init_code;
+  StackFuncEmitter init_emitter(register_ir.at("init_code"), nullptr, error);
+  if (!init_emitter.emit(&init_code))
+    return false;
+  out["init_code"] = init_code;
+
+  auto emit_func_like = [&](const json &func_like, json::object_t *out_func) {
+    *out_func = copy_fields(func_like, {"name", "return", "args"});
+    json::array_t locals = func_like.at("locals");
+    json::array_t code;
+    StackFuncEmitter emitter(func_like, &locals, error);
+    if (!emitter.emit(&code))
+      return false;
+    (*out_func)["locals"] = locals;
+    (*out_func)["code"] = code;
+    return true;
+  };
+
+  json::array_t functions_out;
+  for (const auto &func : register_ir.at("functions")) {
+    json::object_t stack_func;
+    if (!emit_func_like(func, &stack_func))
+      return false;
+    functions_out.push_back(stack_func);
+  }
+  out["functions"] = functions_out;
+
+  json::array_t states_out;
+  for (const auto &state : register_ir.at("states")) {
+    json::array_t handlers_out;
+    for (const auto &handler : state.at("handlers")) {
+      json::object_t stack_handler;
+      if (!emit_func_like(handler, &stack_handler))
+        return false;
+      handlers_out.push_back(stack_handler);
+    }
+    states_out.push_back({
+        {"name", state.at("name")},
+        {"handlers", handlers_out}
+    });
+  }
+  out["states"] = states_out;
+  *stack_ir = std::move(out);
+  return true;
+}
+
+void get_register_ir_builtins(const json &register_ir, IRSignatureMap *builtins) {
+  auto add_calls = [&](const json &func_like) {
+    const auto &registers = func_like.at("registers");
+    for (const auto &block : func_like.at("blocks")) {
+      for (const auto &instr : block.at("code")) {
+        if (instr.at("op") != "CALL_LIB")
+          continue;
+        auto &sig = (*builtins)[instr.at("name").get<std::string>()];
+        sig.ret = instr.contains("dest") ? registers.at(instr.at("dest").get<uint32_t>()).get<std::string>() : "void";
+        sig.args.clear();
+        for (const auto &arg : instr.at("args"))
+          sig.args.push_back(registers.at(arg.get<uint32_t>()).get<std::string>());
+      }
+    }
+  };
+  add_calls(register_ir.at("init_code"));
+  for (const auto &func : register_ir.at("functions"))
+    add_calls(func);
+  for (const auto &state : register_ir.at("states")) {
+    for (const auto &handler : state.at("handlers"))
+      add_calls(handler);
+  }
+}
+
+}
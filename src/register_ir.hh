@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../extern/json.hh"
+#include "json_ir_pass.hh"
+
+namespace Tailslide {
+
+// Converts stack IR from `JSONScriptCompiler` into a three-address form where every value
+// is held in a typed virtual register that's only ever assigned once. Globals, locals and
+// args keep the same slots they had in the stack IR and are accessed through `LOAD` and `STORE`.
+//
+// Each function's code is split into basic blocks with a label apiece. Every block but the
+// last ends in a `JUMP`, `JUMP_TABLE` or `RET`, conditional jumps give both their targets
+// as `label` and `else_label`.
+bool build_register_ir(const nlohmann::json &stack_ir, const IRSignatureMap &builtins,
+                       nlohmann::json *register_ir, std::string *error);
+
+// Fields of register IR ops that refer to registers or blocks rather than saying what the op computes
+const char * const REGISTER_IR_FIELDS[] = {
+    "dest", "src", "srcs", "args", "cond", "left", "right", "member_src", "else_label"
+};
+
+// Whether `field` is one of `REGISTER_IR_FIELDS`
+bool is_register_ir_field(const std::string &field);
+
+// Calls `func` with each of the fields holding a register an op reads, in the order its stack IR
+// equivalent expects them to be pushed. `instr` may be const, or not if they need to be changed.
+template<typename JSON, typename F>
+void for_each_register_operand(JSON &instr, F func) {
+  const auto &op = instr.at("op");
+  if (op == "BIN_OP") {
+    func(instr.at("right"));
+    func(instr.at("left"));
+  } else if (op == "REPLACE_MEMBER") {
+    func(instr.at("member_src"));
+    func(instr.at("src"));
+  } else {
+    for (const auto *field : {"srcs", "args"}) {
+      if (instr.contains(field)) {
+        for (auto &reg : instr.at(field))
+          func(reg);
+      }
+    }
+    for (const auto *field : {"src", "cond"}) {
+      if (instr.contains(field))
+        func(instr.at(field));
+    }
+  }
+}
+
+// The registers an op reads, in the order its stack IR equivalent expects them to be pushed
+std::vector<uint32_t> get_register_operands(const nlohmann::json &instr);
+
+// Converts register IR back into stack IR. Registers used once, in the order the stack would
+// have them, stay on the stack. Anything else is stored to a new local.
+bool register_ir_to_stack_ir(const nlohmann::json &register_ir, nlohmann::json *stack_ir, std::string *error);
+
+// Finds the signature of every builtin the register IR calls from the types of the
+// registers passed to and returned from it, for checking the stack IR it converts to.
+void get_register_ir_builtins(const nlohmann::json &register_ir, IRSignatureMap *builtins);
+
+}
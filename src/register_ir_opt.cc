@@ -0,0 +1,460 @@
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "register_ir.hh"
+#include "register_ir_opt.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+// Builtins whose result only depends on their arguments, and that don't do anything else.
+// `llModPow()` would qualify if it didn't sleep the script.
+static const std::set<std::string> PURE_BUILTINS {
+    "llAbs", "llAcos", "llAngleBetween", "llAsin", "llAtan2", "llAxes2Rot", "llAxisAngle2Rot",
+    "llBase64ToInteger", "llBase64ToString", "llCSV2List", "llCeil", "llChar", "llCos",
+    "llDeleteSubList", "llDeleteSubString", "llDumpList2String", "llEscapeURL", "llEuler2Rot",
+    "llFabs", "llFloor", "llGetListEntryType", "llGetListLength", "llGetSubString", "llHash",
+    "llInsertString", "llIntegerToBase64", "llJson2List", "llJsonGetValue", "llJsonSetValue",
+    "llJsonValueType", "llList2CSV", "llList2Float", "llList2Integer", "llList2Json", "llList2Key",
+    "llList2List", "llList2ListSlice", "llList2ListStrided", "llList2Rot", "llList2String",
+    "llList2Vector", "llListFindList", "llListInsertList", "llListReplaceList", "llListSort",
+    "llListStatistics", "llLog", "llLog10", "llMD5String", "llOrd", "llParseString2List",
+    "llParseStringKeepNulls", "llPow", "llReplaceSubString", "llRot2Angle", "llRot2Axis",
+    "llRot2Euler", "llRot2Fwd", "llRot2Left", "llRot2Up", "llRotBetween", "llRound", "llSHA1String",
+    "llSHA256String", "llSin", "llSqrt", "llStringLength", "llStringToBase64", "llStringTrim",
+    "llSubStringIndex", "llTan", "llToLower", "llToUpper", "llUnescapeURL", "llVecDist",
+    "llVecMag", "llVecNorm", "llXorBase64", "llXorBase64StringsCorrect",
+};
+
+static bool is_pure(const json &instr) {
+  const auto op = instr["op"].get<std::string>();
+  if (op == "CALL_LIB")
+    return PURE_BUILTINS.find(instr["name"].get<std::string>()) != PURE_BUILTINS.end();
+  return op == "LOAD" || op == "CONST" || op == "CAST" || op == "BOOL" || op == "UN_OP" || op == "BIN_OP"
+      || op == "TAKE_MEMBER" || op == "REPLACE_MEMBER" || op == "BUILD_COORD" || op == "BUILD_LIST";
+}
+
+// Reading these again is as cheap as reading a register that's been stored to a local
+static bool is_cheap(const json &instr) {
+  return instr["op"] == "LOAD" || instr["op"] == "CONST";
+}
+
+// Division by zero stops the script
+static bool can_fail(const json &instr) {
+  auto operation = instr.value("operation", "");
+  return instr["op"] == "BIN_OP" && (operation == "DIV" || operation == "MOD");
+}
+
+static std::string slot_key(const json &instr) {
+  return instr["whence"].get<std::string>() + ":" + instr["index"].dump();
+}
+
+static void rename_operands(json &instr, const std::map<uint32_t, uint32_t> &renames) {
+  auto rename = [&](json &reg) {
+    auto rename_iter = renames.find(reg.get<uint32_t>());
+    if (rename_iter != renames.end())
+      reg = rename_iter->second;
+  };
+  for_each_register_operand(instr, rename);
+}
+
+static void redirect_jumps(json &instr, const std::string &from, const std::string &to) {
+  for (const auto *field : {"label", "else_label", "default_label"}) {
+    if (instr.contains(field) && instr[field] == from)
+      instr[field] = to;
+  }
+  if (instr.contains("cases")) {
+    for (auto &jump_case : instr["cases"]) {
+      if (jump_case["label"] == from)
+        jump_case["label"] = to;
+    }
+  }
+}
+
+// A description of the value an op computes, two ops with the same one compute the same value
+static std::string describe_value(const json &instr, const std::map<uint32_t, uint32_t> &reg_values,
+                                  const std::map<std::string, uint32_t> &slot_versions, uint32_t globals_version) {
+  json description = instr;
+  for (const auto *field : REGISTER_IR_FIELDS)
+    description.erase(field);
+  std::string key = description.dump();
+  for (auto reg : get_register_operands(instr)) {
+    auto value_iter = reg_values.find(reg);
+    // registers from other blocks only ever match themselves
+    if (value_iter != reg_values.end())
+      key += " v" + std::to_string(value_iter->second);
+    else
+      key += " r" + std::to_string(reg);
+  }
+  if (instr["op"] == "LOAD") {
+    auto version_iter = slot_versions.find(slot_key(instr));
+    key += " @" + std::to_string(version_iter != slot_versions.end() ? version_iter->second : 0);
+    if (instr["whence"] == "GLOBAL")
+      key += " g" + std::to_string(globals_version);
+  }
+  return key;
+}
+
+static void eliminate_common_subexpressions(json &func_like, RegisterIROptStats *stats) {
+  std::map<uint32_t, uint32_t> renames;
+  for (auto &block : func_like["blocks"]) {
+    // value numbers for everything computed in this block, and the first register to hold each
+    std::map<std::string, uint32_t> value_numbers;
+    std::map<uint32_t, uint32_t> reg_values;
+    std::map<uint32_t, uint32_t> value_regs;
+    // bumped on every store, so loads on either side of it never match
+    std::map<std::string, uint32_t> slot_versions;
+    uint32_t globals_version = 0;
+    json::array_t new_code;
+    for (auto &instr : block["code"]) {
+      rename_operands(instr, renames);
+      const auto op = instr["op"].get<std::string>();
+      if (op == "STORE" || op == "STORE_DEFAULT") {
+        ++slot_versions[slot_key(instr)];
+      } else if (op == "CALL") {
+        // our own functions might change any global
+        ++globals_version;
+      }
+
+      if (!instr.contains("dest") || !is_pure(instr)) {
+        new_code.push_back(std::move(instr));
+        continue;
+      }
+      auto dest = instr["dest"].get<uint32_t>();
+      auto key = describe_value(instr, reg_values, slot_versions, globals_version);
+      auto value_iter = value_numbers.find(key);
+      uint32_t value;
+      if (value_iter == value_numbers.end()) {
+        value = (uint32_t)value_numbers.size();
+        value_numbers[key] = value;
+        value_regs[value] = dest;
+      } else {
+        value = value_iter->second;
+        if (!is_cheap(instr)) {
+          renames[dest] = value_regs[value];
+          (*stats)["common_subexpressions"] += 1;
+          continue;
+        }
+      }
+      reg_values[dest] = value;
+      new_code.push_back(std::move(instr));
+    }
+    block["code"] = std::move(new_code);
+  }
+
+  // Hoisted values can be used from other blocks
+  if (renames.empty())
+    return;
+  for (auto &block : func_like["blocks"]) {
+    for (auto &instr : block["code"])
+      rename_operands(instr, renames);
+  }
+}
+
+struct RegisterBlockGraph {
+  std::vector<std::vector<size_t>> succs;
+  std::vector<std::vector<size_t>> preds;
+  std::vector<bool> reachable;
+  // dominators[block][other] is whether `other` dominates `block`
+  std::vector<std::vector<bool>> dominators;
+};
+
+static RegisterBlockGraph build_block_graph(const json &blocks) {
+  size_t num_blocks = blocks.size();
+  std::map<std::string, size_t> label_blocks;
+  for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx)
+    label_blocks[blocks[block_idx]["label"].get<std::string>()] = block_idx;
+
+  RegisterBlockGraph graph;
+  graph.succs.resize(num_blocks);
+  graph.preds.resize(num_blocks);
+  for (size_t block_idx = 0; block_idx < num_blocks; ++block_idx) {
+    const auto &code = blocks[block_idx]["code"];
+    if (code.empty())
+      continue;
+    // jumps only ever come at the end of a block
+    const auto &last = code.back();
+    std::vector<std::string> targets;
+    for (const auto *field : {"label", "else_label", "default_label"}) {
+      if (last.contains(field))
+        targets.push_back(last[field].get<std::string>());
+    }
+    if (last.contains("cases")) {
+      for (const auto &jump_case : last["cases"])
+        targets.push_back(jump_case["label"].get<std::string>());
+    }
+    auto &succs = graph.succs[block_idx];
+    for (const auto &target : targets) {
+      auto target_iter = label_blocks.find(target);
+      if (target_iter != label_blocks.end())
+        succs.push_back(target_iter->second);
+    }
+    std::sort(succs.begin(), succs.end());
+    succs.erase(std::unique(succs.begin(), succs.end()), succs.end());
+    for (auto succ : succs)
+      graph.preds[succ].push_back(block_idx);
+  }
+
+  graph.reachable.assign(num_blocks, false);
+  std::vector<size_t> pending {0};
+  while (num_blocks && !pending.empty()) {
+    auto block_idx = pending.back();
+    pending.pop_back();
+    if (graph.reachable[block_idx])
+      continue;
+    graph.reachable[block_idx] = true;
+    for (auto succ : graph.succs[block_idx])
+      pending.push_back(succ);
+  }
+
+  graph.dominators.assign(num_blocks, std::vector<bool>(num_blocks, true));
+  if (num_blocks) {
+    graph.dominators[0].assign(num_blocks, false);
+    graph.dominators[0][0] = true;
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t block_idx = 1; block_idx < num_blocks; ++block_idx) {
+      if (!graph.reachable[block_idx])
+        continue;
+      std::vector<bool> doms(num_blocks, true);
+      for (auto pred : graph.preds[block_idx]) {
+        if (!graph.reachable[pred])
+          continue;
+        for (size_t other = 0; other < num_blocks; ++other)
+          doms[other] = doms[other] && graph.dominators[pred][other];
+      }
+      doms[block_idx] = true;
+      if (doms != graph.dominators[block_idx]) {
+        graph.dominators[block_idx] = std::move(doms);
+        changed = true;
+      }
+    }
+  }
+  return graph;
+}
+
+// loop header -> every block in the loop, found from the jumps back to each header
+static std::map<size_t, std::set<size_t>> find_loops(const RegisterBlockGraph &graph) {
+  std::map<size_t, std::set<size_t>> loops;
+  for (size_t block_idx = 0; block_idx < graph.succs.size(); ++block_idx) {
+    if (!graph.reachable[block_idx])
+      continue;
+    for (auto header : graph.succs[block_idx]) {
+      if (!graph.dominators[block_idx][header])
+        continue;
+      auto &body = loops[header];
+      body.insert(header);
+      std::vector<size_t> pending {block_idx};
+      while (!pending.empty()) {
+        auto body_idx = pending.back();
+        pending.pop_back();
+        if (!body.insert(body_idx).second)
+          continue;
+        for (auto pred : graph.preds[body_idx])
+          pending.push_back(pred);
+      }
+    }
+  }
+  return loops;
+}
+
+static void hoist_from_loop(json &func_like, const RegisterBlockGraph &graph, size_t header,
+                            const std::set<size_t> &body, RegisterIROptStats *stats) {
+  auto &blocks = func_like["blocks"];
+  std::set<std::string> stored_slots;
+  std::set<uint32_t> defined_in_loop;
+  std::map<uint32_t, const json *> defs;
+  bool calls = false;
+  for (auto block_idx : body) {
+    for (const auto &instr : blocks[block_idx]["code"]) {
+      if (instr["op"] == "STORE" || instr["op"] == "STORE_DEFAULT")
+        stored_slots.insert(slot_key(instr));
+      else if (instr["op"] == "CALL")
+        calls = true;
+      if (instr.contains("dest")) {
+        defined_in_loop.insert(instr["dest"].get<uint32_t>());
+        defs[instr["dest"].get<uint32_t>()] = &instr;
+      }
+    }
+  }
+
+  // Find ops that give the same result every time around the loop, operands before the ops using them.
+  std::set<uint32_t> invariant;
+  std::vector<uint32_t> invariant_order;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto block_idx : body) {
+      for (const auto &instr : blocks[block_idx]["code"]) {
+        if (!instr.contains("dest") || !is_pure(instr) || can_fail(instr))
+          continue;
+        auto dest = instr["dest"].get<uint32_t>();
+        if (invariant.find(dest) != invariant.end())
+          continue;
+        if (instr["op"] == "LOAD") {
+          if (stored_slots.find(slot_key(instr)) != stored_slots.end())
+            continue;
+          // our own functions might change any global
+          if (calls && instr["whence"] == "GLOBAL")
+            continue;
+        }
+        bool operands_invariant = true;
+        for (auto reg : get_register_operands(instr)) {
+          if (invariant.find(reg) == invariant.end() && defined_in_loop.find(reg) != defined_in_loop.end())
+            operands_invariant = false;
+        }
+        if (!operands_invariant)
+          continue;
+        invariant.insert(dest);
+        invariant_order.push_back(dest);
+        changed = true;
+      }
+    }
+  }
+
+  // Only hoist ops doing real work, along with whatever they need.
+  std::set<uint32_t> hoisted;
+  for (auto reg_iter = invariant_order.rbegin(); reg_iter != invariant_order.rend(); ++reg_iter) {
+    const auto &instr = *defs[*reg_iter];
+    if (is_cheap(instr) && hoisted.find(*reg_iter) == hoisted.end())
+      continue;
+    hoisted.insert(*reg_iter);
+    for (auto reg : get_register_operands(instr)) {
+      if (invariant.find(reg) != invariant.end())
+        hoisted.insert(reg);
+    }
+  }
+  if (hoisted.empty())
+    return;
+
+  json::array_t hoisted_code;
+  for (auto reg : invariant_order) {
+    if (hoisted.find(reg) != hoisted.end())
+      hoisted_code.push_back(*defs[reg]);
+  }
+  for (auto block_idx : body) {
+    json::array_t new_code;
+    for (auto &instr : blocks[block_idx]["code"]) {
+      if (!instr.contains("dest") || hoisted.find(instr["dest"].get<uint32_t>()) == hoisted.end())
+        new_code.push_back(std::move(instr));
+    }
+    blocks[block_idx]["code"] = std::move(new_code);
+  }
+  (*stats)["hoisted_ops"] += (uint32_t)hoisted_code.size();
+
+  std::vector<size_t> outside_preds;
+  for (auto pred : graph.preds[header]) {
+    if (body.find(pred) == body.end())
+      outside_preds.push_back(pred);
+  }
+  auto header_label = blocks[header]["label"].get<std::string>();
+
+  // Put the hoisted ops at the end of the block leading into the loop if there's only one
+  if (outside_preds.size() == 1 && graph.succs[outside_preds[0]].size() == 1) {
+    auto &pred_code = blocks[outside_preds[0]]["code"].get_ref<json::array_t &>();
+    const auto &last = pred_code.back();
+    if (last["op"] == "JUMP" && last["jump_type"] == "ALWAYS") {
+      pred_code.insert(pred_code.end() - 1, hoisted_code.begin(), hoisted_code.end());
+      return;
+    }
+  }
+
+  // Otherwise they need a new block of their own for everything entering the loop to go through
+  std::set<std::string> labels;
+  for (const auto &block : blocks)
+    labels.insert(block["label"].get<std::string>());
+  std::string preheader_label;
+  for (size_t label_num = blocks.size(); preheader_label.empty() || labels.count(preheader_label); ++label_num)
+    preheader_label = "_block" + std::to_string(label_num);
+  for (auto pred : outside_preds)
+    redirect_jumps(blocks[pred]["code"].back(), header_label, preheader_label);
+  hoisted_code.push_back({{"op", "JUMP"}, {"jump_type", "ALWAYS"}, {"label", header_label}});
+  blocks.insert(blocks.begin() + (ptrdiff_t)header, json {
+      {"label", preheader_label},
+      {"code", std::move(hoisted_code)}
+  });
+}
+
+static void hoist_loop_invariants(json &func_like, RegisterIROptStats *stats) {
+  std::set<std::string> done_headers;
+  for (;;) {
+    const auto &blocks = func_like["blocks"];
+    auto graph = build_block_graph(blocks);
+    auto loops = find_loops(graph);
+    // Inner loops go first, so what's hoisted out of them can be hoisted out of outer loops too
+    size_t header = SIZE_MAX;
+    for (const auto &loop : loops) {
+      if (done_headers.count(blocks[loop.first]["label"].get<std::string>()))
+        continue;
+      if (header == SIZE_MAX || loop.second.size() < loops[header].size())
+        header = loop.first;
+    }
+    if (header == SIZE_MAX)
+      break;
+    done_headers.insert(blocks[header]["label"].get<std::string>());
+    hoist_from_loop(func_like, graph, header, loops[header], stats);
+  }
+}
+
+// Pure ops whose results aren't used by anything can go
+static void remove_dead_ops(json &func_like, RegisterIROptStats *stats) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    std::vector<uint32_t> use_counts(func_like["registers"].size(), 0);
+    for (const auto &block : func_like["blocks"]) {
+      for (const auto &instr : block["code"]) {
+        for (auto reg : get_register_operands(instr)) {
+          if (reg < use_counts.size())
+            ++use_counts[reg];
+        }
+      }
+    }
+    for (auto &block : func_like["blocks"]) {
+      json::array_t new_code;
+      for (auto &instr : block["code"]) {
+        if (instr.contains("dest") && is_pure(instr)) {
+          auto dest = instr["dest"].get<uint32_t>();
+          if (dest < use_counts.size() && !use_counts[dest]) {
+            (*stats)["dead_ops"] += 1;
+            changed = true;
+            continue;
+          }
+        }
+        new_code.push_back(std::move(instr));
+      }
+      block["code"] = std::move(new_code);
+    }
+  }
+}
+
+static void optimize_func_like(json &func_like, const RegisterIROptOptions &options, RegisterIROptStats *stats) {
+  if (options.cse)
+    eliminate_common_subexpressions(func_like, stats);
+  if (options.licm) {
+    hoist_loop_invariants(func_like, stats);
+    // hoisting can leave the same value being computed twice before the loop
+    if (options.cse)
+      eliminate_common_subexpressions(func_like, stats);
+  }
+  remove_dead_ops(func_like, stats);
+}
+
+void optimize_register_ir(json &register_ir, const RegisterIROptOptions &options, RegisterIROptStats *stats) {
+  (*stats)["common_subexpressions"] += 0;
+  (*stats)["hoisted_ops"] += 0;
+  (*stats)["dead_ops"] += 0;
+  // `init_code` only runs once and has no locals to keep shared values in, leave it alone.
+  for (auto &func : register_ir["functions"])
+    optimize_func_like(func, options, stats);
+  for (auto &state : register_ir["states"]) {
+    for (auto &handler : state["handlers"])
+      optimize_func_like(handler, options, stats);
+  }
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "../extern/json.hh"
+
+namespace Tailslide {
+
+struct RegisterIROptOptions {
+  // Reuse the result of a pure op instead of computing it again later in the same block
+  bool cse = false;
+  // Compute pure ops whose operands don't change within a loop once, before the loop
+  bool licm = false;
+};
+
+// what was removed or moved -> how many of them
+typedef std::map<std::string, uint32_t> RegisterIROptStats;
+
+// Removes redundant computation from the functions and handlers in register IR.
+//
+// Only loads, constants, operators, casts, building values and calls to builtins in a table of
+// pure builtins are ever touched. Values are all copied rather than referenced, so a load only
+// gives the same value as an earlier one if nothing stored to the slot in between, and calls to
+// the script's own functions might change any global. Hoisting never moves ops that could stop
+// the script, like division, so a loop that never runs still can't fail.
+//
+// Ops that are moved or reused keep their relative order, evaluation order is unchanged otherwise.
+// Pure ops whose results end up unused are removed.
+void optimize_register_ir(nlohmann::json &register_ir, const RegisterIROptOptions &options,
+                          RegisterIROptStats *stats);
+
+}
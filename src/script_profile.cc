@@ -0,0 +1,53 @@
+#include "script_profile.hh"
+#include "../extern/json.hh"
+
+namespace Tailslide {
+
+using json = nlohmann::json;
+
+static const BranchProfile EMPTY_BRANCH {};
+static const LoopProfile EMPTY_LOOP {};
+
+std::string get_profile_key(LSLASTNode *node) {
+  auto *loc = node->getLoc();
+  return std::to_string(loc->first_line) + ":" + std::to_string(loc->first_column);
+}
+
+bool ScriptProfile::fromJSON(const std::string &json_str, ScriptProfile *profile, std::string *error) {
+  try {
+    auto profile_json = json::parse(json_str);
+    for (auto &call : profile_json.value("calls", json::object()).items())
+      profile->calls[call.key()] = call.value().get<uint64_t>();
+    for (auto &branch : profile_json.value("branches", json::object()).items()) {
+      auto &branch_profile = profile->branches[branch.key()];
+      branch_profile.taken = branch.value().at("taken").get<uint64_t>();
+      branch_profile.not_taken = branch.value().at("not_taken").get<uint64_t>();
+    }
+    for (auto &loop : profile_json.value("loops", json::object()).items()) {
+      auto &loop_profile = profile->loops[loop.key()];
+      loop_profile.entries = loop.value().at("entries").get<uint64_t>();
+      loop_profile.iterations = loop.value().at("iterations").get<uint64_t>();
+    }
+  } catch (const json::exception &e) {
+    *error = e.what();
+    return false;
+  }
+  return true;
+}
+
+uint64_t ScriptProfile::getCalls(const std::string &func_name) const {
+  auto call_iter = calls.find(func_name);
+  return (call_iter == calls.end()) ? 0 : call_iter->second;
+}
+
+const BranchProfile &ScriptProfile::getBranch(LSLASTNode *node) const {
+  auto branch_iter = branches.find(get_profile_key(node));
+  return (branch_iter == branches.end()) ? EMPTY_BRANCH : branch_iter->second;
+}
+
+const LoopProfile &ScriptProfile::getLoop(LSLASTNode *node) const {
+  auto loop_iter = loops.find(get_profile_key(node));
+  return (loop_iter == loops.end()) ? EMPTY_LOOP : loop_iter->second;
+}
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <tailslide/tailslide.hh>
+
+namespace Tailslide {
+
+struct BranchProfile {
+  uint64_t taken = 0;
+  uint64_t not_taken = 0;
+};
+
+struct LoopProfile {
+  uint64_t entries = 0;
+  uint64_t iterations = 0;
+};
+
+// Execution counts recorded by running a script compiled with instrumentation.
+// Branches and loops are keyed on their position in the source, so that
+// the same profile can be applied no matter what other options are in use.
+struct ScriptProfile {
+  std::map<std::string, uint64_t> calls;
+  std::map<std::string, BranchProfile> branches;
+  std::map<std::string, LoopProfile> loops;
+
+  // Parses the JSON form written by the runtime's `ScriptProfile.to_json()`
+  static bool fromJSON(const std::string &json_str, ScriptProfile *profile, std::string *error);
+
+  uint64_t getCalls(const std::string &func_name) const;
+  const BranchProfile &getBranch(LSLASTNode *node) const;
+  const LoopProfile &getLoop(LSLASTNode *node) const;
+};
+
+// Key identifying a branch or loop within the profile
+std::string get_profile_key(LSLASTNode *node);
+
+}
@@ -0,0 +1,92 @@
+#include <set>
+#include <string>
+#include <utility>
+
+#include "switch_detection.hh"
+
+namespace Tailslide {
+
+static LSLExpression *strip_parens(LSLExpression *expr) {
+  while (expr->getNodeSubType() == NODE_PARENTHESIS_EXPRESSION)
+    expr = ((LSLParenthesisExpression *) expr)->getChildExpr();
+  return expr;
+}
+
+static LSLExpression *strip_check_wrappers(LSLExpression *expr) {
+  expr = strip_parens(expr);
+  // `if` checks get wrapped in a conversion to bool, which changes nothing for a comparison
+  if (expr->getNodeSubType() == NODE_BOOL_CONVERSION_EXPRESSION)
+    expr = strip_parens(((LSLBoolConversionExpression *) expr)->getChildExpr());
+  return expr;
+}
+
+static bool is_switch_subject(LSLExpression *expr) {
+  if (expr->getNodeSubType() != NODE_LVALUE_EXPRESSION || expr->getConstantValue())
+    return false;
+  if (((LSLLValueExpression *) expr)->getMember())
+    return false;
+  // Only types where `==` means the same thing as equality of dict keys
+  auto type = expr->getIType();
+  return type == LST_INTEGER || type == LST_STRING;
+}
+
+// Matches `subject == constant` or `constant == subject`
+static bool match_case_check(LSLExpression *check_expr, LSLLValueExpression **subject, LSLConstant **value) {
+  check_expr = strip_check_wrappers(check_expr);
+  if (check_expr->getNodeSubType() != NODE_BINARY_EXPRESSION)
+    return false;
+  auto *bin_expr = (LSLBinaryExpression *) check_expr;
+  if (bin_expr->getOperation() != OP_EQ)
+    return false;
+
+  auto *lhs = strip_parens(bin_expr->getLHS());
+  auto *rhs = strip_parens(bin_expr->getRHS());
+  if (!is_switch_subject(lhs))
+    std::swap(lhs, rhs);
+  if (!is_switch_subject(lhs))
+    return false;
+  auto *const_val = rhs->getConstantValue();
+  if (!const_val || const_val->getIType() != lhs->getIType())
+    return false;
+  *subject = (LSLLValueExpression *) lhs;
+  *value = const_val;
+  return true;
+}
+
+void collect_switch_chain(LSLIfStatement *if_stmt, SwitchChain &chain) {
+  std::set<int32_t> seen_ints;
+  std::set<std::string> seen_strs;
+
+  LSLASTNode *node = if_stmt;
+  while (node && node->getNodeSubType() == NODE_IF_STATEMENT) {
+    auto *cur_if = (LSLIfStatement *) node;
+    LSLLValueExpression *subject;
+    LSLConstant *value;
+    if (!match_case_check(cur_if->getCheckExpr(), &subject, &value))
+      break;
+    if (chain.subject && chain.subject->getSymbol() != subject->getSymbol())
+      break;
+
+    // A repeated value could never be reached through the original chain,
+    // easier to just leave it and everything after it for the default case.
+    bool is_new;
+    if (value->getIType() == LST_INTEGER)
+      is_new = seen_ints.insert(((LSLIntegerConstant *) value)->getValue()).second;
+    else
+      is_new = seen_strs.insert(((LSLStringConstant *) value)->getValue()).second;
+    if (!is_new)
+      break;
+
+    chain.subject = subject;
+    chain.cases.push_back({cur_if, value, cur_if->getTrueBranch()});
+    node = cur_if->getFalseBranch();
+  }
+  chain.default_body = node;
+}
+
+bool find_switch_chain(LSLIfStatement *if_stmt, SwitchChain &chain) {
+  collect_switch_chain(if_stmt, chain);
+  return chain.cases.size() >= MIN_SWITCH_CASES;
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include <tailslide/tailslide.hh>
+
+namespace Tailslide {
+
+// Chains shorter than this aren't worth dispatching through a table
+const size_t MIN_SWITCH_CASES = 4;
+
+struct SwitchCase {
+  LSLIfStatement *if_stmt;
+  LSLConstant *value;
+  LSLASTNode *body;
+};
+
+// An `if (x == a) ... else if (x == b) ... else ...` chain, all comparing
+// the same variable against distinct constants.
+struct SwitchChain {
+  LSLLValueExpression *subject = nullptr;
+  std::vector<SwitchCase> cases;
+  // Whatever's left at the end of the chain, may be `nullptr`
+  LSLASTNode *default_body = nullptr;
+};
+
+// Collects as much of the chain starting at `if_stmt` as can be treated as a switch.
+// Only one case can ever match, so the cases may be checked in any order.
+void collect_switch_chain(LSLIfStatement *if_stmt, SwitchChain &chain);
+// Same, but returns whether the chain is long enough to be worth a table
+bool find_switch_chain(LSLIfStatement *if_stmt, SwitchChain &chain);
+
+}
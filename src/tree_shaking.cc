@@ -0,0 +1,190 @@
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <tailslide/visitor.hh>
+
+#include "ast_utils.hh"
+#include "tree_shaking.hh"
+
+namespace Tailslide {
+
+// Serializes the structure of a function such that functions differing only in
+// their own name and the names of their locals and labels come out the same.
+// Called functions are referred to by whatever they'll currently resolve to,
+// so merging callees can make their callers mergeable too.
+class FunctionFingerprintVisitor : public ASTVisitor {
+  public:
+    FunctionFingerprintVisitor(const TreeShaker *shaker, LSLSymbol *func_sym) :
+        _mShaker(shaker), _mFuncSym(func_sym) {}
+
+    std::stringstream mStr;
+    // Set if there was something we don't know how to compare
+    bool mMergeable = true;
+
+  protected:
+    bool visit(LSLASTNode *node) override {
+      return writeNode(node);
+    }
+
+    bool visit(LSLIdentifier *ident) override {
+      auto *sym = ident->getSymbol();
+      // coordinate members don't have symbols
+      if (!sym)
+        return writeNode(ident, writeStr(ident->getName()));
+      if (sym == _mFuncSym)
+        return writeNode(ident, "@self");
+      if (sym->getSymbolType() == SYM_FUNCTION && sym->getSubType() != SYM_BUILTIN)
+        return writeNode(ident, "@" + writeStr(_mShaker->resolve(sym)->getName()));
+      switch (sym->getSubType()) {
+        case SYM_LOCAL:
+        case SYM_FUNCTION_PARAMETER:
+        case SYM_EVENT_PARAMETER:
+          return writeNode(ident, "$" + std::to_string(getLocalIndex(sym)));
+        default:
+          break;
+      }
+      if (sym->getSymbolType() == SYM_LABEL)
+        return writeNode(ident, "$" + std::to_string(getLocalIndex(sym)));
+      return writeNode(ident, "#" + writeStr(sym->getName()));
+    }
+
+    bool visit(LSLBinaryExpression *bin_expr) override {
+      return writeNode(bin_expr, std::to_string((int)bin_expr->getOperation()));
+    }
+
+    bool visit(LSLUnaryExpression *unary_expr) override {
+      return writeNode(unary_expr, std::to_string((int)unary_expr->getOperation()));
+    }
+
+    bool visit(LSLIntegerConstant *int_const) override {
+      return writeNode(int_const, std::to_string(int_const->getValue()));
+    }
+
+    bool visit(LSLFloatConstant *float_const) override {
+      return writeNode(float_const, writeFloat(float_const->getValue()));
+    }
+
+    bool visit(LSLStringConstant *str_const) override {
+      return writeNode(str_const, writeStr(str_const->getValue()));
+    }
+
+    bool visit(LSLKeyConstant *key_const) override {
+      return writeNode(key_const, writeStr(key_const->getValue()));
+    }
+
+    bool visit(LSLVectorConstant *vec_const) override {
+      auto *val = vec_const->getValue();
+      return writeNode(vec_const, writeFloat(val->x) + writeFloat(val->y) + writeFloat(val->z));
+    }
+
+    bool visit(LSLQuaternionConstant *quat_const) override {
+      auto *val = quat_const->getValue();
+      return writeNode(quat_const,
+          writeFloat(val->x) + writeFloat(val->y) + writeFloat(val->z) + writeFloat(val->s));
+    }
+
+    bool visit(LSLListConstant *list_const) override {
+      mMergeable = false;
+      return false;
+    }
+
+    bool writeNode(LSLASTNode *node, const std::string &details = "") {
+      mStr << '[' << node->getNodeType() << ':' << node->getNodeSubType() << ':' << node->getIType();
+      mStr << ':' << details << '(';
+      visitChildren(node);
+      mStr << ")]";
+      return false;
+    }
+
+    static std::string writeStr(const char *str) {
+      // length-prefixed so the contents can't be confused for structure
+      std::string val {str};
+      return std::to_string(val.size()) + "'" + val;
+    }
+
+    static std::string writeFloat(float val) {
+      // exact, and distinguishes -0.0 from 0.0
+      std::stringstream sstr;
+      sstr << std::hexfloat << val << ',';
+      return sstr.str();
+    }
+
+    int getLocalIndex(LSLSymbol *sym) {
+      auto local_iter = _mLocalIndices.find(sym);
+      if (local_iter != _mLocalIndices.end())
+        return local_iter->second;
+      int idx = (int)_mLocalIndices.size();
+      _mLocalIndices[sym] = idx;
+      return idx;
+    }
+
+    const TreeShaker *_mShaker;
+    LSLSymbol *_mFuncSym;
+    std::map<LSLSymbol *, int> _mLocalIndices;
+};
+
+void TreeShaker::shake(LSLScript *script) {
+  std::map<LSLSymbol *, LSLASTNode *> func_nodes;
+  std::vector<LSLSymbol *> func_order;
+  for (auto *glob : *script->getGlobals()) {
+    if (glob->getNodeType() != NODE_GLOBAL_FUNCTION)
+      continue;
+    func_nodes[glob->getSymbol()] = glob;
+    func_order.push_back(glob->getSymbol());
+  }
+
+  // Event handlers are the only way in, anything they can't reach is dead.
+  CalleeCollectingVisitor handler_visitor;
+  script->getStates()->visit(&handler_visitor);
+  std::vector<LSLSymbol *> pending {std::move(handler_visitor.mCallees)};
+  while (!pending.empty()) {
+    auto *sym = pending.back();
+    pending.pop_back();
+    if (!_mReachable.insert(sym).second)
+      continue;
+    CalleeCollectingVisitor func_visitor;
+    func_nodes[sym]->visit(&func_visitor);
+    pending.insert(pending.end(), func_visitor.mCallees.begin(), func_visitor.mCallees.end());
+  }
+
+  // Merging functions may make their callers identical as well, so keep
+  // going until nothing else merges. The first definition always wins.
+  bool merged_any = true;
+  while (merged_any) {
+    merged_any = false;
+    std::map<std::string, LSLSymbol *> fingerprints;
+    for (auto *sym : func_order) {
+      if (!isKept(sym))
+        continue;
+      FunctionFingerprintVisitor fingerprint_visitor(this, sym);
+      func_nodes[sym]->visit(&fingerprint_visitor);
+      if (!fingerprint_visitor.mMergeable)
+        continue;
+      auto inserted = fingerprints.emplace(fingerprint_visitor.mStr.str(), sym);
+      if (!inserted.second) {
+        _mMerged[sym] = inserted.first->second;
+        merged_any = true;
+      }
+    }
+  }
+}
+
+bool TreeShaker::isKept(LSLSymbol *func_sym) const {
+  return isReachable(func_sym) && _mMerged.find(func_sym) == _mMerged.end();
+}
+
+bool TreeShaker::isReachable(LSLSymbol *func_sym) const {
+  return _mReachable.find(func_sym) != _mReachable.end();
+}
+
+LSLSymbol *TreeShaker::resolve(LSLSymbol *func_sym) const {
+  auto merged_iter = _mMerged.find(func_sym);
+  while (merged_iter != _mMerged.end()) {
+    func_sym = merged_iter->second;
+    merged_iter = _mMerged.find(func_sym);
+  }
+  return func_sym;
+}
+
+}
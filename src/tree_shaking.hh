@@ -0,0 +1,28 @@
+#pragma once
+
+#include <map>
+#include <set>
+
+#include <tailslide/tailslide.hh>
+
+namespace Tailslide {
+
+// Whole-script analysis of which global functions can ever be called from an
+// event handler, and which ones are structurally identical to another function
+// such that calls to them can go to a single shared copy.
+class TreeShaker {
+  public:
+    void shake(LSLScript *script);
+    // Whether `func_sym` needs its own definition in the output
+    bool isKept(LSLSymbol *func_sym) const;
+    bool isReachable(LSLSymbol *func_sym) const;
+    // The function that should actually be called in place of `func_sym`
+    LSLSymbol *resolve(LSLSymbol *func_sym) const;
+
+  protected:
+    std::set<LSLSymbol *> _mReachable;
+    // merged function -> the function whose definition it shares
+    std::map<LSLSymbol *, LSLSymbol *> _mMerged;
+};
+
+}
@@ -1,8 +1,13 @@
 import asyncio
+import copy
 import json
 import os.path
 import pathlib
+import tempfile
+import threading
+import time
 import unittest
+import unittest.mock
 
 import pytest_httpbin
 
@@ -14,8 +19,42 @@ BASE_PATH = pathlib.Path(os.path.dirname(os.path.abspath(__file__)))
 RESOURCES_PATH = BASE_PATH / "test_resources"
 
 
-def _compile_script_filename(lsl_filename):
-    return lummao.compile_script_file(RESOURCES_PATH / lsl_filename)
+def _compile_script_filename(lsl_filename, **options):
+    return lummao.compile_script_file(RESOURCES_PATH / lsl_filename, **options)
+
+
+def _run_with_big_stack(func):
+    # Parsing and type checking still recurse once per nesting level, give them room.
+    result = {}
+
+    def _wrapper():
+        try:
+            result["val"] = func()
+        except BaseException as e:
+            result["exc"] = e
+
+    old_size = threading.stack_size(512 * 1024 * 1024)
+    try:
+        thread = threading.Thread(target=_wrapper)
+        thread.start()
+        thread.join()
+    finally:
+        threading.stack_size(old_size)
+    if "exc" in result:
+        raise result["exc"]
+    return result["val"]
+
+
+def _make_long_sum_script(num_terms):
+    return """
+    integer gResult;
+    default {
+        state_entry() {
+            integer i = 1;
+            gResult = %s;
+        }
+    }
+    """ % " + ".join(["i"] * num_terms)
 
 
 class HarnessTestCase(unittest.IsolatedAsyncioTestCase):
@@ -32,6 +71,35 @@ class HarnessTestCase(unittest.IsolatedAsyncioTestCase):
         self.assertEqual(187, script.gTestsPassed)
         self.assertEqual(0, script.gTestsFailed)
 
+    async def test_run_conformance_suite_options(self):
+        option_sets = [
+            {"promote_loop_globals": True},
+            {"elide_int_wraparound": True},
+            {"simplify_casts": True},
+            {"bind_helpers": True},
+            {"eliminate_dead_vars": True},
+            {"tree_shaking": True},
+        ]
+        for options in option_sets:
+            with self.subTest(**options):
+                script = _compile_script_filename("lsl_conformance.lsl", **options)
+                await script.edefaultstate_entry()
+                self.assertEqual(187, script.gTestsPassed)
+                self.assertEqual(0, script.gTestsFailed)
+
+        # and run what the minifier makes of it
+        for options in ({"shorten_identifiers": False}, {}):
+            with self.subTest(minify=True, **options):
+                minified = lummao.minify_script_file(RESOURCES_PATH / "lsl_conformance.lsl", **options)
+                # The counters are the first two globals, whatever they ended up being called
+                passed_name, failed_name = (
+                    line.split(b" ")[1].rstrip(b";").decode() for line in minified.split(b"\n")[:2]
+                )
+                script = lummao.compile_script(minified)
+                await script.edefaultstate_entry()
+                self.assertEqual(187, getattr(script, passed_name))
+                self.assertEqual(0, getattr(script, failed_name))
+
     async def test_run_execute_loop_with_state_changes(self):
         script = _compile_script_filename("lsl_conformance2.lsl")
         # Handles the internal state changes and whatnot
@@ -39,6 +107,1107 @@ class HarnessTestCase(unittest.IsolatedAsyncioTestCase):
         self.assertEqual(69, script.gTestsPassed)
         self.assertEqual(0, script.gTestsFailed)
 
+    async def test_run_conformance_suite_lazy(self):
+        script = _compile_script_filename("lsl_conformance.lsl", lazy_methods=True)
+        # Nothing should be compiled until it's actually used
+        self.assertIsInstance(type(script).__dict__["testReturnFloat"], lummao.LazyMethod)
+        await script.edefaultstate_entry()
+        self.assertEqual(187, script.gTestsPassed)
+        self.assertEqual(0, script.gTestsFailed)
+        self.assertNotIsInstance(type(script).__dict__["testReturnFloat"], lummao.LazyMethod)
+
+    async def test_run_execute_loop_with_state_changes_lazy(self):
+        script = _compile_script_filename("lsl_conformance2.lsl", lazy_methods=True)
+        await script.execute()
+        self.assertEqual(69, script.gTestsPassed)
+        self.assertEqual(0, script.gTestsFailed)
+
+    async def test_lazy_method_aliases(self):
+        lsl_src = """
+        integer gTotal;
+        integer twice(integer val) {
+            return val * 2;
+        }
+        integer twiceAgain(integer val) {
+            return val * 2;
+        }
+        default {
+            state_entry() {
+                gTotal = twice(1) + twiceAgain(2);
+            }
+        }
+        """
+        script = lummao.compile_script(lsl_src, lazy_methods=True, tree_shaking=True)
+        script_cls = type(script)
+        self.assertIs(script_cls.__dict__["twice"], script_cls.__dict__["twiceAgain"])
+        await script.edefaultstate_entry()
+        self.assertEqual(6, script.gTotal)
+        # Compiling it through one name replaces it under all of them
+        self.assertNotIsInstance(script_cls.__dict__["twiceAgain"], lummao.LazyMethod)
+        self.assertIs(script_cls.__dict__["twice"], script_cls.__dict__["twiceAgain"])
+
+    async def test_promoted_loop_globals(self):
+        py_src = lummao.convert_script_file(RESOURCES_PATH / "loop_globals.lsl", promote_loop_globals=True)
+        self.assertIn(b"promoted_gCounter = self.gCounter", py_src)
+        script = _compile_script_filename("loop_globals.lsl", promote_loop_globals=True)
+        await script.edefaultstate_entry()
+        # Values need to be written back when leaving through `return` and `jump` too
+        self.assertEqual(8, script.gCounter)
+        self.assertEqual(3.5, script.gTotal)
+        self.assertEqual(6.0, script.gPos[0])
+
+        # A local can't be mistaken for the promoted global, whatever it's called
+        lsl_src = """
+        integer gCounter;
+        default {
+            state_entry() {
+                integer promoted_gCounter = 2;
+                integer i;
+                for (i = 0; i < 3; ++i)
+                    gCounter += promoted_gCounter;
+            }
+        }
+        """
+        script = lummao.compile_script(lsl_src, promote_loop_globals=True)
+        await script.edefaultstate_entry()
+        self.assertEqual(6, script.gCounter)
+
+    async def test_elide_int_wraparound(self):
+        py_src = lummao.convert_script_file(RESOURCES_PATH / "int_ranges.lsl", elide_int_wraparound=True)
+        self.assertIn(b"(_i + 1)", py_src)
+        script = _compile_script_filename("int_ranges.lsl", elide_int_wraparound=True)
+        await script.edefaultstate_entry()
+        self.assertEqual(30, script.gResult)
+        # Anything that could overflow still needs to wrap
+        self.assertEqual(-2147483648, script.gWrapped)
+
+    async def test_simplify_casts(self):
+        lsl_src = """
+        string gStr;
+        key gKey;
+        list gList;
+        default {
+            state_entry() {
+                integer i = 42;
+                gStr = (string)(key)(string)i;
+                gKey = (key)gStr;
+                gList = (list)i + (list)(string)(key)gStr;
+            }
+        }
+        """
+        py_src = lummao.convert_script(lsl_src, simplify_casts=True)
+        self.assertIn(b"str(_i)", py_src)
+        self.assertNotIn(b"typecast(typecast(", py_src)
+        script = lummao.compile_script(lsl_src, simplify_casts=True)
+        await script.edefaultstate_entry()
+        self.assertEqual("42", script.gStr)
+        self.assertEqual("42", script.gKey)
+        self.assertEqual([42, "42"], script.gList)
+
+    async def test_bind_helpers(self):
+        lsl_src = """
+        integer gTotal;
+        integer double(integer val) {
+            return val * 2;
+        }
+        default {
+            state_entry() {
+                // can't be confused with the bound method
+                integer bound_double;
+                integer i;
+                for (i = 0; i < 3; ++i) {
+                    bound_double = i;
+                    gTotal = gTotal + double(bound_double);
+                }
+            }
+        }
+        """
+        py_src = lummao.convert_script(lsl_src, bind_helpers=True)
+        self.assertIn(b"radd=radd", py_src)
+        self.assertIn(b"bound_double = self.double", py_src)
+        script = lummao.compile_script(lsl_src, bind_helpers=True)
+        await script.edefaultstate_entry()
+        self.assertEqual(6, script.gTotal)
+
+        # Helpers bound as defaults can still be swapped out
+        add_calls = []
+
+        def _counting_radd(rhs, lhs, f32=True):
+            add_calls.append((rhs, lhs))
+            return lummao.radd(rhs, lhs, f32)
+
+        lummao.rebind_helpers(script, radd=_counting_radd)
+        await script.edefaultstate_entry()
+        self.assertEqual(12, script.gTotal)
+        self.assertEqual(3, len(add_calls))
+
+        # Rebinding a subclass's helpers leaves the class it inherits from alone
+        base_cls = type(lummao.compile_script(lsl_src, bind_helpers=True))
+        derived_cls = type("DerivedScript", (base_cls,), {})
+        lummao.rebind_helpers(derived_cls, radd=_counting_radd)
+        add_calls.clear()
+        await base_cls().edefaultstate_entry()
+        self.assertEqual(0, len(add_calls))
+        await derived_cls().edefaultstate_entry()
+        self.assertEqual(3, len(add_calls))
+
+    async def test_switch_dispatch(self):
+        py_src = lummao.convert_script_file(RESOURCES_PATH / "switch_chain.lsl", switch_dispatch=True)
+        self.assertIn(b"\nswitch0 = {", py_src)
+        self.assertIn(b"\nswitch1 = {1: 0, 2: 1, 3: 2, 5: 3}", py_src)
+        script = _compile_script_filename("switch_chain.lsl", switch_dispatch=True)
+        await script.edefaultstate_entry()
+        self.assertEqual(-580, script.gResult)
+        self.assertEqual("other one two three other five ", script.gNames)
+
+    async def test_switch_jump_tables(self):
+        with open(RESOURCES_PATH / "switch_chain.lsl", "rb") as f:
+            lsl_src = f.read()
+
+        def _find_ops(node, op_name):
+            if isinstance(node, dict):
+                if node.get("op") == op_name:
+                    yield node
+                for val in node.values():
+                    yield from _find_ops(val, op_name)
+            elif isinstance(node, list):
+                for val in node:
+                    yield from _find_ops(val, op_name)
+
+        self.assertEqual([], list(_find_ops(lummao.convert_script_to_ir(lsl_src), "JUMP_TABLE")))
+        tables = list(_find_ops(lummao.convert_script_to_ir(lsl_src, jump_tables=True), "JUMP_TABLE"))
+        self.assertEqual(2, len(tables))
+        self.assertEqual(["zero", "one", "two", "three", "four"], [c["value"] for c in tables[0]["cases"]])
+
+    async def test_ir_peephole(self):
+        lsl_src = """
+        integer gVal;
+        integer test(integer a) {
+            if (a) {
+                return 1;
+                gVal = 77;
+            }
+            while (a) {
+                if (a > 2)
+                    jump done;
+                a--;
+            }
+            @done;
+            return 0;
+        }
+        default {
+            state_entry() {
+                gVal = test(3);
+            }
+        }
+        """
+
+        def _test_code(ir):
+            return next(func for func in ir["functions"] if func["name"] == "test")["code"]
+
+        plain_code = _test_code(lummao.convert_script_to_ir(lsl_src))
+        self.assertNotIn("peephole_stats", lummao.convert_script_to_ir(lsl_src))
+        ir = lummao.convert_script_to_ir(lsl_src, peephole=True)
+        code = _test_code(ir)
+        self.assertLess(len(code), len(plain_code))
+        # Nothing can follow a RET until there's a label to jump to
+        for instr, next_instr in zip(code, code[1:]):
+            if instr.get("op") == "RET":
+                self.assertEqual("label", next_instr["instr_type"])
+        # `gVal = 77` is gone
+        self.assertNotIn(77, [instr.get("value") for instr in code])
+        stats = ir["peephole_stats"]
+        self.assertEqual(
+            {"push_pop", "dup_store_pop", "jump_threading", "jump_to_next", "unreachable_code", "cast_pairs"},
+            set(stats),
+        )
+        self.assertLess(0, stats["unreachable_code"])
+
+        # Something for each of the other rules, mostly left behind by removing dead stores
+        rules_src = """
+        integer gVal;
+        integer gOther;
+        default {
+            state_entry() {
+                string str = llGetTimestamp();
+                key unread_key;
+                integer unread = gVal;
+                integer unread_too = (gOther = 5);
+                // `(key)` then `(string)` once nothing's left between them
+                llOwnerSay((string)(unread_key = (key)str));
+                while (gVal < 10) {
+                    if (gVal > 2)
+                        gVal += 2;
+                    else
+                        gVal += 1;
+                }
+                jump next;
+                @next;
+                llOwnerSay((string)gOther);
+            }
+        }
+        """
+        ir = lummao.convert_script_to_ir(rules_src, peephole=True, eliminate_dead_stores=True)
+        stats = ir["peephole_stats"]
+        for rule in ("push_pop", "dup_store_pop", "jump_threading", "jump_to_next", "cast_pairs"):
+            with self.subTest(rule=rule):
+                self.assertLess(0, stats[rule])
+        code = ir["states"][0]["handlers"][0]["code"]
+        casts = [(instr["from_type"], instr["to_type"]) for instr in code if instr.get("op") == "CAST"]
+        self.assertEqual([("integer", "string")], casts)
+
+        ir = lummao.convert_script_to_ir(lsl_src, peephole=["unreachable_code"])
+        self.assertEqual(["unreachable_code"], list(ir["peephole_stats"]))
+        with self.assertRaises(ValueError):
+            lummao.convert_script_to_ir(lsl_src, peephole=["not_a_rule"])
+        # A bare string is a single rule name, not a collection of one-letter ones
+        ir = lummao.convert_script_to_ir(lsl_src, peephole="unreachable_code")
+        self.assertEqual(["unreachable_code"], list(ir["peephole_stats"]))
+        with self.assertRaises(ValueError):
+            lummao.convert_script_to_ir(lsl_src, peephole="dup_store")
+
+    async def test_ir_superinstructions(self):
+        from lummao import ir_stats
+
+        lsl_src = """
+        default {
+            state_entry() {
+                integer total;
+                integer i;
+                for (i = 0; i < 10; ++i) {
+                    total += i;
+                }
+                llOwnerSay((string)total);
+            }
+        }
+        """
+        plain_ir = lummao.convert_script_to_ir(lsl_src)
+        counts = ir_stats.count_op_sequences(plain_ir, 4)
+        self.assertEqual(1, counts[(
+            "PUSH_CONSTANT integer", "PUSH LOCAL integer", "BIN_OP LESS integer integer", "JUMP NIF"
+        )])
+
+        plain_code = plain_ir["states"][0]["handlers"][0]["code"]
+        code = lummao.convert_script_to_ir(lsl_src, superinstructions=True)["states"][0]["handlers"][0]["code"]
+        self.assertLess(len(code), len(plain_code))
+        incr = next(instr for instr in code if instr.get("op") == "INCR_LOCAL")
+        self.assertEqual(("integer", "LOCAL", "PLUS", 1), (incr["type"], incr["whence"], incr["operation"], incr["value"]))
+        cmp_jump = next(instr for instr in code if instr.get("op") == "CMP_LOCAL_CONST_JUMP")
+        self.assertEqual(("LESS", 10, "NIF"), (cmp_jump["operation"], cmp_jump["value"], cmp_jump["jump_type"]))
+        self.assertIn("STORE_CONSTANT", [instr.get("op") for instr in code])
+
+    async def test_register_ir(self):
+        with open(RESOURCES_PATH / "lsl_conformance2.lsl", "rb") as f:
+            lsl_src = f.read()
+
+        def _func_likes(ir):
+            yield from ir["functions"]
+            for state in ir["states"]:
+                yield from state["handlers"]
+
+        stack_ir = lummao.convert_script_to_ir(lsl_src)
+        register_ir = lummao.convert_script_to_register_ir(lsl_src)
+        num_stack_ops = sum(
+            1 for func in _func_likes(stack_ir) for instr in func["code"] if instr["instr_type"] == "op"
+        )
+        num_register_ops = 0
+        for func in _func_likes(register_ir):
+            dests = []
+            for block in func["blocks"]:
+                num_register_ops += len(block["code"])
+                dests.extend(instr["dest"] for instr in block["code"] if "dest" in instr)
+            # Every register is assigned exactly once
+            self.assertEqual(list(range(len(func["registers"]))), sorted(dests))
+            for block in func["blocks"][:-1]:
+                self.assertIn(block["code"][-1]["op"], ("JUMP", "JUMP_TABLE", "RET"))
+        self.assertLess(num_register_ops, num_stack_ops)
+
+        round_trip = lummao.register_ir_to_stack_ir(register_ir, verify_types=True)
+        self.assertEqual(stack_ir["globals"], round_trip["globals"])
+        self.assertEqual(
+            [(func["name"], func["args"]) for func in _func_likes(stack_ir)],
+            [(func["name"], func["args"]) for func in _func_likes(round_trip)],
+        )
+
+        # Only how values get shuffled around on the stack and between blocks may change,
+        # everything that computes something or has an effect stays in the same order.
+        shuffle_ops = {"PUSH", "STORE", "POP_N", "DUP", "PUSH_EMPTY", "JUMP"}
+
+        def _value_ops(func):
+            return [
+                {k: v for k, v in instr.items() if k != "stack_types"}
+                for instr in func["code"] if instr["instr_type"] == "op" and instr["op"] not in shuffle_ops
+            ]
+
+        for orig_func, round_trip_func in zip(_func_likes(stack_ir), _func_likes(round_trip)):
+            self.assertEqual(_value_ops(orig_func), _value_ops(round_trip_func))
+        # Stores to the script's own variables are still there, on top of any for new locals
+        for orig_func, round_trip_func in zip(_func_likes(stack_ir), _func_likes(round_trip)):
+            orig_stores = [instr for instr in orig_func["code"] if instr.get("op") == "STORE"]
+            round_trip_stores = [
+                instr for instr in round_trip_func["code"]
+                if instr.get("op") == "STORE" and (
+                    instr["whence"] != "LOCAL" or instr["index"] < len(orig_func["locals"]))
+            ]
+            self.assertEqual(orig_stores, round_trip_stores)
+        with self.assertRaises(ValueError):
+            lummao.convert_script_to_register_ir(lsl_src, superinstructions=True)
+        with self.assertRaises(ValueError):
+            lummao.convert_script_to_register_ir(lsl_src, cfg=True)
+        # Stats from the stack IR passes it was built from come along with it
+        self.assertIn("peephole_stats", lummao.convert_script_to_register_ir(lsl_src, peephole=True))
+
+    async def test_register_ir_malformed(self):
+        register_ir = lummao.convert_script_to_register_ir("""
+        default {
+            state_entry() {
+                llOwnerSay("hi");
+            }
+        }
+        """)
+
+        def _without(path):
+            broken = copy.deepcopy(register_ir)
+            container = broken
+            for key in path[:-1]:
+                container = container[key]
+            del container[path[-1]]
+            return broken
+
+        handler_path = ["states", 0, "handlers", 0]
+        for path in (
+            ["globals"],
+            ["init_code"],
+            ["states", 0, "handlers"],
+            handler_path + ["registers"],
+            handler_path + ["blocks", 0, "code"],
+            handler_path + ["blocks", 0, "code", 0, "op"],
+            handler_path + ["blocks", 0, "code", 0, "dest"],
+        ):
+            with self.subTest(path=path):
+                with self.assertRaises(ValueError):
+                    lummao.register_ir_to_stack_ir(_without(path), verify_types=True)
+
+    async def test_ir_dead_stores(self):
+        lsl_src = """
+        integer test(integer a) {
+            integer unread = 5;
+            integer b;
+            b = a * 2;
+            if (b > 4)
+                return b;
+            return a;
+        }
+        default {
+            state_entry() {
+                llOwnerSay((string)test(3));
+            }
+        }
+        """
+
+        def _test_func(ir):
+            return next(func for func in ir["functions"] if func["name"] == "test")
+
+        plain_code = _test_func(lummao.convert_script_to_ir(lsl_src))["code"]
+        ir = lummao.convert_script_to_ir(lsl_src, eliminate_dead_stores=True, cfg=True)
+        func = _test_func(ir)
+        stores = [
+            instr for instr in func["code"]
+            if instr.get("op") in ("STORE", "STORE_DEFAULT") and instr["whence"] == "LOCAL"
+        ]
+        # `unread` is never read and `b` is always stored to before it's read
+        self.assertEqual([("STORE", 1)], [(instr["op"], instr["index"]) for instr in stores])
+        self.assertNotIn(5, [instr.get("value") for instr in func["code"]])
+        self.assertLess(len(func["code"]), len(plain_code))
+        self.assertEqual(1, ir["dataflow_stats"]["dead_stores"])
+        self.assertEqual(1, ir["dataflow_stats"]["dead_store_defaults"])
+
+        blocks = func["cfg"]["blocks"]
+        self.assertEqual([], blocks[0]["preds"])
+        self.assertEqual(2, len(blocks[0]["succs"]))
+        for block_idx, block in enumerate(blocks):
+            for succ in block["succs"]:
+                self.assertIn(block_idx, blocks[succ]["preds"])
+
+        dot_ir = lummao.convert_script_to_ir(lsl_src, cfg="dot")
+        self.assertTrue(_test_func(dot_ir)["cfg"].startswith('digraph "test" {'))
+
+    async def test_ir_resolve(self):
+        lsl_src = """
+        integer twice(integer val) {
+            return val * 2;
+        }
+        default {
+            state_entry() {
+                integer i;
+                for (i = 0; i < 3; ++i) {
+                    if (twice(i) > 2)
+                        jump done;
+                }
+                @done;
+                llOwnerSay((string)i);
+                state other;
+            }
+        }
+        state other {
+            state_entry() {
+                {
+                    jump done;
+                    @done;
+                }
+                {
+                    jump done;
+                    @done;
+                }
+                llOwnerSay("other");
+            }
+        }
+        """
+        ir = lummao.convert_script_to_ir(lsl_src, resolve=True, cfg=True)
+        self.assertEqual([{"name": "llOwnerSay", "return": "void", "args": ["string"]}], ir["builtins"])
+        for state in ir["states"]:
+            code = state["handlers"][0]["code"]
+            for instr in code:
+                self.assertEqual("op", instr["instr_type"])
+                self.assertNotIn("label", instr)
+                if instr["op"] == "JUMP":
+                    self.assertLessEqual(instr["target"], len(code))
+                elif instr["op"] == "CALL":
+                    self.assertEqual("twice", ir["functions"][instr["function"]]["name"])
+                elif instr["op"] == "CALL_LIB":
+                    self.assertEqual(0, instr["builtin"])
+                elif instr["op"] == "CHANGE_STATE":
+                    self.assertEqual("other", ir["states"][instr["state"]]["name"])
+            self.assertEqual(len(code), state["handlers"][0]["cfg"]["blocks"][-1]["end"])
+
+        # Labels with the same name in different scopes don't get mixed up
+        code = lummao.convert_script_to_ir(lsl_src)["states"][1]["handlers"][0]["code"]
+        labels = [instr["label"] for instr in code if instr["instr_type"] == "label"]
+        self.assertEqual(2, len(set(labels)))
+        jumps = [instr["label"] for instr in code if instr.get("op") == "JUMP"]
+        self.assertEqual(labels, jumps)
+
+        # even when the renamed label would clash with one that's really called that
+        clash_labels = "".join(f"@done_{i};" for i in range(50))
+        clash_src = f"""
+        default {{
+            state_entry() {{
+                {clash_labels}
+                {{ jump done; @done; }}
+                {{ jump done; @done; }}
+            }}
+        }}
+        """
+        code = lummao.convert_script_to_ir(clash_src)["states"][0]["handlers"][0]["code"]
+        labels = [instr["label"] for instr in code if instr["instr_type"] == "label"]
+        self.assertEqual(52, len(set(labels)))
+        jumps = [instr["label"] for instr in code if instr.get("op") == "JUMP"]
+        self.assertEqual(labels[-2:], jumps)
+        lummao.convert_script_to_ir(clash_src, resolve=True)
+
+        # or with one of the labels made up for control flow, whichever comes first
+        temp_jump = 'jump LabelTempJump0; llOwnerSay("skipped"); @LabelTempJump0; llOwnerSay("b");'
+        temp_if = 'if (llGetUnixTime()) llOwnerSay("a");'
+        for body in (temp_if + temp_jump, temp_jump + temp_if):
+            with self.subTest(body=body):
+                code = lummao.convert_script_to_ir(
+                    "default { state_entry() { %s } }" % body
+                )["states"][0]["handlers"][0]["code"]
+                labels = [instr["label"] for instr in code if instr["instr_type"] == "label"]
+                self.assertEqual(len(labels), len(set(labels)))
+                user_jump = next(instr for instr in code if instr.get("jump_type") == "ALWAYS")
+                label_idx = next(
+                    i for i, instr in enumerate(code)
+                    if instr["instr_type"] == "label" and instr["label"] == user_jump["label"]
+                )
+                self.assertEqual("b", code[label_idx + 1]["value"])
+
+    async def test_ir_stack_depths(self):
+        lsl_src = """
+        integer add(integer a, integer b) {
+            return a + b;
+        }
+        default {
+            state_entry() {
+                integer i;
+                for (i = 0; i < 3; ++i)
+                    llOwnerSay((string)add(i, 1));
+            }
+        }
+        """
+        ir = lummao.convert_script_to_ir(lsl_src, stack_depths=True)
+        self.assertEqual(0, ir["init_max_stack"])
+        self.assertEqual(2, ir["functions"][0]["max_stack"])
+        handler = ir["states"][0]["handlers"][0]
+        # `PUSH_EMPTY` for the return value, then both args
+        self.assertEqual(3, handler["max_stack"])
+        code = handler["code"]
+        self.assertEqual([0, 0], [instr["stack_depth"] for instr in code if instr["instr_type"] == "label"])
+        effects = {instr["op"]: instr["stack_effect"] for instr in code if instr["instr_type"] == "op"}
+        self.assertEqual(-2, effects["CALL"])
+        self.assertEqual(-1, effects["CALL_LIB"])
+        self.assertEqual(1, effects["PUSH_EMPTY"])
+
+        # Entry depths end up on the ops jumps go to
+        code = lummao.convert_script_to_ir(lsl_src, stack_depths=True, resolve=True)["states"][0]["handlers"][0]["code"]
+        for instr in code:
+            if "target" in instr:
+                self.assertEqual(0, code[instr["target"]]["stack_depth"])
+
+        with self.assertRaises(ValueError):
+            lummao.convert_script_to_register_ir(lsl_src, stack_depths=True)
+
+    async def test_ir_verify_types(self):
+        lsl_src = """
+        vector v = <1, 2, 3>;
+        float scale(float f) {
+            return f * v.x;
+        }
+        default {
+            state_entry() {
+                integer i;
+                for (i = 0; i < 3; ++i)
+                    llOwnerSay((string)scale((float)i));
+            }
+        }
+        """
+        ir = lummao.convert_script_to_ir(lsl_src, verify_types=True)
+        code = ir["functions"][0]["code"]
+        bin_op = next(instr for instr in code if instr.get("op") == "BIN_OP")
+        self.assertEqual(["float", "float"], bin_op["stack_types"])
+        code = ir["states"][0]["handlers"][0]["code"]
+        call = next(instr for instr in code if instr.get("op") == "CALL")
+        self.assertEqual(["float", "float"], call["stack_types"])
+
+        # The value `int *= float` leaves on the stack isn't the float everything expects
+        with self.assertRaisesRegex(RuntimeError, "expected float, found integer"):
+            lummao.convert_script_to_ir("""
+            default {
+                state_entry() {
+                    integer i = 2;
+                    llOwnerSay((string)(i *= 1.5));
+                }
+            }
+            """, verify_types=True)
+
+    async def test_ir_reuse_local_slots(self):
+        lsl_src = """
+        default {
+            state_entry() {
+                if (llGetUnixTime() > 5) {
+                    integer a = 1;
+                    string s = "a";
+                    llOwnerSay(s + (string)a);
+                } else {
+                    integer b = 2;
+                    llOwnerSay((string)b);
+                }
+                integer c = 3;
+                llOwnerSay((string)c);
+            }
+        }
+        """
+        handler = lummao.convert_script_to_ir(lsl_src)["states"][0]["handlers"][0]
+        self.assertEqual(["integer", "string", "integer", "integer"], handler["locals"])
+
+        ir = lummao.convert_script_to_ir(lsl_src, reuse_local_slots=True)
+        handler = ir["states"][0]["handlers"][0]
+        self.assertEqual(["integer", "string"], handler["locals"])
+        self.assertEqual({"declared_locals": 4, "reused_slots": 2}, ir["local_slot_stats"])
+        stores = [instr["index"] for instr in handler["code"] if instr.get("op") == "STORE" and instr["type"] == "integer"]
+        self.assertEqual([0, 0, 0], stores)
+
+        # A jump could skip a declaration, so nothing gets shared
+        lsl_src = lsl_src.replace("integer c = 3;", "@skip; integer c = 3;")
+        ir = lummao.convert_script_to_ir(lsl_src, reuse_local_slots=True)
+        self.assertEqual(4, len(ir["states"][0]["handlers"][0]["locals"]))
+
+    async def test_ir_data_section(self):
+        lsl_src = """
+        integer a = 5;
+        integer b;
+        string s = "hi";
+        key k = "hi";
+        integer e = 2 + 3;
+        list l = [5, "hi"];
+        integer d = a;
+        default {
+            state_entry() {
+                a = 3;
+                llOwnerSay((string)[a, b, s, k, e, l, d]);
+            }
+        }
+        """
+        ir = lummao.convert_script_to_ir(lsl_src, data_section=True)
+        constants = ir["constants"]
+        data = ir["data"]
+        self.assertEqual(len(ir["globals"]), len(data))
+        self.assertEqual({"type": "integer", "value": 5}, constants[data[0]])
+        self.assertEqual({"type": "integer", "value": 0}, constants[data[1]])
+        self.assertEqual({"type": "string", "value": "hi"}, constants[data[2]])
+        self.assertEqual({"type": "key", "value": "hi"}, constants[data[3]])
+        # Identical values share an entry
+        self.assertEqual(data[0], data[4])
+        self.assertEqual({"type": "list", "value": [data[0], data[2]]}, constants[data[5]])
+        # `a` changes, so `d` still needs code to initialize it and starts out as 0 until then
+        self.assertEqual(data[1], data[6])
+        stores = [instr for instr in ir["init_code"] if instr.get("op") == "STORE"]
+        self.assertEqual([6], [instr["index"] for instr in stores])
+
+        self.assertEqual(data, lummao.convert_script_to_register_ir(lsl_src, data_section=True)["data"])
+        self.assertNotIn("data", lummao.convert_script_to_ir(lsl_src))
+
+    async def test_register_ir_cse_licm(self):
+        lsl_src = """
+        show(list l, integer n) {
+            integer i;
+            for (i = 0; i < llGetListLength(l) / 3; ++i) {
+                llOwnerSay((string)llList2Integer(l, i * 3));
+                llOwnerSay((string)llList2Integer(l, i * 3 + 1) + (string)(10 / n));
+            }
+        }
+        default {
+            state_entry() {
+                show([1, 2, 3, 4, 5, 6], 2);
+            }
+        }
+        """
+        ir = lummao.convert_script_to_register_ir(lsl_src, cse=True, licm=True)
+        self.assertEqual(1, ir["redundancy_stats"]["common_subexpressions"])
+        self.assertLess(0, ir["redundancy_stats"]["hoisted_ops"])
+
+        blocks = ir["functions"][0]["blocks"]
+        # The length is only worked out once, before the loop
+        length_block = next(block for block in blocks if any(
+            instr.get("name") == "llGetListLength" for instr in block["code"]))
+        self.assertEqual("ALWAYS", length_block["code"][-1]["jump_type"])
+        # but divisions stay in the loop, they could fail in a loop that never runs
+        self.assertFalse(any(instr.get("operation") == "DIV" for instr in length_block["code"]))
+
+        code = lummao.register_ir_to_stack_ir(ir)["functions"][0]["code"]
+        self.assertEqual(1, len([instr for instr in code if instr.get("name") == "llGetListLength"]))
+        self.assertEqual(1, len([instr for instr in code if instr.get("operation") == "MUL"]))
+
+        with self.assertRaises(ValueError):
+            lummao.convert_script_to_ir(lsl_src, cse=True)
+
+    async def test_run_execute_loop_typed(self):
+        py_src = lummao.convert_script_file(RESOURCES_PATH / "lsl_conformance2.lsl", typed_output=True)
+        # None of the things mypyc can't deal with
+        for unsupported in (b"async ", b"await ", b"locals()", b"__dict__", b"with_goto"):
+            self.assertNotIn(unsupported, py_src)
+        script = _compile_script_filename("lsl_conformance2.lsl", typed_output=True)
+        self.assertIsInstance(script, lummao.SyncLSLScript)
+        script.execute()
+        self.assertEqual(69, script.gTestsPassed)
+        self.assertEqual(0, script.gTestsFailed)
+
+    async def test_typed_output_passes_mypy_strict(self):
+        import mypy.api
+
+        py_src = lummao.convert_script_file(RESOURCES_PATH / "lsl_conformance2.lsl", typed_output=True)
+        with tempfile.TemporaryDirectory() as tmp_dir:
+            py_path = os.path.join(tmp_dir, "conformance2_typed.py")
+            with open(py_path, "wb") as f:
+                f.write(py_src)
+            # Only the generated code is being checked, not the rest of lummao
+            with unittest.mock.patch.dict(os.environ, {"MYPYPATH": str(BASE_PATH.parent)}):
+                stdout, stderr, status = mypy.api.run(
+                    ["--strict", "--follow-imports=silent", "--cache-dir", os.devnull, py_path]
+                )
+        self.assertEqual(0, status, stdout + stderr)
+
+        with self.assertRaises(ValueError):
+            lummao.convert_script("default{state_entry(){}}", typed_output=True, bind_helpers=True)
+
+    async def test_typed_incr_decr_in_expressions(self):
+        lsl_src = """
+        integer gCount = 2147483647;
+        vector gVec;
+        integer gResults;
+        default {
+            state_entry() {
+                integer i = 5;
+                integer pre = ++i;
+                integer post = i--;
+                integer wrapped = gCount++;
+                vector v = <1, 2, 3>;
+                float vy = v.y++;
+                float gvz = --gVec.z;
+                gResults = pre * 1000 + post * 100 + i * 10 + (gCount < 0) + (integer)(vy + v.y + gvz);
+            }
+        }
+        """
+        script = lummao.compile_script(lsl_src, typed_output=True)
+        script.edefaultstate_entry()
+        self.assertEqual(6000 + 600 + 50 + 1 + 4, script.gResults)
+        self.assertEqual((0.0, 0.0, -1.0), script.gVec)
+
+    async def test_typed_rejects_jumps(self):
+        with self.assertRaises(lummao.CompileError) as e:
+            lummao.convert_script_file(RESOURCES_PATH / "lsl_conformance.lsl", typed_output=True)
+        self.assertTrue(any("jumps can't be used" in msg for msg in e.exception.err_msgs))
+
+    async def test_profile_guided_recompile(self):
+        lsl_src = """
+        integer gHits;
+        integer classify(string cmd) {
+            if (cmd == "rare")
+                return 1;
+            else if (cmd == "common")
+                return 2;
+            return 0;
+        }
+        integer neverCalled(integer i) {
+            while (i < 10) {
+                gHits += i;
+                ++i;
+            }
+            return gHits;
+        }
+        default {
+            state_entry() {
+                integer i;
+                for (i = 0; i < 5; ++i)
+                    gHits += classify("common");
+                gHits += classify("rare");
+            }
+        }
+        """
+        script = lummao.compile_script(lsl_src, instrument=True)
+        await script.edefaultstate_entry()
+        self.assertEqual(11, script.gHits)
+        profile = script.profile
+        self.assertEqual(6, profile.calls["classify"])
+        self.assertEqual({"entries": 1, "iterations": 5}, list(profile.to_json()["loops"].values())[0])
+
+        py_src = lummao.convert_script(lsl_src, profile=profile, promote_loop_globals=True)
+        # The common case gets checked first now
+        self.assertLess(py_src.index(b'"common"'), py_src.index(b'"rare"'))
+        # Nothing worth doing for a function that never ran
+        self.assertNotIn(b"promoted_gHits", py_src)
+        script = lummao.compile_script(lsl_src, profile=json.dumps(profile.to_json()))
+        await script.edefaultstate_entry()
+        self.assertEqual(11, script.gHits)
+
+    async def test_eliminate_dead_vars(self):
+        lsl_src = """
+        integer gUnused = 5;
+        integer gWrittenOnly;
+        integer gCalls;
+        integer gResult;
+        integer bump() {
+            return ++gCalls;
+        }
+        default {
+            state_entry() {
+                integer unused = 1;
+                integer stored = bump();
+                if (gCalls)
+                    stored = 3;
+                integer nested = (stored = 9) + 1;
+                integer i;
+                for (i = 0; i < 2; ++i) {
+                    stored = bump();
+                }
+                gWrittenOnly = nested;
+                integer overwritten = bump();
+                if (gCalls > 5)
+                    overwritten = 4;
+                else
+                    overwritten = 5;
+                integer total;
+                for (i = 0; i < 3; ++i)
+                    total = total + i;
+                gResult = gResult + overwritten * 10 + total;
+            }
+        }
+        """
+        py_src = lummao.convert_script(lsl_src, eliminate_dead_vars=True)
+        for removed in (b"gUnused", b"gWrittenOnly", b"_unused", b"_stored"):
+            self.assertNotIn(removed, py_src)
+        # Overwritten on every path before it's read
+        self.assertIn(b"_overwritten: int\n", py_src)
+        self.assertNotIn(b"_overwritten: int = ", py_src)
+        # Read on the loop's next iteration
+        self.assertIn(b"_total: int = 0", py_src)
+        script = lummao.compile_script(lsl_src, eliminate_dead_vars=True)
+        await script.edefaultstate_entry()
+        # Side effects of dead stores must still happen
+        self.assertEqual(4, script.gCalls)
+        self.assertEqual(53, script.gResult)
+        self.assertFalse(hasattr(script, "gWrittenOnly"))
+
+    async def test_tree_shaking(self):
+        lsl_src = """
+        integer gTotal;
+        integer addOne(integer val) {
+            integer result = val + 1;
+            return result;
+        }
+        integer incremented(integer num) {
+            integer ret = num + 1;
+            return ret;
+        }
+        integer twice(integer val) {
+            return addOne(addOne(val));
+        }
+        integer twiceAgain(integer val) {
+            return incremented(incremented(val));
+        }
+        integer unused() {
+            return twice(5);
+        }
+        default {
+            state_entry() {
+                gTotal = twice(1) * 10 + twiceAgain(2);
+            }
+        }
+        """
+        py_src = lummao.convert_script(lsl_src, tree_shaking=True)
+        self.assertNotIn(b"def unused(", py_src)
+        self.assertNotIn(b"def incremented(", py_src)
+        self.assertNotIn(b"def twiceAgain(", py_src)
+        self.assertIn(b"twiceAgain = twice", py_src)
+        script = lummao.compile_script(lsl_src, tree_shaking=True)
+        await script.edefaultstate_entry()
+        self.assertEqual(34, script.gTotal)
+        self.assertEqual(5, await script.incremented(4))
+
+        ir = lummao.convert_script_to_ir(lsl_src, tree_shaking=True)
+        self.assertEqual(["addOne", "twice"], [func["name"] for func in ir["functions"]])
+
+    async def test_minify(self):
+        lsl_src = """
+        integer gUnused = 5;
+        integer gTotal = 0;
+        integer addUp(integer first, integer second) {
+            integer unread = llAbs(first);
+            return first + second;
+            gTotal = 99;
+        }
+        integer unusedFunc() {
+            return 1;
+        }
+        default {
+            state_entry() {
+                integer thing = 2 * 3 + 1;
+                if (FALSE) {
+                    gTotal = -1;
+                } else {
+                    gTotal = addUp(thing, 10);
+                }
+            }
+        }
+        """
+        minified = lummao.minify_script(lsl_src)
+        self.assertEqual(
+            b'integer a;\ninteger b(integer c,integer d){llAbs(c);return c+d;}\n'
+            b'default{state_entry(){integer c=7;a=b(c,10);}}\n',
+            minified,
+        )
+        script = lummao.compile_script(minified)
+        await script.edefaultstate_entry()
+        self.assertEqual(17, script.a)
+
+    async def test_minify_dead_store_conversion(self):
+        lsl_src = """
+        float gResult;
+        float half(integer val) {
+            float unread;
+            return (unread = val) / 2;
+        }
+        default {
+            state_entry() {
+                gResult = half(5);
+            }
+        }
+        """
+        minified = lummao.minify_script(lsl_src, shorten_identifiers=False)
+        # Storing to `unread` made the division a float one, the cast has to keep it that way
+        self.assertIn(b'return((float)(val))/2;', minified)
+        script = lummao.compile_script(minified)
+        await script.edefaultstate_entry()
+        self.assertEqual(2.5, script.gResult)
+
+    async def test_perf_lint(self):
+        lsl_src = """
+integer forever(integer val) {
+    return forever(val - 1);
+}
+integer countdown(integer val) {
+    if (val <= 0)
+        return 0;
+    return countdown(val - 1);
+}
+default {
+    state_entry() {
+        list items = [1, 2];
+        list out;
+        string str;
+        integer i;
+        integer num = 3;
+        for (i = 0; i < llGetListLength(items); ++i) {
+            out += [i];
+            str = str + (string)num + (string)num;
+        }
+        list big = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16];
+    }
+}
+"""
+        findings = lummao.perf_lint_script(lsl_src)
+        self.assertEqual([
+            (3, "unbounded-recursion"),
+            (17, "loop-condition-call"),
+            (18, "loop-accumulation"),
+            (19, "loop-accumulation"),
+            (19, "repeated-cast"),
+            (21, "large-list-literal"),
+        ], [(f["line"], f["code"]) for f in findings])
+
+    async def test_perf_lint_globals(self):
+        lsl_src = """
+list gItems = [1, 2];
+key gOwner;
+grow() {
+    gItems += [3];
+}
+reset() {
+    gOwner = NULL_KEY;
+}
+default {
+    state_entry() {
+        integer i;
+        for (i = 0; i < llGetListLength(gItems); ++i)
+            llOwnerSay((string)i);
+        for (i = 0; i < llGetListLength(gItems); ++i)
+            grow();
+        llOwnerSay((string)gOwner);
+        reset();
+        llOwnerSay((string)gOwner);
+    }
+}
+"""
+        findings = lummao.perf_lint_script(lsl_src)
+        # Builtins can't change globals, but calls to the script's own functions might
+        self.assertEqual([
+            (13, "loop-condition-call"),
+        ], [(f["line"], f["code"]) for f in findings])
+
+    async def test_long_binary_chains(self):
+        def _convert(num_terms):
+            lsl_src = _make_long_sum_script(num_terms)
+            start = time.perf_counter()
+            py_src = lummao.convert_script(lsl_src)
+            ir = lummao.convert_script_to_ir(lsl_src)
+            return py_src, ir, time.perf_counter() - start
+
+        _, _, small_time = _run_with_big_stack(lambda: _convert(50_000))
+        py_src, ir, big_time = _run_with_big_stack(lambda: _convert(100_000))
+        self.assertEqual(99_999, py_src.count(b"radd("))
+        code = ir["states"][0]["handlers"][0]["code"]
+        self.assertEqual(99_999, sum(1 for op in code if op.get("op") == "BIN_OP"))
+        # Twice the operands should take about twice as long, quadratic emission would take four times.
+        self.assertLess(big_time, small_time * 3 + 0.5)
+
+        lsl_src = _make_long_sum_script(5_000)
+        # CPython can't compile it nested that deeply, it has to be split up to run
+        script = lummao.compile_script(lsl_src, max_expression_depth=50)
+        await script.edefaultstate_entry()
+        self.assertEqual(5_000, script.gResult)
+
+    async def test_max_expression_depth(self):
+        lsl_src = _make_long_sum_script(1_000)
+        py_src = lummao.convert_script(lsl_src, max_expression_depth=50)
+        self.assertIn(b"(flat18 := ", py_src)
+        self.assertNotIn(b"flat19", py_src)
+        script = lummao.compile_script(lsl_src, max_expression_depth=50)
+        await script.edefaultstate_entry()
+        self.assertEqual(1_000, script.gResult)
+
+    async def test_max_expression_depth_nested_operands(self):
+        # Parentheses end the chain at every level, only their depth shows how deeply these nest
+        left_deep = "(" * 300 + "i" + " + i)" * 300
+        right_deep = "i + (" * 300 + "i" + ")" * 300
+        lsl_src = """
+        integer gResult;
+        default {
+            state_entry() {
+                integer i = 1;
+                gResult = (%s) - (%s) * 2;
+            }
+        }
+        """ % (left_deep, right_deep)
+        py_src = lummao.convert_script(lsl_src, max_expression_depth=50)
+        self.assertIn(b"(flat0 := ", py_src)
+        script = lummao.compile_script(lsl_src, max_expression_depth=50)
+        await script.edefaultstate_entry()
+        self.assertEqual(301 - 301 * 2, script.gResult)
+
+    async def test_max_expression_depth_nested_literals(self):
+        # List and vector literals add a level of brackets each, so count towards the depth too
+        nestings = {
+            "list": ("llList2Integer([i + ", "], 0)"),
+            "vector": ("(integer)llVecMag(<i + ", ", 0, 0>)"),
+        }
+        for name, (prefix, suffix) in nestings.items():
+            with self.subTest(literal=name):
+                lsl_src = """
+                integer gResult;
+                default {
+                    state_entry() {
+                        integer i = 1;
+                        gResult = i + %s;
+                    }
+                }
+                """ % (prefix * 150 + "i" + suffix * 150)
+                py_src = lummao.convert_script(lsl_src, max_expression_depth=50)
+                self.assertIn(b"(flat0 := ", py_src)
+                script = lummao.compile_script(lsl_src, max_expression_depth=50)
+                await script.edefaultstate_entry()
+                self.assertEqual(152, script.gResult)
+
+    async def test_max_expression_depth_evaluation_order(self):
+        lsl_src = """
+        string gLog;
+        integer gResult;
+        integer logged(string name, integer val) {
+            gLog += name;
+            return val;
+        }
+        default {
+            state_entry() {
+                integer i = 3;
+                gResult = logged("a", 1) - logged("b", 2) * i - logged("c", 4) + i - (i = 5) - logged("d", 6) + i;
+            }
+        }
+        """
+        expected = lummao.compile_script(lsl_src)
+        await expected.edefaultstate_entry()
+        script = lummao.compile_script(lsl_src, max_expression_depth=2)
+        await script.edefaultstate_entry()
+        self.assertEqual(expected.gLog, script.gLog)
+        self.assertEqual(expected.gResult, script.gResult)
+
+    async def test_coord_member_mutation(self):
+        lsl_src = """
+        vector gVec = <1, 2, 3>;
+        rotation gRot;
+        default {
+            state_entry() {
+                gVec.y++;
+                --gRot.s;
+                gVec.z -= 0.5;
+            }
+        }
+        """
+        # The coordinates should be built directly, not through the generic helper
+        self.assertNotIn(b"replace_coord_axis", lummao.convert_script(lsl_src))
+        script = lummao.compile_script(lsl_src)
+        await script.edefaultstate_entry()
+        self.assertEqual((1.0, 3.0, 2.5), script.gVec)
+        self.assertEqual((0.0, 0.0, 0.0, 0.0), script.gRot)
+
     async def test_jump_out_of_while_true(self):
         # Make sure Python's code optimization didn't break our
         # ability to jump out of a `while True` loop
@@ -389,14 +389,14 @@ class Script(BaseLSLScript):
         self.gRot = Quaternion((3.0, 3.0, 3.0, 3.0))
         await self.ensureRotationEqual("-gRot = <-3,-3,-3,-3>", neg(self.gRot), Quaternion((-3.0, -3.0, -3.0, -3.0)))
         _v = Vector((0.0, 0.0, 0.0))
-        _v = replace_coord_axis(_v, 0, 3.0)
+        _v = Vector((3.0, _v[1], _v[2]))
         await self.ensureFloatEqual("v.x", _v[0], 3.0)
         _q = Quaternion((0.0, 0.0, 0.0, 1.0))
-        _q = replace_coord_axis(_q, 3, 5.0)
+        _q = Quaternion((_q[0], _q[1], _q[2], 5.0))
         await self.ensureFloatEqual("q.s", _q[3], 5.0)
-        self.gVector = replace_coord_axis(self.gVector, 1, 17.5)
+        self.gVector = Vector((self.gVector[0], 17.5, self.gVector[2]))
         await self.ensureFloatEqual("gVector.y = 17.5", self.gVector[1], 17.5)
-        self.gRot = replace_coord_axis(self.gRot, 2, 19.5)
+        self.gRot = Quaternion((self.gRot[0], self.gRot[1], 19.5, self.gRot[3]))
         await self.ensureFloatEqual("gRot.z = 19.5", self.gRot[2], 19.5)
         _l = typecast(5, list)
         _l2 = typecast(5, list)
@@ -412,12 +412,12 @@ class Script(BaseLSLScript):
             pass
         await self.ensureListEqual("gCallOrder expected order", self.gCallOrder, [5, 4, 3, 2, 1, 0])
         await self.ensureIntegerEqual("(gInteger = 5)", (assign(self.__dict__, "gInteger", 5)), 5)
-        await self.ensureFloatEqual("(gVector.z = 6)", (assign(self.__dict__, "gVector", replace_coord_axis(self.gVector, 2, 6.0))[2]), 6.0)
+        await self.ensureFloatEqual("(gVector.z = 6)", (assign(self.__dict__, "gVector", Vector((self.gVector[0], self.gVector[1], 6.0)))[2]), 6.0)
         self.gVector = Vector((1.0, 2.0, 3.0))
         await self.ensureFloatEqual("++gVector.z", preincr(self.__dict__, "gVector", 2), 4.0)
         self.gVector = Vector((1.0, 2.0, 3.0))
         await self.ensureFloatEqual("gVector.z++", postincr(self.__dict__, "gVector", 2), 3.0)
-        await self.ensureFloatEqual("(v.z = 6)", ((_v := replace_coord_axis(_v, 2, 6.0))[2]), 6.0)
+        await self.ensureFloatEqual("(v.z = 6)", ((_v := Vector((_v[0], _v[1], 6.0)))[2]), 6.0)
         _v = Vector((1.0, 2.0, 3.0))
         await self.ensureFloatEqual("++v.z", preincr(locals(), "_v", 2), 4.0)
         _v = Vector((1.0, 2.0, 3.0))
@@ -106,16 +106,16 @@ class Script(BaseLSLScript):
 
     async def testArgumentAccessor(self, _v: Vector) -> None:
         _v = Vector((0.0, 0.0, 0.0))
-        _v = replace_coord_axis(_v, 0, await self.testReturnFloat())
-        _v = replace_coord_axis(_v, 1, await self.testReturnFloat())
-        _v = replace_coord_axis(_v, 2, await self.testReturnFloat())
+        _v = Vector((await self.testReturnFloat(), _v[1], _v[2]))
+        _v = Vector((_v[0], await self.testReturnFloat(), _v[2]))
+        _v = Vector((_v[0], _v[1], await self.testReturnFloat()))
         await self.ensureVectorEqual("testArgumentAccessor", _v, Vector((1.0, 1.0, 1.0)))
 
     async def testLocalAccessor(self) -> None:
         _v: Vector = Vector((0.0, 0.0, 0.0))
-        _v = replace_coord_axis(_v, 0, await self.testReturnFloat())
-        _v = replace_coord_axis(_v, 1, await self.testReturnFloat())
-        _v = replace_coord_axis(_v, 2, await self.testReturnFloat())
+        _v = Vector((await self.testReturnFloat(), _v[1], _v[2]))
+        _v = Vector((_v[0], await self.testReturnFloat(), _v[2]))
+        _v = Vector((_v[0], _v[1], await self.testReturnFloat()))
         await self.ensureVectorEqual("testLocalAccessor", _v, Vector((1.0, 1.0, 1.0)))
 
     async def testGlobalAccessor(self) -> None: